@@ -46,6 +46,7 @@
 namespace DShow {
 /* internal forward */
 struct HDevice;
+struct HFrame;
 struct HVideoEncoder;
 struct VideoConfig;
 struct AudioConfig;
@@ -62,6 +63,84 @@ typedef std::function<void(const AudioConfig &config, unsigned char *data,
 
 typedef std::function<void()> ReactivateProc;
 
+typedef std::function<void(const VideoConfig &config)> VideoFormatChangeProc;
+typedef std::function<void(const AudioConfig &config)> AudioFormatChangeProc;
+
+/**
+ * Reference to captured frame data.  Unlike the data pointer given to
+ * VideoProc, the data stays valid until the last reference is released, and
+ * references can be copied and released from any thread.
+ */
+class DSHOWCAPTURE_EXPORT FrameRef {
+	HFrame *frame = nullptr;
+
+public:
+	inline FrameRef() {}
+	explicit FrameRef(HFrame *frame);
+	FrameRef(const FrameRef &ref);
+	FrameRef(FrameRef &&ref) noexcept;
+	~FrameRef();
+
+	FrameRef &operator=(const FrameRef &ref);
+	FrameRef &operator=(FrameRef &&ref) noexcept;
+
+	bool Valid() const;
+	void Release();
+
+	unsigned char *Data() const;
+	size_t Size() const;
+	long long StartTime() const;
+	long long StopTime() const;
+
+	/**
+	 * Timestamps mapped to the host's monotonic clock (the
+	 * QueryPerformanceCounter timeline, in 100-nanosecond units), which
+	 * removes the device's own epoch and drift.  0 if not available.
+	 */
+	long long HostStartTime() const;
+	long long HostStopTime() const;
+
+	/**
+	 * Whether the device gave no timestamps for this frame, and they were
+	 * generated by the library instead
+	 * (see VideoConfig::synthesizeTimestamps).
+	 */
+	bool Synthesized() const;
+
+	/**
+	 * Whether the frame is identical to the previous one
+	 * (see VideoConfig::duplicateFrames).
+	 */
+	bool Duplicate() const;
+
+	/**
+	 * Whether the data had to be copied out of the device's buffers
+	 * instead of being leased directly from them.
+	 */
+	bool Copied() const;
+};
+
+typedef std::function<void(const VideoConfig &config, const FrameRef &frame,
+			   long rotation)>
+	VideoFrameProc;
+
+typedef std::function<void(const AudioConfig &config, const FrameRef &frame)>
+	AudioFrameProc;
+
+/**
+ * Delivers an encoded access unit as the list of segments it arrived in.
+ * The timestamps are those of the first segment.
+ */
+typedef std::function<void(const VideoConfig &config, const FrameRef *segments,
+			   size_t count, long long startTime,
+			   long long stopTime)>
+	VideoSegmentProc;
+
+typedef std::function<void(const AudioConfig &config, const FrameRef *segments,
+			   size_t count, long long startTime,
+			   long long stopTime)>
+	AudioSegmentProc;
+
 enum class InitGraph {
 	False,
 	True,
@@ -90,6 +169,10 @@ enum class VideoFormat {
 	YV12,
 	Y800,
 	P010,
+	/* 10-bit planar, samples in the lower bits; conversion output only */
+	I010,
+	/* P010 with the samples expanded to 16 bits; conversion output only */
+	P016,
 
 	/* packed YUV formats */
 	YVYU = 300,
@@ -129,12 +212,215 @@ enum class Result {
 	Error,
 };
 
+/** What to do with a raw video frame identical to the previous one */
+enum class DuplicateMode {
+	Deliver,
+	/** Deliver it, marked with FrameRef::Duplicate */
+	Flag,
+	/** Drop it before it reaches any consumer */
+	Suppress,
+};
+
+enum class ColorMatrix {
+	BT601,
+	BT709,
+	BT2020,
+};
+
+enum class ColorRange {
+	/** 16-235 luma, 16-240 chroma */
+	Limited,
+	Full,
+};
+
+enum class ColorTransfer {
+	Unspecified,
+	/** BT.601/709/2020 SDR */
+	BT709,
+	SRGB,
+	Linear,
+	/** SMPTE ST 2084 */
+	PQ,
+	HLG,
+};
+
+/** How raw video is resized when the device can't provide the desired size */
+enum class ScaleMode {
+	/** Use whatever size is closest */
+	None,
+	Bilinear,
+	/** Average all covered pixels when downscaling, bilinear otherwise */
+	Area,
+};
+
+/** What to do when a delivery queue is full */
+enum class OverflowPolicy {
+	DropOldest,
+	DropNewest,
+	Block,
+};
+
+struct QueueConfig {
+	/**
+	 * Number of samples that can be queued for delivery.  When 0, samples
+	 * are delivered directly on the device's streaming thread.
+	 */
+	int depth = 0;
+
+	OverflowPolicy overflow = OverflowPolicy::DropOldest;
+
+	/**
+	 * Maximum time (in milliseconds) to block the streaming thread with
+	 * OverflowPolicy::Block before dropping the new sample
+	 */
+	int blockTimeoutMs = 10;
+
+	/**
+	 * Don't create a delivery thread, samples are read with
+	 * Device::ReadVideoFrame instead of being sent to the callback
+	 * (video only)
+	 */
+	bool pull = false;
+};
+
+/**
+ * Additional consumer of a device's stream.  Sinks receive the same frames as
+ * the main callback without copying them.  Encoded access units are only
+ * given to sinks when they are assembled, not when segmentCallback is used.
+ */
+struct VideoSinkConfig {
+	VideoFrameProc callback;
+
+	/** Delivery queue for this sink (pull mode is not supported) */
+	QueueConfig queue;
+
+	/**
+	 * Minimum interval between frames given to this sink (in
+	 * 100-nanosecond units), 0 for every frame
+	 */
+	long long frameInterval = 0;
+};
+
+struct AudioSinkConfig {
+	AudioFrameProc callback;
+
+	/** Delivery queue for this sink (pull mode is not supported) */
+	QueueConfig queue;
+};
+
+/**
+ * Delivers a video frame along with the audio covering its time span.  The
+ * video frame is invalid for audio released while there is no video.
+ */
+typedef std::function<void(const VideoConfig &videoConfig,
+			   const FrameRef &video, long rotation,
+			   const AudioConfig &audioConfig,
+			   const FrameRef *audio, size_t audioCount)>
+	AVBundleProc;
+
+struct AVSyncConfig {
+	AVBundleProc callback;
+
+	/**
+	 * Maximum time (in milliseconds) a video frame is held back waiting
+	 * for the audio that covers it
+	 */
+	int maxWaitMs = 40;
+
+	/** Delivery queue for bundles (pull mode is not supported) */
+	QueueConfig queue;
+};
+
+struct QueueStats {
+	int depth;
+	long maxQueued;
+	long long queued;
+	long long delivered;
+	long long droppedOldest;
+	long long droppedNewest;
+	long long droppedTimeout;
+	/**
+	 * Frames left in the queue when it was stopped.  Queues with a
+	 * callback deliver everything first, so these are frames that were
+	 * never pulled.  Once stopped, queued equals delivered plus
+	 * droppedOldest plus droppedStop.
+	 */
+	long long droppedStop;
+};
+
+#define DSHOW_STATS_HISTOGRAM_BUCKETS 24
+
+/**
+ * Fixed-bucket histogram of durations in microseconds.  Bucket 0 holds
+ * values below 2us, bucket n holds values in [2^n, 2^(n+1)) us, and the last
+ * bucket is open-ended.
+ */
+struct StatsHistogram {
+	long long buckets[DSHOW_STATS_HISTOGRAM_BUCKETS];
+	long long count;
+	long long sumUs;
+	long long maxUs;
+};
+
+struct StreamStats {
+	/** Samples received from the device */
+	long long samples;
+	/** Frames handed to the callbacks */
+	long long delivered;
+	long long mediaTypeChanges;
+
+	long long droppedNoTimestamp;
+	/** Samples given generated timestamps instead of being dropped */
+	long long synthesized;
+	long long droppedEmpty;
+	long long droppedBadPointer;
+	long long droppedReactivating;
+	/** Frames dropped to reach VideoConfig::outputInterval */
+	long long droppedDecimated;
+	/** Frames identical to their predecessor, and how many were dropped */
+	long long duplicates;
+	long long droppedDuplicate;
+	/** Samples too small to convert to VideoConfig::format */
+	long long droppedConversion;
+	/** Sum of all drops reported by the delivery queue, if any */
+	long long droppedQueue;
+	/**
+	 * Sum of all drops reported by the delivery queues of sinks, counted
+	 * from when each sink was added rather than from the device's start
+	 */
+	long long droppedSinkQueues;
+
+	/** Interval between sample arrivals */
+	StatsHistogram arrivalInterval;
+	/** Distance of the arrival interval from frameInterval (video only) */
+	StatsHistogram arrivalJitter;
+	/**
+	 * Stream time at delivery minus the sample's start time.  Only
+	 * recorded when the graph has a reference clock.  Samples with
+	 * synthesized timestamps are measured from their host time instead.
+	 */
+	StatsHistogram deliveryLatency;
+	/** Time spent inside the callback */
+	StatsHistogram callbackDuration;
+};
+
+struct CaptureStats {
+	StreamStats video;
+	StreamStats audio;
+};
+
 struct VideoInfo {
 	int minCX, minCY;
 	int maxCX, maxCY;
 	int granularityCX, granularityCY;
 	long long minInterval, maxInterval;
 	VideoFormat format;
+
+	/**
+	 * Estimated bytes per second at the largest size and highest frame
+	 * rate, with typical compression for encoded formats
+	 */
+	long long bandwidth;
 };
 
 struct AudioInfo {
@@ -169,6 +455,36 @@ struct VideoConfig : Config {
 	VideoProc callback;
 	ReactivateProc reactivateCallback;
 
+	/**
+	 * Optional.  If set, frames are delivered to this callback instead
+	 * of callback, and may be held for as long as the consumer needs
+	 * them without having to copy them first.
+	 *
+	 * Note that holding on to frames keeps the device's buffers in use;
+	 * frames are only copied when the device is about to run out of
+	 * buffers.
+	 */
+	VideoFrameProc frameCallback;
+
+	/**
+	 * Optional, encoded formats only.  If set, access units are delivered
+	 * as a list of the segments they arrived in instead of being assembled
+	 * into a single contiguous buffer.  Not used with QueueConfig::pull.
+	 */
+	VideoSegmentProc segmentCallback;
+
+	/**
+	 * Optional.  Called from the streaming thread when the device
+	 * switches to a different media type mid-stream, with the updated
+	 * config, before any sample in the new format is delivered.
+	 *
+	 * The callback may read the device's config and statistics and add
+	 * or remove sinks.  It must not call Stop, SetVideoConfig,
+	 * SetAudioConfig, ConnectFilters, ResetGraph or ShutdownGraph, as
+	 * those wait for the streaming thread it is running on.
+	 */
+	VideoFormatChangeProc formatChangeCallback;
+
 	/** Desired width/height of video. */
 	int cx = 0, cy_abs = 0;
 
@@ -178,16 +494,121 @@ struct VideoConfig : Config {
 	/** Desired frame interval (in 100-nanosecond units) */
 	long long frameInterval = 0;
 
+	/**
+	 * Interval of the frames given to consumers (in 100-nanosecond
+	 * units), if it should be lower than the rate negotiated with the
+	 * device.  Frames are selected by timestamp and the rest are dropped
+	 * before any consumer sees them.  Raw formats only, 0 to disable.
+	 */
+	long long outputInterval = 0;
+
 	/** Internal video format. */
 	VideoFormat internalFormat = VideoFormat::Any;
 
 	/** Desired video format. */
 	VideoFormat format = VideoFormat::Any;
+
+	/** Delivery queue between the device and the callback */
+	QueueConfig queue;
+
+	/**
+	 * How often (in milliseconds) the device is polled for HDR signal
+	 * changes.  Only used if reactivateCallback is set.
+	 */
+	int hdrPollIntervalMs = 250;
+
+	/**
+	 * How often (in milliseconds) the roll of rotatable devices (such as
+	 * the StreamCam) is polled
+	 */
+	int rotationPollIntervalMs = 500;
+
+	/**
+	 * Rotate raw frames of rotatable devices by their roll (clockwise, in
+	 * degrees) before delivery, so that consumers get upright frames with
+	 * a rotation of 0.  cx/cy_abs are swapped while the device is on its
+	 * side, and formatChangeCallback is called whenever that changes.
+	 * NV12, I420, YV12, Y800, XRGB and ARGB output only, the rotation is
+	 * passed on as before otherwise.
+	 */
+	bool applyRotation = false;
+
+	/**
+	 * Generate timestamps for raw video samples the device delivers
+	 * without any, based on their arrival time and frameInterval, instead
+	 * of dropping them.  Use FrameRef::Synthesized to tell them apart.
+	 */
+	bool synthesizeTimestamps = false;
+
+	/**
+	 * Detection of repeated frames, such as those sent by capture cards
+	 * when the source runs at a lower rate or has lost signal.  Frames
+	 * are compared to the previous distinct frame over a sample of 64
+	 * rows, so a change confined to the rows in between is missed.
+	 */
+	DuplicateMode duplicateFrames = DuplicateMode::Deliver;
+
+	/**
+	 * Matrix and range of the YUV frames produced when RGB video is
+	 * converted to a YUV format (see internalFormat/format).
+	 */
+	ColorMatrix conversionMatrix = ColorMatrix::BT709;
+	ColorRange conversionRange = ColorRange::Limited;
+
+	/**
+	 * Colorimetry of the delivered video.  Set from the extended format
+	 * flags of the device's media type (VIDEOINFOHEADER2) when the format
+	 * is negotiated and whenever it changes, and from conversionMatrix and
+	 * conversionRange for RGB converted to YUV.  colorSignaled is false if
+	 * the device doesn't specify any, in which case these are the usual
+	 * defaults (BT.709, limited range).
+	 */
+	ColorMatrix colorMatrix = ColorMatrix::BT709;
+	ColorRange colorRange = ColorRange::Limited;
+	ColorTransfer colorTransfer = ColorTransfer::Unspecified;
+	bool colorSignaled = false;
+
+	/**
+	 * If not None and the device doesn't offer cx/cy_abs itself, the
+	 * smallest larger size is negotiated instead (or the closest one if
+	 * there is none) and frames are scaled to cx/cy_abs before delivery.
+	 * Raw I420, YV12, NV12, Y800, packed 4:2:2, XRGB and ARGB output
+	 * only.
+	 */
+	ScaleMode scaling = ScaleMode::None;
+
+	/**
+	 * If nonzero, formats whose estimated bandwidth (see
+	 * VideoInfo::bandwidth) exceeds this many bytes per second are avoided
+	 * in favor of less demanding ones, such as NV12 or MJPEG instead of
+	 * YUY2.  To share a USB controller between devices, give each of them
+	 * a part of its budget.  Ignored with useDefaultConfig.
+	 */
+	long long bandwidthBudget = 0;
 };
 
 struct AudioConfig : Config {
 	AudioProc callback;
 
+	/**
+	 * Optional, encoded formats only.  If set, access units are delivered
+	 * as a list of the segments they arrived in instead of being assembled
+	 * into a single contiguous buffer.
+	 */
+	AudioSegmentProc segmentCallback;
+
+	/**
+	 * Optional.  Called from the streaming thread when the device
+	 * switches to a different media type mid-stream, with the updated
+	 * config, before any sample in the new format is delivered.
+	 *
+	 * The callback may read the device's config and statistics and add
+	 * or remove sinks.  It must not call Stop, SetVideoConfig,
+	 * SetAudioConfig, ConnectFilters, ResetGraph or ShutdownGraph, as
+	 * those wait for the streaming thread it is running on.
+	 */
+	AudioFormatChangeProc formatChangeCallback;
+
 	/**
 		 * Use the audio attached to the video device
 		 *
@@ -209,6 +630,22 @@ struct AudioConfig : Config {
 
 	/** Audio playback mode */
 	AudioMode mode = AudioMode::Capture;
+
+	/**
+	 * Buffer size to negotiate with the driver, in milliseconds.  0 leaves
+	 * the driver's default buffering.
+	 */
+	int bufferingMs = 10;
+
+	/**
+	 * If nonzero, consecutive PCM packets are merged into chunks of this
+	 * many milliseconds before being delivered, with timestamps derived
+	 * from the sample count.  Ignored for encoded formats.
+	 */
+	int coalesceMs = 0;
+
+	/** Delivery queue between the device and the callback */
+	QueueConfig queue;
 };
 
 class DSHOWCAPTURE_EXPORT Device {
@@ -222,6 +659,13 @@ public:
 	~Device();
 
 	bool        Valid() const;
+
+	/**
+	 * Deprecated.  Configuration changes no longer need to be guarded:
+	 * samples are delivered from an immutable copy of the configuration,
+	 * so holding access neither stalls nor drops them.  Only excludes
+	 * other callers of GetAccess, and is kept for compatibility.
+	 */
 	void        GetAccess();
 	void        ReleaseAccess();
 
@@ -246,6 +690,52 @@ public:
 	bool GetVideoDeviceId(DeviceId &id) const;
 	bool GetAudioDeviceId(DeviceId &id) const;
 
+	/**
+	 * Reads the next video frame when the video queue is configured with
+	 * QueueConfig::pull.
+	 *
+	 * @param  frame      Receives the frame
+	 * @param  timeoutMs  Maximum time to wait for a frame
+	 * @param  rotation   Optional, receives the frame's rotation
+	 * @return            false if no frame arrived before the timeout
+	 */
+	bool ReadVideoFrame(FrameRef &frame, unsigned long timeoutMs,
+			    long *rotation = nullptr);
+
+	bool GetVideoQueueStats(QueueStats &stats) const;
+	bool GetAudioQueueStats(QueueStats &stats) const;
+
+	/** Statistics are reset each time the device is started */
+	void GetStats(CaptureStats &stats) const;
+
+	/**
+	 * Adds an additional consumer to the video or audio stream.  Sinks
+	 * can be added and removed while the device is running.
+	 *
+	 * @return  Sink id, or 0 on failure
+	 */
+	int AddVideoSink(const VideoSinkConfig &config);
+	int AddAudioSink(const AudioSinkConfig &config);
+
+	/**
+	 * Removes a sink.  Once this returns, the sink's callback will not be
+	 * called again.
+	 *
+	 * May be called from any callback, including the sink's own, in which
+	 * case the call it is made from is the last one.  It waits for the
+	 * sink's callback to return on other threads, so a sink callback must
+	 * not remove a sink whose callback waits for it in turn.
+	 */
+	bool RemoveSink(int id);
+
+	/**
+	 * Delivers the device's audio and video as time aligned bundles, in
+	 * addition to the regular callbacks.  Requires both video and audio
+	 * to be configured, and can only be changed while inactive.  Pass
+	 * null to disable.
+	 */
+	bool SetAVSyncConfig(const AVSyncConfig *config);
+
 	/**
 		 * Opens a DirectShow dialog associated with this device
 		 *
@@ -307,4 +797,26 @@ enum class LogType {
 typedef void (*LogCallback)(LogType type, const wchar_t *msg, void *param);
 
 DSHOWCAPTURE_EXPORT void SetLogCallback(LogCallback callback, void *param);
+
+/**
+ * Called from a background thread when revalidating cached capabilities
+ * finds that a device now has different ones than the cache returned.
+ * Exactly one of video and audio is set, and holds the device's current
+ * capabilities (which are cached from then on).
+ */
+typedef void (*CapsChangedCallback)(const VideoDevice *video,
+				    const AudioDevice *audio, void *param);
+
+/**
+ * Enables the capability cache, which is disabled by default.  While it's
+ * enabled, Device::EnumVideoDevices and Device::EnumAudioDevices with
+ * activate set return the cached capabilities of devices whose driver hasn't
+ * changed without opening them, and then check them again in the background.
+ *
+ * @param  file      Cache file, or null to disable the cache
+ * @param  callback  Optional, called with any differences found
+ */
+DSHOWCAPTURE_EXPORT void SetCapsCache(const wchar_t *file,
+				      CapsChangedCallback callback,
+				      void *param);
 };
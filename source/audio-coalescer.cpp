@@ -0,0 +1,111 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "audio-coalescer.hpp"
+
+/* 100-nanosecond units */
+#define RESYNC_THRESHOLD (10 * 10000LL)
+
+namespace DShow {
+
+AudioCoalescer::AudioCoalescer() : pool(std::make_shared<BufferPool>()) {}
+
+void AudioCoalescer::Reset(int chunkMs, int sampleRate_, int blockAlign_,
+			   ChunkProc output_)
+{
+	buffer.clear();
+	anchored = false;
+	emittedSamples = 0;
+
+	if (chunkMs <= 0 || sampleRate_ <= 0 || blockAlign_ <= 0) {
+		chunkBytes = 0;
+		output = nullptr;
+		return;
+	}
+
+	sampleRate = sampleRate_;
+	blockAlign = (size_t)blockAlign_;
+	output = std::move(output_);
+
+	size_t chunkSamples = (size_t)(sampleRate * chunkMs / 1000);
+	if (!chunkSamples)
+		chunkSamples = 1;
+
+	chunkBytes = chunkSamples * blockAlign;
+	buffer.reserve(chunkBytes * 2);
+	pool->Observe(chunkBytes);
+}
+
+void AudioCoalescer::Emit(size_t bytes)
+{
+	long long samples = (long long)(bytes / blockAlign);
+	long long startTime = TimeAt(emittedSamples);
+	long long stopTime = TimeAt(emittedSamples + samples);
+
+	std::vector<unsigned char> chunk = pool->Acquire();
+	chunk.assign(buffer.begin(), buffer.begin() + bytes);
+	buffer.erase(buffer.begin(), buffer.begin() + bytes);
+
+	emittedSamples += samples;
+	output(std::move(chunk), startTime, stopTime);
+}
+
+void AudioCoalescer::Push(const unsigned char *data, size_t size,
+			  bool hasTime, long long startTime)
+{
+	if (!Active())
+		return;
+
+	if (hasTime) {
+		long long buffered = (long long)(buffer.size() / blockAlign);
+		long long expected = TimeAt(emittedSamples + buffered);
+		long long diff = startTime - expected;
+
+		if (!anchored || diff > RESYNC_THRESHOLD ||
+		    diff < -RESYNC_THRESHOLD) {
+			Flush();
+
+			anchored = true;
+			anchorTime = startTime;
+			emittedSamples = 0;
+		}
+
+	} else if (!anchored) {
+		return;
+	}
+
+	buffer.insert(buffer.end(), data, data + size);
+
+	while (buffer.size() >= chunkBytes)
+		Emit(chunkBytes);
+}
+
+void AudioCoalescer::Flush()
+{
+	if (!Active())
+		return;
+
+	size_t bytes = buffer.size() - buffer.size() % blockAlign;
+	if (bytes)
+		Emit(bytes);
+
+	buffer.clear();
+}
+
+}; /* namespace DShow */
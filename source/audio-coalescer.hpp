@@ -0,0 +1,92 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "frame.hpp"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace DShow {
+
+/*
+ * Merges consecutive PCM samples into chunks of a fixed duration.  Chunk
+ * timestamps are derived from the sample count since the last timestamp the
+ * stream was anchored to, so small per-packet timestamp noise does not reach
+ * the consumer.  A packet whose timestamp is too far from the predicted one
+ * flushes the partial chunk and re-anchors the stream.
+ */
+class AudioCoalescer {
+public:
+	typedef std::function<void(std::vector<unsigned char> &&chunk,
+				   long long startTime, long long stopTime)>
+		ChunkProc;
+
+private:
+	std::shared_ptr<BufferPool> pool;
+	std::vector<unsigned char> buffer;
+	ChunkProc output;
+
+	size_t chunkBytes = 0;
+	size_t blockAlign = 0;
+	long long sampleRate = 0;
+
+	bool anchored = false;
+	long long anchorTime = 0;
+	long long emittedSamples = 0;
+
+	inline long long TimeAt(long long samples) const
+	{
+		return anchorTime + samples * 10000000LL / sampleRate;
+	}
+
+	void Emit(size_t bytes);
+
+public:
+	AudioCoalescer();
+
+	/**
+	 * Configures the coalescer, a chunkMs of 0 (or an unusable format)
+	 * disables it.  Any buffered data is discarded.
+	 */
+	void Reset(int chunkMs, int sampleRate, int blockAlign,
+		   ChunkProc output);
+
+	inline bool Active() const { return chunkBytes != 0; }
+
+	/** Pool the chunk buffers come from, chunks may be recycled to it */
+	inline const std::shared_ptr<BufferPool> &GetPool() const
+	{
+		return pool;
+	}
+
+	/**
+	 * Appends a packet.  Packets without a timestamp continue the current
+	 * stream and are discarded if the stream has not been anchored yet.
+	 */
+	void Push(const unsigned char *data, size_t size, bool hasTime,
+		  long long startTime);
+
+	/** Delivers any buffered data as a short chunk */
+	void Flush();
+};
+
+}; /* namespace DShow */
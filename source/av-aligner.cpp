@@ -0,0 +1,142 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "av-aligner.hpp"
+
+/* audio is held for this many maxWait periods when there is no video */
+#define AUDIO_ONLY_WAIT_FACTOR 4
+
+namespace DShow {
+
+static inline long long AlignStart(const FrameRef &frame)
+{
+	long long host = frame.HostStartTime();
+	return host ? host : frame.StartTime();
+}
+
+static inline long long AlignStop(const FrameRef &frame)
+{
+	long long host = frame.HostStopTime();
+	long long stop = host ? host : frame.StopTime();
+	long long start = AlignStart(frame);
+	return stop > start ? stop : start;
+}
+
+bool AVAligner::Start(const QueueConfig &config, long long maxWait_,
+		      DeliveryQueue::DeliverProc deliver)
+{
+	Stop();
+
+	QueueConfig queueConfig = config;
+	queueConfig.pull = false;
+	if (queueConfig.depth <= 0)
+		queueConfig.depth = 8;
+
+	if (!queue.Start(queueConfig, deliver))
+		return false;
+
+	maxWait = maxWait_;
+	audioEnd = 0;
+	audioSeen = false;
+	active = true;
+	return true;
+}
+
+void AVAligner::Stop()
+{
+	if (!active)
+		return;
+
+	/* whatever is still held goes out before the queue drains, video
+	 * with the audio that has arrived for it */
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Release(true);
+	}
+
+	active = false;
+	queue.Stop();
+}
+
+void AVAligner::Release(bool flush)
+{
+	while (!video.empty()) {
+		QueuedFrame &front = video.front();
+		long long start = AlignStart(front.frame);
+		long long stop = AlignStop(front.frame);
+		long long newest = AlignStart(video.back().frame);
+
+		bool covered = audioSeen && audioEnd >= stop;
+		bool expired = newest - start >= maxWait;
+		if (!covered && !expired && !flush)
+			break;
+
+		QueuedFrame bundle;
+		bundle.frame = std::move(front.frame);
+		bundle.rotation = front.rotation;
+
+		/* late audio that belongs before this frame is attached to it
+		 * as well, so nothing is lost */
+		while (!audio.empty() && AlignStart(audio.front()) < stop) {
+			bundle.segments.push_back(std::move(audio.front()));
+			audio.pop_front();
+		}
+
+		video.pop_front();
+		queue.Push(bundle);
+	}
+
+	if (!video.empty() || audio.empty())
+		return;
+
+	long long age = AlignStart(audio.back()) - AlignStart(audio.front());
+	if (age >= maxWait * AUDIO_ONLY_WAIT_FACTOR || flush) {
+		QueuedFrame bundle;
+		for (FrameRef &frame : audio)
+			bundle.segments.push_back(std::move(frame));
+		audio.clear();
+		queue.Push(bundle);
+	}
+}
+
+void AVAligner::PushVideo(const QueuedFrame &frame)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	video.push_back(QueuedFrame());
+	video.back().frame = frame.frame;
+	video.back().rotation = frame.rotation;
+
+	Release();
+}
+
+void AVAligner::PushAudio(const FrameRef &frame)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	long long stop = AlignStop(frame);
+	if (!audioSeen || stop > audioEnd)
+		audioEnd = stop;
+	audioSeen = true;
+
+	audio.push_back(frame);
+	Release();
+}
+
+}; /* namespace DShow */
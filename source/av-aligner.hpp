@@ -0,0 +1,70 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "delivery-queue.hpp"
+
+#include <deque>
+#include <mutex>
+
+namespace DShow {
+
+/*
+ * Pairs video frames with the audio that covers their time span.  Frames are
+ * compared on the host timeline (each stream's clock model removes its own
+ * epoch and drift), falling back to the raw timestamps if a stream has no
+ * host times.
+ *
+ * A video frame is released once audio up to its stop time has arrived, or
+ * once it has waited maxWait.  Every audio packet is attached to exactly one
+ * bundle, so bundles come out interleaved and in timestamp order.  If video
+ * stops, audio is released on its own after it has waited for a while.
+ * Stopping delivers everything still held.
+ */
+class AVAligner {
+	std::mutex mutex;
+	std::deque<QueuedFrame> video;
+	std::deque<FrameRef> audio;
+	long long maxWait = 0;
+	long long audioEnd = 0;
+	bool audioSeen = false;
+
+	DeliveryQueue queue;
+	bool active = false;
+
+	/* releases everything held if flush is set */
+	void Release(bool flush = false);
+
+public:
+	/**
+	 * Starts the aligner, bundles are delivered from their own thread.
+	 * maxWait is in 100-nanosecond units.
+	 */
+	bool Start(const QueueConfig &config, long long maxWait,
+		   DeliveryQueue::DeliverProc deliver);
+	void Stop();
+
+	inline bool Active() const { return active; }
+
+	void PushVideo(const QueuedFrame &frame);
+	void PushAudio(const FrameRef &frame);
+};
+
+}; /* namespace DShow */
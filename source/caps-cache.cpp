@@ -0,0 +1,683 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "caps-cache.hpp"
+#include "format-score.hpp"
+#include "log.hpp"
+
+#include <SetupAPI.h>
+#include <initguid.h>
+#include <devpkey.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cwctype>
+
+/* bump whenever the layout below or the values of VideoFormat/AudioFormat
+ * change, older files are then ignored and replaced */
+#define CACHE_MAGIC 0x43435344 /* "DSCC" */
+#define CACHE_VERSION 1
+
+#define KIND_VIDEO 1
+#define KIND_AUDIO 2
+
+#define FLAG_AUDIO_ATTACHED 1
+#define FLAG_SEPARATE_AUDIO_FILTER 2
+
+namespace DShow {
+
+/* ------------------------------------------------------------------------- */
+/* File layout
+ *
+ * A header, then the entry table sorted by key, then the paths (UTF-16) and
+ * caps arrays the entries point to.  Offsets are in bytes from the start of
+ * the file. */
+
+struct FileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t size;
+};
+
+struct FileEntry {
+	uint64_t key;
+	uint64_t fingerprint;
+	uint32_t pathOffset;
+	uint32_t pathLength;
+	uint32_t capsOffset;
+	uint32_t capsCount;
+	uint32_t kind;
+	uint32_t flags;
+};
+
+struct FileVideoCaps {
+	int32_t minCX, minCY;
+	int32_t maxCX, maxCY;
+	int32_t granularityCX, granularityCY;
+	int64_t minInterval, maxInterval;
+	int32_t format;
+	int32_t reserved;
+};
+
+struct FileAudioCaps {
+	int32_t minChannels, maxChannels;
+	int32_t channelsGranularity;
+	int32_t minSampleRate, maxSampleRate;
+	int32_t sampleRateGranularity;
+	int32_t format;
+	int32_t reserved;
+};
+
+/* FNV-1a */
+static inline uint64_t HashBytes(uint64_t hash, const void *data, size_t size)
+{
+	const unsigned char *bytes = (const unsigned char *)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+#define HASH_INIT 0xcbf29ce484222325ULL
+
+/* device paths differ in case depending on where they come from */
+static uint64_t GetKey(unsigned kind, const wchar_t *path)
+{
+	uint64_t hash = HashBytes(HASH_INIT, &kind, sizeof(kind));
+
+	for (; *path; path++) {
+		wchar_t ch = (wchar_t)towlower(*path);
+		hash = HashBytes(hash, &ch, sizeof(ch));
+	}
+
+	return hash;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Driver fingerprint */
+
+static const DEVPROPKEY *fingerprintKeys[] = {
+	&DEVPKEY_Device_DriverVersion,
+	&DEVPKEY_Device_DriverDate,
+	&DEVPKEY_Device_DriverInfPath,
+	&DEVPKEY_Device_DriverInfSection,
+};
+
+/* changes whenever the device's driver is updated or replaced */
+static bool GetDriverFingerprint(const wchar_t *devicePath,
+				 unsigned long long &fingerprint)
+{
+	HDEVINFO devInfo = SetupDiCreateDeviceInfoList(nullptr, nullptr);
+	if (devInfo == INVALID_HANDLE_VALUE)
+		return false;
+
+	SP_DEVICE_INTERFACE_DATA interfaceData = {};
+	interfaceData.cbSize = sizeof(interfaceData);
+	SP_DEVINFO_DATA did = {};
+	did.cbSize = sizeof(did);
+	bool found = false;
+	uint64_t hash = HASH_INIT;
+
+	/* fails for lack of a detail buffer, but still fills in did */
+	if (SetupDiOpenDeviceInterfaceW(devInfo, devicePath, 0,
+					&interfaceData)) {
+		SetupDiGetDeviceInterfaceDetailW(devInfo, &interfaceData,
+						 nullptr, 0, nullptr, &did);
+
+		for (const DEVPROPKEY *key : fingerprintKeys) {
+			BYTE value[512];
+			DEVPROPTYPE type;
+			DWORD valueSize = 0;
+
+			if (did.DevInst &&
+			    SetupDiGetDevicePropertyW(devInfo, &did, key,
+						      &type, value,
+						      sizeof(value),
+						      &valueSize, 0)) {
+				hash = HashBytes(hash, value, valueSize);
+				found = true;
+			}
+
+			hash = HashBytes(hash, &valueSize, sizeof(valueSize));
+		}
+	}
+
+	SetupDiDestroyDeviceInfoList(devInfo);
+
+	fingerprint = hash;
+	return found;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Configuration */
+
+static std::mutex configMutex;
+static std::wstring cacheFile;
+static CapsChangedCallback changedCallback = nullptr;
+static void *changedParam = nullptr;
+
+/* held from Open to Close */
+static std::mutex fileMutex;
+
+void SetCapsCache(const wchar_t *file, CapsChangedCallback callback,
+		  void *param)
+{
+	std::lock_guard<std::mutex> lock(configMutex);
+	cacheFile = file ? file : L"";
+	changedCallback = callback;
+	changedParam = param;
+}
+
+/* ------------------------------------------------------------------------- */
+
+bool CapsCache::Open()
+{
+	Close();
+
+	{
+		std::lock_guard<std::mutex> configLock(configMutex);
+		if (cacheFile.empty())
+			return false;
+		fileName = cacheFile;
+	}
+
+	lock = std::unique_lock<std::mutex>(fileMutex);
+
+	/* a missing or invalid file is simply an empty cache */
+	if (!Map())
+		Unmap();
+	return true;
+}
+
+bool CapsCache::Map()
+{
+	file = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ,
+			   nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+			   nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) ||
+	    fileSize.QuadPart < (LONGLONG)sizeof(FileHeader) ||
+	    fileSize.QuadPart > 0x7fffffff)
+		return false;
+
+	mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0,
+				     nullptr);
+	if (!mapping)
+		return false;
+
+	view = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0,
+						    0, 0);
+	if (!view)
+		return false;
+
+	size = (size_t)fileSize.QuadPart;
+
+	const FileHeader *header = (const FileHeader *)view;
+	if (header->magic != CACHE_MAGIC || header->version != CACHE_VERSION ||
+	    header->size != size ||
+	    header->entryCount >
+		    (size - sizeof(FileHeader)) / sizeof(FileEntry)) {
+		Debug(L"CapsCache: Ignoring outdated or invalid cache file");
+		return false;
+	}
+
+	return true;
+}
+
+void CapsCache::Unmap()
+{
+	if (view)
+		UnmapViewOfFile(view);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+
+	view = nullptr;
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+	size = 0;
+}
+
+bool CapsCache::FindEntry(unsigned kind, const wchar_t *path,
+			  Entry &entry) const
+{
+	if (!view)
+		return false;
+
+	const FileHeader *header = (const FileHeader *)view;
+	const FileEntry *begin = (const FileEntry *)(header + 1);
+	const FileEntry *end = begin + header->entryCount;
+	const uint64_t key = GetKey(kind, path);
+
+	const FileEntry *fe = std::lower_bound(
+		begin, end, key,
+		[](const FileEntry &e, uint64_t k) { return e.key < k; });
+
+	/* compare paths as well in the unlikely case of a collision */
+	for (; fe != end && fe->key == key; fe++) {
+		if (fe->kind == kind && ReadEntry(fe, entry) &&
+		    _wcsicmp(entry.path.c_str(), path) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+bool CapsCache::ReadEntry(const void *fileEntry, Entry &entry) const
+{
+	const FileEntry *fe = (const FileEntry *)fileEntry;
+	const size_t capsSize = fe->kind == KIND_VIDEO ? sizeof(FileVideoCaps)
+						       : sizeof(FileAudioCaps);
+
+	if ((fe->kind != KIND_VIDEO && fe->kind != KIND_AUDIO) ||
+	    fe->pathOffset > size ||
+	    fe->pathLength > (size - fe->pathOffset) / sizeof(wchar_t) ||
+	    fe->capsOffset > size ||
+	    fe->capsCount > (size - fe->capsOffset) / capsSize)
+		return false;
+
+	entry.fingerprint = fe->fingerprint;
+	entry.kind = fe->kind;
+	entry.flags = fe->flags;
+	entry.path.resize(fe->pathLength);
+	memcpy(&entry.path[0], view + fe->pathOffset,
+	       fe->pathLength * sizeof(wchar_t));
+	entry.video.clear();
+	entry.audio.clear();
+
+	for (uint32_t i = 0; i < fe->capsCount; i++) {
+		const unsigned char *data = view + fe->capsOffset + i * capsSize;
+
+		if (fe->kind == KIND_VIDEO) {
+			FileVideoCaps fc;
+			memcpy(&fc, data, sizeof(fc));
+
+			VideoInfo caps;
+			caps.minCX = fc.minCX;
+			caps.minCY = fc.minCY;
+			caps.maxCX = fc.maxCX;
+			caps.maxCY = fc.maxCY;
+			caps.granularityCX = fc.granularityCX;
+			caps.granularityCY = fc.granularityCY;
+			caps.minInterval = fc.minInterval;
+			caps.maxInterval = fc.maxInterval;
+			caps.format = (VideoFormat)fc.format;
+			caps.bandwidth = EstimateCapBandwidth(caps);
+			entry.video.push_back(caps);
+		} else {
+			FileAudioCaps fc;
+			memcpy(&fc, data, sizeof(fc));
+
+			AudioInfo caps;
+			caps.minChannels = fc.minChannels;
+			caps.maxChannels = fc.maxChannels;
+			caps.channelsGranularity = fc.channelsGranularity;
+			caps.minSampleRate = fc.minSampleRate;
+			caps.maxSampleRate = fc.maxSampleRate;
+			caps.sampleRateGranularity = fc.sampleRateGranularity;
+			caps.format = (AudioFormat)fc.format;
+			entry.audio.push_back(caps);
+		}
+	}
+
+	return true;
+}
+
+bool CapsCache::Lookup(unsigned kind, const wchar_t *path, Entry &entry) const
+{
+	unsigned long long fingerprint;
+
+	if (!Active() || !path || !*path)
+		return false;
+
+	if (!FindEntry(kind, path, entry))
+		return false;
+
+	if (!GetDriverFingerprint(path, fingerprint) ||
+	    fingerprint != entry.fingerprint) {
+		Debug(L"CapsCache: Driver of '%s' changed", path);
+		return false;
+	}
+
+	return true;
+}
+
+bool CapsCache::Find(const wchar_t *path, VideoDevice &device) const
+{
+	Entry entry;
+	if (!Lookup(KIND_VIDEO, path, entry))
+		return false;
+
+	device.path = path;
+	device.audioAttached = (entry.flags & FLAG_AUDIO_ATTACHED) != 0;
+	device.separateAudioFilter =
+		(entry.flags & FLAG_SEPARATE_AUDIO_FILTER) != 0;
+	device.caps = std::move(entry.video);
+	return true;
+}
+
+bool CapsCache::Find(const wchar_t *path, AudioDevice &device) const
+{
+	Entry entry;
+	if (!Lookup(KIND_AUDIO, path, entry))
+		return false;
+
+	device.path = path;
+	device.caps = std::move(entry.audio);
+	return true;
+}
+
+void CapsCache::Update(Entry &entry)
+{
+	if (!Active() || entry.path.empty())
+		return;
+
+	/* devices without a driver of their own (software filters and the
+	 * like) may change their caps at any time */
+	if (!GetDriverFingerprint(entry.path.c_str(), entry.fingerprint))
+		return;
+
+	for (Entry &update : updates) {
+		if (update.kind == entry.kind &&
+		    _wcsicmp(update.path.c_str(), entry.path.c_str()) == 0) {
+			update = std::move(entry);
+			return;
+		}
+	}
+
+	updates.push_back(std::move(entry));
+}
+
+void CapsCache::Store(const VideoDevice &device)
+{
+	Entry entry;
+	entry.path = device.path;
+	entry.kind = KIND_VIDEO;
+	entry.flags = (device.audioAttached ? FLAG_AUDIO_ATTACHED : 0) |
+		      (device.separateAudioFilter ? FLAG_SEPARATE_AUDIO_FILTER
+						  : 0);
+	entry.video = device.caps;
+	Update(entry);
+}
+
+void CapsCache::Store(const AudioDevice &device)
+{
+	Entry entry;
+	entry.path = device.path;
+	entry.kind = KIND_AUDIO;
+	entry.audio = device.caps;
+	Update(entry);
+}
+
+void CapsCache::Close()
+{
+	if (!Active())
+		return;
+
+	if (!updates.empty()) {
+		std::vector<Entry> entries;
+
+		if (view) {
+			const FileHeader *header = (const FileHeader *)view;
+			const FileEntry *fe = (const FileEntry *)(header + 1);
+
+			for (uint32_t i = 0; i < header->entryCount; i++) {
+				Entry entry;
+				if (ReadEntry(fe + i, entry))
+					entries.push_back(std::move(entry));
+			}
+		}
+
+		for (Entry &update : updates) {
+			auto it = std::find_if(
+				entries.begin(), entries.end(),
+				[&](const Entry &e) {
+					return e.kind == update.kind &&
+					       _wcsicmp(e.path.c_str(),
+							update.path.c_str()) ==
+						       0;
+				});
+
+			if (it != entries.end())
+				*it = std::move(update);
+			else
+				entries.push_back(std::move(update));
+		}
+
+		/* the file can't be replaced while it's mapped */
+		Unmap();
+
+		if (!Write(entries))
+			Warning(L"CapsCache: Failed to write '%s'",
+				fileName.c_str());
+	}
+
+	Unmap();
+	updates.clear();
+	lock.unlock();
+}
+
+template<typename T>
+static inline void Append(std::vector<unsigned char> &data, const T &value)
+{
+	const unsigned char *bytes = (const unsigned char *)&value;
+	data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+bool CapsCache::Write(std::vector<Entry> &entries) const
+{
+	std::vector<std::pair<uint64_t, const Entry *>> sorted;
+	for (const Entry &entry : entries)
+		sorted.emplace_back(GetKey(entry.kind, entry.path.c_str()),
+				    &entry);
+
+	std::sort(sorted.begin(), sorted.end(),
+		  [](const std::pair<uint64_t, const Entry *> &a,
+		     const std::pair<uint64_t, const Entry *> &b) {
+			  return a.first < b.first;
+		  });
+
+	std::vector<FileEntry> table(sorted.size());
+	std::vector<unsigned char> payload;
+	size_t base = sizeof(FileHeader) + table.size() * sizeof(FileEntry);
+
+	for (size_t i = 0; i < sorted.size(); i++) {
+		const Entry &entry = *sorted[i].second;
+		FileEntry &fe = table[i];
+
+		fe.key = sorted[i].first;
+		fe.fingerprint = entry.fingerprint;
+		fe.kind = entry.kind;
+		fe.flags = entry.flags;
+
+		fe.pathOffset = (uint32_t)(base + payload.size());
+		fe.pathLength = (uint32_t)entry.path.size();
+		const unsigned char *path =
+			(const unsigned char *)entry.path.c_str();
+		payload.insert(payload.end(), path,
+			       path + entry.path.size() * sizeof(wchar_t));
+
+		/* keep the 64-bit fields of the caps aligned */
+		while ((base + payload.size()) % 8)
+			payload.push_back(0);
+
+		fe.capsOffset = (uint32_t)(base + payload.size());
+
+		if (entry.kind == KIND_VIDEO) {
+			fe.capsCount = (uint32_t)entry.video.size();
+
+			for (const VideoInfo &caps : entry.video) {
+				FileVideoCaps fc = {};
+				fc.minCX = caps.minCX;
+				fc.minCY = caps.minCY;
+				fc.maxCX = caps.maxCX;
+				fc.maxCY = caps.maxCY;
+				fc.granularityCX = caps.granularityCX;
+				fc.granularityCY = caps.granularityCY;
+				fc.minInterval = caps.minInterval;
+				fc.maxInterval = caps.maxInterval;
+				fc.format = (int32_t)caps.format;
+				Append(payload, fc);
+			}
+		} else {
+			fe.capsCount = (uint32_t)entry.audio.size();
+
+			for (const AudioInfo &caps : entry.audio) {
+				FileAudioCaps fc = {};
+				fc.minChannels = caps.minChannels;
+				fc.maxChannels = caps.maxChannels;
+				fc.channelsGranularity =
+					caps.channelsGranularity;
+				fc.minSampleRate = caps.minSampleRate;
+				fc.maxSampleRate = caps.maxSampleRate;
+				fc.sampleRateGranularity =
+					caps.sampleRateGranularity;
+				fc.format = (int32_t)caps.format;
+				Append(payload, fc);
+			}
+		}
+	}
+
+	FileHeader header;
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	header.entryCount = (uint32_t)table.size();
+	header.size = (uint32_t)(base + payload.size());
+
+	std::vector<unsigned char> data;
+	data.reserve(header.size);
+	Append(data, header);
+	for (const FileEntry &fe : table)
+		Append(data, fe);
+	data.insert(data.end(), payload.begin(), payload.end());
+
+	/* write a new file and swap it in, so that readers never see a
+	 * partially written one */
+	std::wstring tempName = fileName + L".tmp";
+	HANDLE temp = CreateFileW(tempName.c_str(), GENERIC_WRITE, 0, nullptr,
+				  CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+				  nullptr);
+	if (temp == INVALID_HANDLE_VALUE)
+		return false;
+
+	DWORD written = 0;
+	bool success = WriteFile(temp, data.data(), (DWORD)data.size(),
+				 &written, nullptr) &&
+		       written == data.size();
+	CloseHandle(temp);
+
+	if (success)
+		success = !!MoveFileExW(tempName.c_str(), fileName.c_str(),
+					MOVEFILE_REPLACE_EXISTING);
+	if (!success)
+		DeleteFileW(tempName.c_str());
+
+	return success;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline bool operator!=(const VideoInfo &a, const VideoInfo &b)
+{
+	return a.minCX != b.minCX || a.minCY != b.minCY ||
+	       a.maxCX != b.maxCX || a.maxCY != b.maxCY ||
+	       a.granularityCX != b.granularityCX ||
+	       a.granularityCY != b.granularityCY ||
+	       a.minInterval != b.minInterval ||
+	       a.maxInterval != b.maxInterval || a.format != b.format;
+}
+
+static inline bool operator!=(const AudioInfo &a, const AudioInfo &b)
+{
+	return a.minChannels != b.minChannels ||
+	       a.maxChannels != b.maxChannels ||
+	       a.channelsGranularity != b.channelsGranularity ||
+	       a.minSampleRate != b.minSampleRate ||
+	       a.maxSampleRate != b.maxSampleRate ||
+	       a.sampleRateGranularity != b.sampleRateGranularity ||
+	       a.format != b.format;
+}
+
+template<typename T>
+static bool SameCapsList(const std::vector<T> &a, const std::vector<T> &b)
+{
+	if (a.size() != b.size())
+		return false;
+
+	for (size_t i = 0; i < a.size(); i++)
+		if (a[i] != b[i])
+			return false;
+
+	return true;
+}
+
+bool CapsCache::SameCaps(const VideoDevice &a, const VideoDevice &b)
+{
+	return a.audioAttached == b.audioAttached &&
+	       a.separateAudioFilter == b.separateAudioFilter &&
+	       SameCapsList(a.caps, b.caps);
+}
+
+bool CapsCache::SameCaps(const AudioDevice &a, const AudioDevice &b)
+{
+	return SameCapsList(a.caps, b.caps);
+}
+
+void CapsCache::ReportChanged(const VideoDevice &device)
+{
+	CapsChangedCallback callback;
+	void *param;
+
+	Info(L"CapsCache: Capabilities of '%s' changed", device.name.c_str());
+
+	{
+		std::lock_guard<std::mutex> configLock(configMutex);
+		callback = changedCallback;
+		param = changedParam;
+	}
+
+	if (callback)
+		callback(&device, nullptr, param);
+}
+
+void CapsCache::ReportChanged(const AudioDevice &device)
+{
+	CapsChangedCallback callback;
+	void *param;
+
+	Info(L"CapsCache: Capabilities of '%s' changed", device.name.c_str());
+
+	{
+		std::lock_guard<std::mutex> configLock(configMutex);
+		callback = changedCallback;
+		param = changedParam;
+	}
+
+	if (callback)
+		callback(nullptr, &device, param);
+}
+
+}; /* namespace DShow */
@@ -0,0 +1,100 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+#include "dshow-base.hpp"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace DShow {
+
+/*
+ * Capabilities of previously enumerated devices, kept in a file (see
+ * SetCapsCache) so that enumerating devices doesn't have to bind every
+ * device to its filter and query all of its stream caps again.  Entries are
+ * keyed by device path and only used while the fingerprint of the device's
+ * driver (version, date and INF) is unchanged.
+ *
+ * The file is memory mapped between Open and Close, and lookups binary
+ * search its entry table, so only the entries of present devices are ever
+ * read.  Stored entries are merged into a new file on Close, which then
+ * replaces the old one.  Only one cache is open at a time.
+ */
+class CapsCache {
+	struct Entry {
+		unsigned long long fingerprint = 0;
+		std::wstring path;
+		unsigned kind = 0;
+		unsigned flags = 0;
+		std::vector<VideoInfo> video;
+		std::vector<AudioInfo> audio;
+	};
+
+	std::unique_lock<std::mutex> lock;
+	std::wstring fileName;
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+	const unsigned char *view = nullptr;
+	size_t size = 0;
+	std::vector<Entry> updates;
+
+	bool Map();
+	void Unmap();
+
+	bool FindEntry(unsigned kind, const wchar_t *path, Entry &entry) const;
+	bool ReadEntry(const void *fileEntry, Entry &entry) const;
+	bool Lookup(unsigned kind, const wchar_t *path, Entry &entry) const;
+	void Update(Entry &entry);
+	bool Write(std::vector<Entry> &entries) const;
+
+public:
+	inline ~CapsCache() { Close(); }
+
+	/** Returns false if caching is disabled */
+	bool Open();
+
+	/** Writes stored entries, if any */
+	void Close();
+
+	inline bool Active() const { return lock.owns_lock(); }
+
+	/**
+	 * Fills in the cached capabilities of a device, if it was cached with
+	 * the driver it currently has.  The name is left alone.
+	 */
+	bool Find(const wchar_t *path, VideoDevice &device) const;
+	bool Find(const wchar_t *path, AudioDevice &device) const;
+
+	void Store(const VideoDevice &device);
+	void Store(const AudioDevice &device);
+
+	static bool SameCaps(const VideoDevice &a, const VideoDevice &b);
+	static bool SameCaps(const AudioDevice &a, const AudioDevice &b);
+
+	/** Passes changes found by revalidation on to the consumer */
+	static void ReportChanged(const VideoDevice &device);
+	static void ReportChanged(const AudioDevice &device);
+};
+
+}; /* namespace DShow */
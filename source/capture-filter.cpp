@@ -274,7 +274,12 @@ STDMETHODIMP CapturePin::NotifyAllocator(IMemAllocator *pAllocator,
 {
 	PrintFunc(L"CapturePin::NotifyAllocator");
 
-	DSHOW_UNUSED(pAllocator);
+	ALLOCATOR_PROPERTIES props;
+	if (pAllocator && SUCCEEDED(pAllocator->GetProperties(&props)))
+		allocatorBuffers = props.cBuffers;
+	else
+		allocatorBuffers = 0;
+
 	DSHOW_UNUSED(bReadOnly);
 	return S_OK;
 }
@@ -319,7 +324,7 @@ STDMETHODIMP CapturePin::ReceiveMultiple(IMediaSample **pSamples, long nSamples,
 
 STDMETHODIMP CapturePin::ReceiveCanBlock()
 {
-	return S_FALSE;
+	return captureInfo.canBlock ? S_OK : S_FALSE;
 }
 
 bool CapturePin::IsValidMediaType(const AM_MEDIA_TYPE *pmt) const
@@ -452,13 +457,16 @@ STDMETHODIMP CaptureFilter::GetState(DWORD dwMSecs, FILTER_STATE *State)
 
 STDMETHODIMP CaptureFilter::SetSyncSource(IReferenceClock *pClock)
 {
-	DSHOW_UNUSED(pClock);
+	clock = pClock;
 	return S_OK;
 }
 
 STDMETHODIMP CaptureFilter::GetSyncSource(IReferenceClock **pClock)
 {
-	*pClock = nullptr;
+	*pClock = clock.Get();
+	if (*pClock) {
+		(*pClock)->AddRef();
+	}
 	return NOERROR;
 }
 
@@ -483,11 +491,21 @@ STDMETHODIMP CaptureFilter::Run(REFERENCE_TIME tStart)
 	PrintFunc(L"CaptureFilter::Run");
 
 	state = State_Running;
-
-	DSHOW_UNUSED(tStart);
+	streamStart = tStart;
 	return S_OK;
 }
 
+bool CaptureFilter::GetStreamTime(REFERENCE_TIME &time)
+{
+	if (!clock || state != State_Running)
+		return false;
+	if (FAILED(clock->GetTime(&time)))
+		return false;
+
+	time -= streamStart;
+	return true;
+}
+
 // IBaseFilter methods
 STDMETHODIMP CaptureFilter::EnumPins(IEnumPins **ppEnum)
 {
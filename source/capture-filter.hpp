@@ -34,6 +34,9 @@ struct PinCaptureInfo {
 	std::function<void(IMediaSample *sample)> callback;
 	GUID expectedMajorType{};
 	GUID expectedSubType{};
+
+	/** Whether the callback may block the streaming thread */
+	bool canBlock = false;
 };
 
 class CapturePin : public IPin, public IMemInputPin {
@@ -46,6 +49,7 @@ class CapturePin : public IPin, public IMemInputPin {
 	CaptureFilter *filter;
 	MediaType connectedMediaType;
 	volatile bool flushing = false;
+	volatile long allocatorBuffers = 0;
 
 	bool IsValidMediaType(const AM_MEDIA_TYPE *pmt) const;
 
@@ -85,6 +89,9 @@ public:
 	STDMETHODIMP ReceiveMultiple(IMediaSample **pSamples, long nSamples,
 				     long *nSamplesProcessed);
 	STDMETHODIMP ReceiveCanBlock();
+
+	/** Number of buffers in the upstream allocator, 0 if unknown */
+	inline long GetAllocatorBuffers() const { return allocatorBuffers; }
 };
 
 class CaptureFilter : public IBaseFilter {
@@ -97,6 +104,9 @@ class CaptureFilter : public IBaseFilter {
 
 	ComPtr<IAMFilterMiscFlags> misc;
 
+	ComPtr<IReferenceClock> clock;
+	REFERENCE_TIME streamStart = 0;
+
 public:
 	CaptureFilter(const PinCaptureInfo &info);
 	virtual ~CaptureFilter();
@@ -125,6 +135,9 @@ public:
 	STDMETHODIMP QueryVendorInfo(LPWSTR *pVendorInfo);
 
 	inline CapturePin *GetPin() const { return (CapturePin *)pin; }
+
+	/** Current stream time, fails if there is no clock or not running */
+	bool GetStreamTime(REFERENCE_TIME &time);
 };
 
 class CaptureEnumPins : public IEnumPins {
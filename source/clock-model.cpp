@@ -0,0 +1,202 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "clock-model.hpp"
+
+#include <cmath>
+
+namespace DShow {
+
+ClockModel::ClockModel()
+{
+	Reset();
+}
+
+ClockModel::ClockModel(const Params &params_) : params(params_)
+{
+	if (params.window > MAX_WINDOW)
+		params.window = MAX_WINDOW;
+	if (params.window < 2)
+		params.window = 2;
+	if (params.minPoints > params.window)
+		params.minPoints = params.window;
+	if (params.minPoints < 2)
+		params.minPoints = 2;
+
+	Reset();
+}
+
+void ClockModel::Reset()
+{
+	Restart();
+	mapped = false;
+}
+
+/* drops the fit but keeps mapped timestamps continuous */
+void ClockModel::Restart()
+{
+	count = 0;
+	head = 0;
+	intercept = 0.0;
+	slope = 1.0;
+	meanResidual = 0.0;
+	rejections = 0;
+}
+
+void ClockModel::Fit()
+{
+	int oldest = (head - count + params.window) % params.window;
+	originDevice = deviceTimes[oldest];
+	originHost = hostTimes[oldest];
+
+	double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+	for (int i = 0; i < count; i++) {
+		int idx = (oldest + i) % params.window;
+		double x = (double)(deviceTimes[idx] - originDevice);
+		double y = (double)(hostTimes[idx] - originHost);
+		sx += x;
+		sy += y;
+		sxx += x * x;
+		sxy += x * y;
+	}
+
+	double n = (double)count;
+	double denom = n * sxx - sx * sx;
+
+	if (count >= params.minPoints && denom > 0.0) {
+		double maxDrift = params.maxDriftPpm * 1e-6;
+		slope = (n * sxy - sx * sy) / denom;
+		if (slope < 1.0 - maxDrift)
+			slope = 1.0 - maxDrift;
+		else if (slope > 1.0 + maxDrift)
+			slope = 1.0 + maxDrift;
+	} else {
+		slope = 1.0;
+	}
+
+	intercept = (sy - slope * sx) / n;
+}
+
+double ClockModel::Predict(long long deviceTime) const
+{
+	return (double)originHost + intercept +
+	       slope * (double)(deviceTime - originDevice);
+}
+
+bool ClockModel::Update(long long deviceTime, long long hostTime)
+{
+	if (count && count < params.minPoints) {
+		/* while warming up, only gross errors can be detected.  Arrival
+		 * is only ever late, so a point far earlier than the others
+		 * means those were the bad ones */
+		double residual = (double)hostTime - Predict(deviceTime);
+
+		if (residual < -(double)params.maxSlewOffset) {
+			Restart();
+		} else if (residual > (double)params.maxSlewOffset) {
+			totalRejected++;
+			if (++rejections < params.maxRejections)
+				return false;
+			Restart();
+		}
+
+	} else if (count >= params.minPoints) {
+		double residual = (double)hostTime - Predict(deviceTime);
+		double threshold = params.outlierScale * meanResidual;
+		if (threshold < (double)params.outlierFloor)
+			threshold = (double)params.outlierFloor;
+
+		if (residual < -(double)params.maxSlewOffset) {
+			/* a sample can't arrive that much before the fit
+			 * expects it, the device clock jumped ahead */
+			Restart();
+
+		} else if ((residual = std::fabs(residual)) > threshold) {
+			totalRejected++;
+			if (++rejections < params.maxRejections)
+				return false;
+
+			/* the device clock stepped, start over */
+			Restart();
+		} else {
+			meanResidual += (residual - meanResidual) / 16.0;
+			rejections = 0;
+		}
+	}
+
+	deviceTimes[head] = deviceTime;
+	hostTimes[head] = hostTime;
+	head = (head + 1) % params.window;
+	if (count < params.window)
+		count++;
+
+	Fit();
+	return true;
+}
+
+long long ClockModel::Map(long long deviceTime)
+{
+	if (!count)
+		return deviceTime;
+
+	double target = Predict(deviceTime);
+
+	/* follow the fit directly until it has settled */
+	if (!mapped || count < params.minPoints) {
+		if (mapped && deviceTime >= lastDevice && target < lastHost)
+			target = lastHost;
+
+		mapped = true;
+		lastDevice = deviceTime;
+		lastHost = target;
+		return (long long)target;
+	}
+
+	double elapsed = (double)(deviceTime - lastDevice);
+
+	/* the device clock went back, hold on to the last mapped time until
+	 * the model restarts on the new clock */
+	if (elapsed < -(double)params.maxSlewOffset) {
+		lastDevice = deviceTime;
+		return (long long)lastHost;
+	}
+
+	double naive = lastHost + elapsed * slope;
+	double correction = target - naive;
+
+	if (std::fabs(correction) < (double)params.maxSlewOffset) {
+		double maxStep = std::fabs(elapsed) * params.maxSlewPpm * 1e-6;
+		if (correction > maxStep)
+			correction = maxStep;
+		else if (correction < -maxStep)
+			correction = -maxStep;
+	}
+
+	double mappedTime = naive + correction;
+
+	/* never go backwards, even across a clock step */
+	if (elapsed >= 0.0 && mappedTime < lastHost)
+		mappedTime = lastHost;
+
+	lastDevice = deviceTime;
+	lastHost = mappedTime;
+	return (long long)mappedTime;
+}
+
+}; /* namespace DShow */
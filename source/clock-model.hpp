@@ -0,0 +1,114 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+/*
+ * Portable (no Windows dependencies) model of a device clock against the
+ * host's monotonic clock.  All times are in 100-nanosecond units.
+ *
+ * Device timestamps are fitted against host arrival times with a windowed
+ * linear regression.  Observations that land too far from the current fit
+ * are rejected as outliers, and a run of rejections is treated as a step in
+ * the device clock, which restarts the model.  Mapped timestamps follow the
+ * fit with a limited slew rate so that corrections never show up as jumps.
+ */
+
+namespace DShow {
+
+class ClockModel {
+public:
+	struct Params {
+		/** Number of observations the regression is fitted over */
+		int window = 256;
+		/** Observations needed before the slope is fitted */
+		int minPoints = 8;
+		/** Rejection threshold in mean absolute residuals */
+		double outlierScale = 4.0;
+		/** Residuals below this are never rejected */
+		long long outlierFloor = 20000;
+		/** Consecutive rejections treated as a clock step */
+		int maxRejections = 8;
+		/** Maximum deviation of the fitted rate from 1.0 */
+		double maxDriftPpm = 2000.0;
+		/** Maximum correction rate of mapped timestamps */
+		double maxSlewPpm = 1000.0;
+		/** Corrections larger than this jump instead of slewing */
+		long long maxSlewOffset = 500000;
+	};
+
+private:
+	static const int MAX_WINDOW = 256;
+
+	Params params;
+
+	long long deviceTimes[MAX_WINDOW];
+	long long hostTimes[MAX_WINDOW];
+	int count = 0;
+	int head = 0;
+
+	/* fit: host = originHost + intercept + slope * (device - originDevice) */
+	long long originDevice = 0;
+	long long originHost = 0;
+	double intercept = 0.0;
+	double slope = 1.0;
+
+	double meanResidual = 0.0;
+	int rejections = 0;
+	long long totalRejected = 0;
+
+	bool mapped = false;
+	long long lastDevice = 0;
+	double lastHost = 0.0;
+
+	void Restart();
+	void Fit();
+	double Predict(long long deviceTime) const;
+
+public:
+	ClockModel();
+	explicit ClockModel(const Params &params);
+
+	void Reset();
+
+	/**
+	 * Adds an observation of a device timestamp and the host time it
+	 * arrived at.  Returns false if it was rejected as an outlier.
+	 */
+	bool Update(long long deviceTime, long long hostTime);
+
+	/**
+	 * Maps a device timestamp to the host clock.  Meant to be called with
+	 * increasing device timestamps.  Returns deviceTime unchanged if there
+	 * have been no observations yet.
+	 */
+	long long Map(long long deviceTime);
+
+	/** Converts a device duration to a host duration */
+	inline long long MapDuration(long long duration) const
+	{
+		return (long long)((double)duration * slope);
+	}
+
+	inline bool Valid() const { return count > 0; }
+	inline double Rate() const { return slope; }
+	inline long long Rejected() const { return totalRejected; }
+};
+
+}; /* namespace DShow */
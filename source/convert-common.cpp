@@ -0,0 +1,185 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "convert-kernels.hpp"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/* frames smaller than this are converted on the streaming thread, handing
+ * them off would cost more than it saves */
+#define MIN_PARALLEL_PIXELS (1280 * 720)
+#define MIN_SLICE_ROWS 64
+
+namespace DShow {
+
+static CpuLevel DetectCpuLevel()
+{
+#if defined(CONVERT_AVX2) && defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+
+	/* AVX2 needs the OS to save the upper halves of the ymm registers
+	 * too, not just CPU support */
+	__cpuid(info, 0);
+	if (info[0] >= 7) {
+		__cpuid(info, 1);
+		const int osxsave = (1 << 27) | (1 << 28);
+		if ((info[2] & osxsave) == osxsave && (_xgetbv(0) & 6) == 6) {
+			__cpuidex(info, 7, 0);
+			if (info[1] & (1 << 5))
+				return CpuLevel::AVX2;
+		}
+	}
+#elif defined(CONVERT_AVX2)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return CpuLevel::AVX2;
+#endif
+
+#ifdef CONVERT_SSE2
+	return CpuLevel::SSE2;
+#else
+	return CpuLevel::Scalar;
+#endif
+}
+
+CpuLevel GetCpuLevel()
+{
+	static const CpuLevel level = DetectCpuLevel();
+	return level;
+}
+
+bool GetPlaneLayout(VideoFormat format, int cx, int cy, PlaneLayout &layout)
+{
+	if (cx <= 0 || cy <= 0)
+		return false;
+
+	const size_t width = (size_t)cx;
+	const size_t height = (size_t)cy;
+	const size_t chromaWidth = (width + 1) / 2;
+	const size_t chromaHeight = (height + 1) / 2;
+
+	layout = PlaneLayout();
+
+	switch (format) {
+	/* DIB rows are aligned to 4 bytes */
+	case VideoFormat::RGB24:
+		layout.pitch[0] = (ptrdiff_t)((width * 3 + 3) & ~(size_t)3);
+		layout.size = (size_t)layout.pitch[0] * height;
+		return true;
+
+	case VideoFormat::Y800:
+		layout.pitch[0] = (ptrdiff_t)width;
+		layout.size = width * height;
+		return true;
+
+	case VideoFormat::XRGB:
+	case VideoFormat::ARGB:
+		layout.pitch[0] = (ptrdiff_t)(width * 4);
+		layout.size = width * 4 * height;
+		return true;
+
+	case VideoFormat::YVYU:
+	case VideoFormat::YUY2:
+	case VideoFormat::UYVY:
+	case VideoFormat::HDYC:
+		layout.pitch[0] = (ptrdiff_t)(chromaWidth * 4);
+		layout.size = chromaWidth * 4 * height;
+		return true;
+
+	case VideoFormat::NV12:
+		layout.pitch[0] = (ptrdiff_t)width;
+		layout.pitch[1] = (ptrdiff_t)(chromaWidth * 2);
+		layout.offset[1] = width * height;
+		layout.size = layout.offset[1] + chromaWidth * 2 * chromaHeight;
+		return true;
+
+	case VideoFormat::P010:
+	case VideoFormat::P016:
+		layout.pitch[0] = (ptrdiff_t)(width * 2);
+		layout.pitch[1] = (ptrdiff_t)(chromaWidth * 4);
+		layout.offset[1] = width * 2 * height;
+		layout.size = layout.offset[1] + chromaWidth * 4 * chromaHeight;
+		return true;
+
+	case VideoFormat::I010: {
+		const size_t chromaSize = chromaWidth * 2 * chromaHeight;
+
+		layout.pitch[0] = (ptrdiff_t)(width * 2);
+		layout.pitch[1] = layout.pitch[2] = (ptrdiff_t)(chromaWidth * 2);
+		layout.offset[1] = width * 2 * height;
+		layout.offset[2] = layout.offset[1] + chromaSize;
+		layout.size = layout.offset[2] + chromaSize;
+		return true;
+	}
+
+	/* plane 1 is always U and plane 2 always V, YV12 just stores them
+	 * the other way around */
+	case VideoFormat::I420:
+	case VideoFormat::YV12: {
+		const size_t chromaSize = chromaWidth * chromaHeight;
+		const bool yv12 = format == VideoFormat::YV12;
+
+		layout.pitch[0] = (ptrdiff_t)width;
+		layout.pitch[1] = layout.pitch[2] = (ptrdiff_t)chromaWidth;
+		layout.offset[1] = width * height + (yv12 ? chromaSize : 0);
+		layout.offset[2] = width * height + (yv12 ? 0 : chromaSize);
+		layout.size = width * height + chromaSize * 2;
+		return true;
+	}
+
+	default:
+		return false;
+	}
+}
+
+ConvertProc GetConvertKernel(VideoFormat from, VideoFormat to,
+			     ColorMatrix matrix, ColorRange range,
+			     CpuLevel level)
+{
+	if (from == to)
+		return nullptr;
+
+	ConvertProc kernel = GetPacked422Kernel(from, to, level);
+	if (!kernel)
+		kernel = GetP010Kernel(from, to, level);
+	if (!kernel)
+		kernel = GetRgbKernel(from, to, matrix, range, level);
+	return kernel;
+}
+
+int GetSliceRows(int cx, int cy)
+{
+	int slices = 1;
+
+	if ((long long)cx * cy >= MIN_PARALLEL_PIXELS) {
+		slices = std::min(WorkerPool::Get().Concurrency(),
+				  cy / MIN_SLICE_ROWS);
+		slices = std::max(slices, 1);
+	}
+
+	if (slices == 1)
+		return cy;
+
+	int rows = (cy + slices - 1) / slices;
+	return (rows + 1) & ~1;
+}
+
+}; /* namespace DShow */
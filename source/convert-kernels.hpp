@@ -0,0 +1,145 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+#include "worker-pool.hpp"
+
+#include <algorithm>
+#include <stddef.h>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#define CONVERT_SSE2 1
+
+/* AVX2 kernels are compiled in regardless of the target architecture flags
+ * and are only ever called after a runtime check */
+#if defined(_MSC_VER) && !defined(__clang__)
+#define CONVERT_AVX2 1
+#define AVX2_FUNC
+#elif defined(__GNUC__) || defined(__clang__)
+#define CONVERT_AVX2 1
+#define AVX2_FUNC __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace DShow {
+
+enum class CpuLevel {
+	Scalar,
+	SSE2,
+	AVX2,
+};
+
+/* Highest instruction set level supported by both the build and the CPU */
+CpuLevel GetCpuLevel();
+
+/*
+ * Plane pointers and pitches of a single conversion.  Pitches may be
+ * negative, which is how bottom-up sources are read without a separate flip
+ * pass.
+ */
+struct ConvertFrame {
+	const unsigned char *src[3];
+	ptrdiff_t srcPitch[3];
+	unsigned char *dst[3];
+	ptrdiff_t dstPitch[3];
+	int cx;
+	int cy;
+};
+
+/*
+ * Converts output rows [y0, y1) of a frame.  Both bounds are even for 4:2:0
+ * outputs (except y1 == cy) so that ranges can be converted independently.
+ */
+typedef void (*ConvertProc)(const ConvertFrame &frame, int y0, int y1);
+
+/* Byte offsets and pitches of the planes of a raw video frame */
+struct PlaneLayout {
+	size_t offset[3] = {};
+	ptrdiff_t pitch[3] = {};
+	size_t size = 0;
+};
+
+bool GetPlaneLayout(VideoFormat format, int cx, int cy, PlaneLayout &layout);
+
+static inline bool IsRgb(VideoFormat format)
+{
+	return format == VideoFormat::RGB24 || format == VideoFormat::XRGB ||
+	       format == VideoFormat::ARGB;
+}
+
+/* Rows per slice for a frame of the given size, or cy if it's not worth
+ * splitting.  Always even, so 4:2:0 chroma rows are never shared between
+ * slices. */
+int GetSliceRows(int cx, int cy);
+
+/*
+ * Calls func(y0, y1) for row ranges covering the whole frame, split into
+ * slices on the shared worker pool if the frame is large enough to benefit
+ * from it.
+ */
+template<typename F>
+void RunSliced(int cx, int cy, unsigned affinity, F &&func)
+{
+	const int rows = GetSliceRows(cx, cy);
+	if (rows >= cy) {
+		func(0, cy);
+		return;
+	}
+
+	WorkerPool::Get().Run((cy + rows - 1) / rows, affinity, [&](int slice) {
+		int y0 = slice * rows;
+		func(y0, std::min(y0 + rows, cy));
+	});
+}
+
+inline void RunSliced(ConvertProc proc, const ConvertFrame &frame,
+		      unsigned affinity)
+{
+	RunSliced(frame.cx, frame.cy, affinity,
+		  [&](int y0, int y1) { proc(frame, y0, y1); });
+}
+
+/* packed 4:2:2 (YUY2, YVYU, UYVY, HDYC) to NV12/I420 */
+ConvertProc GetPacked422Kernel(VideoFormat from, VideoFormat to,
+			       CpuLevel level);
+
+/* P010 to NV12 (dithered), I010 and P016 */
+ConvertProc GetP010Kernel(VideoFormat from, VideoFormat to, CpuLevel level);
+
+/* RGB24 to XRGB/ARGB, and XRGB/ARGB to NV12/I420 with the given matrix and
+ * range */
+ConvertProc GetRgbKernel(VideoFormat from, VideoFormat to, ColorMatrix matrix,
+			 ColorRange range, CpuLevel level);
+
+/* Any of the kernels above, nullptr if from and to are the same */
+ConvertProc GetConvertKernel(VideoFormat from, VideoFormat to,
+			     ColorMatrix matrix, ColorRange range,
+			     CpuLevel level);
+
+/*
+ * Rotation of NV12, I420/YV12, Y800 and XRGB/ARGB (even sizes for 4:2:0) by
+ * 90, 180 or 270 degrees clockwise.  ConvertFrame::cx/cy are the size of the
+ * rotated frame, and the planes are passed as they are.
+ */
+ConvertProc GetRotateKernel(VideoFormat format, int rotation, CpuLevel level);
+
+}; /* namespace DShow */
@@ -0,0 +1,347 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+
+#include "convert-kernels.hpp"
+
+#ifdef CONVERT_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef CONVERT_AVX2
+#include <immintrin.h>
+#endif
+
+/*
+ * P010 (10-bit 4:2:0, samples in the upper bits of 16-bit words) to:
+ *
+ *  - NV12, truncated to 8 bits with a 4x4 ordered dither so that gradients
+ *    don't band
+ *  - I010, planar with the samples in the lower 10 bits
+ *  - P016, with the upper bits replicated into the lower ones so that white
+ *    is 0xffff instead of 0xffc0
+ *
+ * Every row is processed as an array of words, chroma rows simply have twice
+ * as many (interleaved U and V).
+ */
+
+namespace DShow {
+
+typedef void (*WordRowProc)(const unsigned short *s, unsigned char *d0,
+			    unsigned char *d1, int n,
+			    const unsigned short *dither);
+
+/* ordered dither thresholds, scaled to the 8 bits that are dropped */
+#define D(x) (x * 16)
+static const unsigned short lumaDither[4][8] = {
+	{D(0), D(8), D(2), D(10), D(0), D(8), D(2), D(10)},
+	{D(12), D(4), D(14), D(6), D(12), D(4), D(14), D(6)},
+	{D(3), D(11), D(1), D(9), D(3), D(11), D(1), D(9)},
+	{D(15), D(7), D(13), D(5), D(15), D(7), D(13), D(5)},
+};
+
+/* the same thresholds for interleaved chroma, U and V of each pair share
+ * one */
+static const unsigned short chromaDither[4][8] = {
+	{D(0), D(0), D(8), D(8), D(2), D(2), D(10), D(10)},
+	{D(12), D(12), D(4), D(4), D(14), D(14), D(6), D(6)},
+	{D(3), D(3), D(11), D(11), D(1), D(1), D(9), D(9)},
+	{D(15), D(15), D(7), D(7), D(13), D(13), D(5), D(5)},
+};
+#undef D
+
+/* ------------------------------------------------------------------------- */
+/* scalar reference                                                          */
+
+static void DitherRowScalar(const unsigned short *s, unsigned char *d0,
+			    unsigned char *, int n,
+			    const unsigned short *dither)
+{
+	for (int i = 0; i < n; i++) {
+		unsigned int v = s[i] + dither[i & 7];
+		d0[i] = (unsigned char)((v > 0xffff ? 0xffff : v) >> 8);
+	}
+}
+
+static void ShiftRowScalar(const unsigned short *s, unsigned char *d0,
+			   unsigned char *, int n, const unsigned short *)
+{
+	unsigned short *d = (unsigned short *)d0;
+	for (int i = 0; i < n; i++)
+		d[i] = s[i] >> 6;
+}
+
+static void SplitRowScalar(const unsigned short *s, unsigned char *d0,
+			   unsigned char *d1, int n, const unsigned short *)
+{
+	unsigned short *u = (unsigned short *)d0;
+	unsigned short *v = (unsigned short *)d1;
+	for (int i = 0; i < n / 2; i++) {
+		u[i] = s[i * 2] >> 6;
+		v[i] = s[i * 2 + 1] >> 6;
+	}
+}
+
+static void ExpandRowScalar(const unsigned short *s, unsigned char *d0,
+			    unsigned char *, int n, const unsigned short *)
+{
+	unsigned short *d = (unsigned short *)d0;
+	for (int i = 0; i < n; i++)
+		d[i] = s[i] | (s[i] >> 10);
+}
+
+/* ------------------------------------------------------------------------- */
+/* SSE2                                                                      */
+
+#ifdef CONVERT_SSE2
+static void DitherRowSSE2(const unsigned short *s, unsigned char *d0,
+			  unsigned char *d1, int n,
+			  const unsigned short *dither)
+{
+	const __m128i pattern = _mm_loadu_si128((const __m128i *)dither);
+	int i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(s + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(s + i + 8));
+		a = _mm_srli_epi16(_mm_adds_epu16(a, pattern), 8);
+		b = _mm_srli_epi16(_mm_adds_epu16(b, pattern), 8);
+		_mm_storeu_si128((__m128i *)(d0 + i), _mm_packus_epi16(a, b));
+	}
+
+	DitherRowScalar(s + i, d0 + i, d1, n - i, dither);
+}
+
+static void ShiftRowSSE2(const unsigned short *s, unsigned char *d0,
+			 unsigned char *d1, int n, const unsigned short *)
+{
+	unsigned short *d = (unsigned short *)d0;
+	int i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(s + i));
+		_mm_storeu_si128((__m128i *)(d + i), _mm_srli_epi16(a, 6));
+	}
+
+	ShiftRowScalar(s + i, (unsigned char *)(d + i), d1, n - i, nullptr);
+}
+
+/* the shifted samples fit in 10 bits, so the signed pack is safe */
+static void SplitRowSSE2(const unsigned short *s, unsigned char *d0,
+			 unsigned char *d1, int n, const unsigned short *)
+{
+	const __m128i mask = _mm_set1_epi32(0xffff);
+	unsigned short *u = (unsigned short *)d0;
+	unsigned short *v = (unsigned short *)d1;
+	int i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(s + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(s + i + 8));
+		__m128i ua = _mm_srli_epi32(_mm_and_si128(a, mask), 6);
+		__m128i ub = _mm_srli_epi32(_mm_and_si128(b, mask), 6);
+		__m128i va = _mm_srli_epi32(a, 22);
+		__m128i vb = _mm_srli_epi32(b, 22);
+		_mm_storeu_si128((__m128i *)(u + i / 2),
+				 _mm_packs_epi32(ua, ub));
+		_mm_storeu_si128((__m128i *)(v + i / 2),
+				 _mm_packs_epi32(va, vb));
+	}
+
+	SplitRowScalar(s + i, (unsigned char *)(u + i / 2),
+		       (unsigned char *)(v + i / 2), n - i, nullptr);
+}
+
+static void ExpandRowSSE2(const unsigned short *s, unsigned char *d0,
+			  unsigned char *d1, int n, const unsigned short *)
+{
+	unsigned short *d = (unsigned short *)d0;
+	int i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(s + i));
+		_mm_storeu_si128((__m128i *)(d + i),
+				 _mm_or_si128(a, _mm_srli_epi16(a, 10)));
+	}
+
+	ExpandRowScalar(s + i, (unsigned char *)(d + i), d1, n - i, nullptr);
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* AVX2                                                                      */
+
+#ifdef CONVERT_AVX2
+AVX2_FUNC static void DitherRowAVX2(const unsigned short *s, unsigned char *d0,
+				    unsigned char *d1, int n,
+				    const unsigned short *dither)
+{
+	const __m256i pattern = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((const __m128i *)dither));
+	int i = 0;
+
+	for (; i + 32 <= n; i += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(s + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(s + i + 16));
+		a = _mm256_srli_epi16(_mm256_adds_epu16(a, pattern), 8);
+		b = _mm256_srli_epi16(_mm256_adds_epu16(b, pattern), 8);
+		__m256i packed = _mm256_permute4x64_epi64(
+			_mm256_packus_epi16(a, b), 0xD8);
+		_mm256_storeu_si256((__m256i *)(d0 + i), packed);
+	}
+
+	DitherRowScalar(s + i, d0 + i, d1, n - i, dither);
+}
+
+AVX2_FUNC static void ShiftRowAVX2(const unsigned short *s, unsigned char *d0,
+				   unsigned char *d1, int n,
+				   const unsigned short *)
+{
+	unsigned short *d = (unsigned short *)d0;
+	int i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(s + i));
+		_mm256_storeu_si256((__m256i *)(d + i),
+				    _mm256_srli_epi16(a, 6));
+	}
+
+	ShiftRowScalar(s + i, (unsigned char *)(d + i), d1, n - i, nullptr);
+}
+
+AVX2_FUNC static void SplitRowAVX2(const unsigned short *s, unsigned char *d0,
+				   unsigned char *d1, int n,
+				   const unsigned short *)
+{
+	const __m256i mask = _mm256_set1_epi32(0xffff);
+	unsigned short *u = (unsigned short *)d0;
+	unsigned short *v = (unsigned short *)d1;
+	int i = 0;
+
+	for (; i + 32 <= n; i += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(s + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(s + i + 16));
+		__m256i ua = _mm256_srli_epi32(_mm256_and_si256(a, mask), 6);
+		__m256i ub = _mm256_srli_epi32(_mm256_and_si256(b, mask), 6);
+		__m256i va = _mm256_srli_epi32(a, 22);
+		__m256i vb = _mm256_srli_epi32(b, 22);
+		_mm256_storeu_si256(
+			(__m256i *)(u + i / 2),
+			_mm256_permute4x64_epi64(_mm256_packs_epi32(ua, ub),
+						 0xD8));
+		_mm256_storeu_si256(
+			(__m256i *)(v + i / 2),
+			_mm256_permute4x64_epi64(_mm256_packs_epi32(va, vb),
+						 0xD8));
+	}
+
+	SplitRowScalar(s + i, (unsigned char *)(u + i / 2),
+		       (unsigned char *)(v + i / 2), n - i, nullptr);
+}
+
+AVX2_FUNC static void ExpandRowAVX2(const unsigned short *s, unsigned char *d0,
+				    unsigned char *d1, int n,
+				    const unsigned short *)
+{
+	unsigned short *d = (unsigned short *)d0;
+	int i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(s + i));
+		_mm256_storeu_si256(
+			(__m256i *)(d + i),
+			_mm256_or_si256(a, _mm256_srli_epi16(a, 10)));
+	}
+
+	ExpandRowScalar(s + i, (unsigned char *)(d + i), d1, n - i, nullptr);
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+template<WordRowProc Luma, WordRowProc Chroma>
+static void P010(const ConvertFrame &frame, int y0, int y1)
+{
+	const int chromaWords = (frame.cx + 1) / 2 * 2;
+
+	for (int y = y0; y < y1; y++) {
+		const unsigned char *s = frame.src[0] + y * frame.srcPitch[0];
+		unsigned char *d = frame.dst[0] + y * frame.dstPitch[0];
+		Luma((const unsigned short *)s, d, nullptr, frame.cx,
+		     lumaDither[y & 3]);
+	}
+
+	for (int y = y0 / 2; y < (y1 + 1) / 2; y++) {
+		const unsigned char *s = frame.src[1] + y * frame.srcPitch[1];
+		unsigned char *d0 = frame.dst[1] + y * frame.dstPitch[1];
+		unsigned char *d1 =
+			frame.dst[2] ? frame.dst[2] + y * frame.dstPitch[2]
+				     : nullptr;
+		Chroma((const unsigned short *)s, d0, d1, chromaWords,
+		       chromaDither[y & 3]);
+	}
+}
+
+ConvertProc GetP010Kernel(VideoFormat from, VideoFormat to, CpuLevel level)
+{
+	if (from != VideoFormat::P010)
+		return nullptr;
+
+#ifdef CONVERT_AVX2
+	if (level >= CpuLevel::AVX2) {
+		switch (to) {
+		case VideoFormat::NV12:
+			return P010<DitherRowAVX2, DitherRowAVX2>;
+		case VideoFormat::I010:
+			return P010<ShiftRowAVX2, SplitRowAVX2>;
+		case VideoFormat::P016:
+			return P010<ExpandRowAVX2, ExpandRowAVX2>;
+		default:
+			return nullptr;
+		}
+	}
+#endif
+#ifdef CONVERT_SSE2
+	if (level >= CpuLevel::SSE2) {
+		switch (to) {
+		case VideoFormat::NV12:
+			return P010<DitherRowSSE2, DitherRowSSE2>;
+		case VideoFormat::I010:
+			return P010<ShiftRowSSE2, SplitRowSSE2>;
+		case VideoFormat::P016:
+			return P010<ExpandRowSSE2, ExpandRowSSE2>;
+		default:
+			return nullptr;
+		}
+	}
+#endif
+
+	(void)level;
+	switch (to) {
+	case VideoFormat::NV12:
+		return P010<DitherRowScalar, DitherRowScalar>;
+	case VideoFormat::I010:
+		return P010<ShiftRowScalar, SplitRowScalar>;
+	case VideoFormat::P016:
+		return P010<ExpandRowScalar, ExpandRowScalar>;
+	default:
+		return nullptr;
+	}
+}
+
+}; /* namespace DShow */
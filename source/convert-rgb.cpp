@@ -0,0 +1,542 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+
+#include "convert-kernels.hpp"
+
+#include <string.h>
+
+#ifdef CONVERT_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef CONVERT_AVX2
+#include <immintrin.h>
+#endif
+
+/*
+ * RGB24 to BGRA, and BGRA (XRGB/ARGB) to NV12/I420.
+ *
+ * RGB to YUV uses the 14-bit coefficients in RgbToYuv, applied with pmaddwd
+ * to pixels widened to [B G R A] words.  Chroma is computed from the sum of
+ * each 2x2 block (hence the extra 2 bits of shift).  All variants use the
+ * same integer arithmetic and produce identical output.
+ *
+ * The coefficients are constants of each kernel instance, there is one per
+ * matrix and range.
+ *
+ * Bottom-up sources are read with a negative pitch, which is how flipping
+ * is done without a separate pass.
+ */
+
+namespace DShow {
+
+/*
+ * Fixed point (14-bit) RGB to YUV coefficients in the memory order of BGRA
+ * pixels, repeated for two pixels so they can be loaded as a vector.  The
+ * offsets include rounding; chroma is computed from 2x2 block sums and
+ * shifted by 16 instead of 14.
+ */
+struct RgbToYuv {
+	short y[8];
+	short u[8];
+	short v[8];
+	int yOffset;
+	int uvOffset;
+};
+
+/* rounded half away from zero, like lround */
+static constexpr short Fixed(double v)
+{
+	return (short)(v < 0.0 ? v * 16384.0 - 0.5 : v * 16384.0 + 0.5);
+}
+
+static constexpr double Kr(ColorMatrix matrix)
+{
+	return matrix == ColorMatrix::BT601   ? 0.299
+	       : matrix == ColorMatrix::BT709 ? 0.2126
+					      : 0.2627;
+}
+
+static constexpr double Kb(ColorMatrix matrix)
+{
+	return matrix == ColorMatrix::BT601   ? 0.114
+	       : matrix == ColorMatrix::BT709 ? 0.0722
+					      : 0.0593;
+}
+
+template<ColorMatrix matrix, ColorRange range> struct Coefficients {
+	static constexpr double kr = Kr(matrix);
+	static constexpr double kb = Kb(matrix);
+	static constexpr double kg = 1.0 - kr - kb;
+
+	static constexpr bool full = range == ColorRange::Full;
+	static constexpr double ys = full ? 1.0 : 219.0 / 255.0;
+	static constexpr double cs = full ? 1.0 : 224.0 / 255.0;
+	static constexpr double us = cs / (2.0 * (1.0 - kb));
+	static constexpr double vs = cs / (2.0 * (1.0 - kr));
+
+	static const RgbToYuv k;
+};
+
+#define COEFFICIENTS(b, g, r) \
+	{Fixed(b), Fixed(g), Fixed(r), 0, Fixed(b), Fixed(g), Fixed(r), 0}
+
+template<ColorMatrix matrix, ColorRange range>
+const RgbToYuv Coefficients<matrix, range>::k = {
+	COEFFICIENTS(kb * ys, kg * ys, kr * ys),
+	COEFFICIENTS((1.0 - kb) * us, -kg * us, -kr * us),
+	COEFFICIENTS(-kb * vs, -kg * vs, (1.0 - kr) * vs),
+	((full ? 0 : 16) << 14) + (1 << 13),
+	(128 << 16) + (1 << 15),
+};
+
+#undef COEFFICIENTS
+
+typedef void (*RgbRowProc)(const unsigned char *s0, const unsigned char *s1,
+			   unsigned char *d0, unsigned char *d1,
+			   unsigned char *c0, unsigned char *c1, int x, int cx);
+
+static inline unsigned char Clamp8(int v)
+{
+	return (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+static inline unsigned char LumaScalar(const unsigned char *p, const RgbToYuv &k)
+{
+	int v = k.y[0] * p[0] + k.y[1] * p[1] + k.y[2] * p[2] + k.yOffset;
+	return Clamp8(v >> 14);
+}
+
+/* ------------------------------------------------------------------------- */
+/* RGB24 to BGRA                                                             */
+
+static void Rgb24RowScalar(const unsigned char *s, unsigned char *d, int x,
+			   int cx)
+{
+	for (; x < cx; x++) {
+		d[x * 4 + 0] = s[x * 3 + 0];
+		d[x * 4 + 1] = s[x * 3 + 1];
+		d[x * 4 + 2] = s[x * 3 + 2];
+		d[x * 4 + 3] = 0xff;
+	}
+}
+
+/* SSE2 has no byte shuffle, so this level moves whole pixels with
+ * overlapping 32-bit loads instead (the last pixel can't, it would read past
+ * the row) */
+static void Rgb24RowSSE2(const unsigned char *s, unsigned char *d, int x,
+			 int cx)
+{
+	for (; x + 1 < cx; x++) {
+		unsigned int pixel;
+		memcpy(&pixel, s + x * 3, 4);
+		pixel |= 0xff000000;
+		memcpy(d + x * 4, &pixel, 4);
+	}
+
+	Rgb24RowScalar(s, d, x, cx);
+}
+
+#ifdef CONVERT_AVX2
+AVX2_FUNC static void Rgb24RowAVX2(const unsigned char *s, unsigned char *d,
+				   int x, int cx)
+{
+	/* bytes 0-11 to the low lane and 12-23 to the high lane, then spread
+	 * each lane's 4 pixels over 16 bytes */
+	const __m256i spread = _mm256_setr_epi32(0, 1, 2, 2, 3, 4, 5, 5);
+	const __m256i shuffle = _mm256_setr_epi8(
+		0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2,
+		-1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m256i alpha = _mm256_set1_epi32((int)0xff000000);
+
+	/* each load reads 32 bytes for 24, stay clear of the row's end */
+	for (; x + 11 <= cx; x += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + x * 3));
+		v = _mm256_permutevar8x32_epi32(v, spread);
+		v = _mm256_or_si256(_mm256_shuffle_epi8(v, shuffle), alpha);
+		_mm256_storeu_si256((__m256i *)(d + x * 4), v);
+	}
+
+	Rgb24RowSSE2(s, d, x, cx);
+}
+#endif
+
+template<void (*Row)(const unsigned char *, unsigned char *, int, int)>
+static void Rgb24(const ConvertFrame &frame, int y0, int y1)
+{
+	for (int y = y0; y < y1; y++)
+		Row(frame.src[0] + y * frame.srcPitch[0],
+		    frame.dst[0] + y * frame.dstPitch[0], 0, frame.cx);
+}
+
+/* ------------------------------------------------------------------------- */
+/* BGRA to 4:2:0                                                             */
+
+template<bool PLANAR, typename K>
+static void BgraRowScalar(const unsigned char *s0, const unsigned char *s1,
+			  unsigned char *d0, unsigned char *d1,
+			  unsigned char *c0, unsigned char *c1, int x, int cx)
+{
+	const RgbToYuv &k = K::k;
+
+	for (; x < cx; x += 2) {
+		const unsigned char *p0 = s0 + x * 4;
+		const unsigned char *p1 = s1 + x * 4;
+		const int next = x + 1 < cx ? 4 : 0;
+
+		d0[x] = LumaScalar(p0, k);
+		if (next)
+			d0[x + 1] = LumaScalar(p0 + next, k);
+		if (d1) {
+			d1[x] = LumaScalar(p1, k);
+			if (next)
+				d1[x + 1] = LumaScalar(p1 + next, k);
+		}
+
+		int sum[3];
+		for (int c = 0; c < 3; c++)
+			sum[c] = p0[c] + p0[next + c] + p1[c] + p1[next + c];
+
+		unsigned char u = Clamp8((k.u[0] * sum[0] + k.u[1] * sum[1] +
+					  k.u[2] * sum[2] + k.uvOffset) >>
+					 16);
+		unsigned char v = Clamp8((k.v[0] * sum[0] + k.v[1] * sum[1] +
+					  k.v[2] * sum[2] + k.uvOffset) >>
+					 16);
+
+		if (PLANAR) {
+			c0[x / 2] = u;
+			c1[x / 2] = v;
+		} else {
+			c0[x] = u;
+			c0[x + 1] = v;
+		}
+	}
+}
+
+#ifdef CONVERT_SSE2
+/* sums the two halves of each pixel's pmaddwd result, for two vectors of two
+ * pixels each */
+static inline __m128i SumPairsSSE2(__m128i a, __m128i b)
+{
+	__m128 fa = _mm_castsi128_ps(a);
+	__m128 fb = _mm_castsi128_ps(b);
+	__m128i even = _mm_castps_si128(
+		_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0)));
+	__m128i odd = _mm_castps_si128(
+		_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1)));
+	return _mm_add_epi32(even, odd);
+}
+
+/* luma of 4 pixels as 32-bit values */
+static inline __m128i Luma4SSE2(__m128i px, __m128i ky, __m128i offset)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), ky);
+	__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), ky);
+	return _mm_srai_epi32(_mm_add_epi32(SumPairsSSE2(lo, hi), offset), 14);
+}
+
+/* [B G R A] sums of the two 2x2 blocks covered by 4 pixels of each row */
+static inline __m128i BlockSumsSSE2(__m128i r0, __m128i r1)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(r0, zero),
+				   _mm_unpacklo_epi8(r1, zero));
+	__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(r0, zero),
+				   _mm_unpackhi_epi8(r1, zero));
+	return _mm_add_epi16(_mm_unpacklo_epi64(lo, hi),
+			     _mm_unpackhi_epi64(lo, hi));
+}
+
+static inline __m128i Chroma4SSE2(__m128i a, __m128i b, __m128i k,
+				  __m128i offset)
+{
+	__m128i sum = SumPairsSSE2(_mm_madd_epi16(a, k), _mm_madd_epi16(b, k));
+	return _mm_srai_epi32(_mm_add_epi32(sum, offset), 16);
+}
+
+template<bool PLANAR, typename K>
+static void BgraRowSSE2(const unsigned char *s0, const unsigned char *s1,
+			unsigned char *d0, unsigned char *d1,
+			unsigned char *c0, unsigned char *c1, int x, int cx)
+{
+	const RgbToYuv &k = K::k;
+	const __m128i ky = _mm_loadu_si128((const __m128i *)k.y);
+	const __m128i ku = _mm_loadu_si128((const __m128i *)k.u);
+	const __m128i kv = _mm_loadu_si128((const __m128i *)k.v);
+	const __m128i yOffset = _mm_set1_epi32(k.yOffset);
+	const __m128i uvOffset = _mm_set1_epi32(k.uvOffset);
+
+	for (; x + 16 <= cx; x += 16) {
+		__m128i r0[4], r1[4];
+		for (int i = 0; i < 4; i++) {
+			r0[i] = _mm_loadu_si128((const __m128i *)(s0 + x * 4) +
+						i);
+			r1[i] = _mm_loadu_si128((const __m128i *)(s1 + x * 4) +
+						i);
+		}
+
+		__m128i y0 = _mm_packs_epi32(Luma4SSE2(r0[0], ky, yOffset),
+					     Luma4SSE2(r0[1], ky, yOffset));
+		__m128i y1 = _mm_packs_epi32(Luma4SSE2(r0[2], ky, yOffset),
+					     Luma4SSE2(r0[3], ky, yOffset));
+		_mm_storeu_si128((__m128i *)(d0 + x), _mm_packus_epi16(y0, y1));
+
+		if (d1) {
+			y0 = _mm_packs_epi32(Luma4SSE2(r1[0], ky, yOffset),
+					     Luma4SSE2(r1[1], ky, yOffset));
+			y1 = _mm_packs_epi32(Luma4SSE2(r1[2], ky, yOffset),
+					     Luma4SSE2(r1[3], ky, yOffset));
+			_mm_storeu_si128((__m128i *)(d1 + x),
+					 _mm_packus_epi16(y0, y1));
+		}
+
+		__m128i b[4];
+		for (int i = 0; i < 4; i++)
+			b[i] = BlockSumsSSE2(r0[i], r1[i]);
+
+		__m128i u = _mm_packs_epi32(
+			Chroma4SSE2(b[0], b[1], ku, uvOffset),
+			Chroma4SSE2(b[2], b[3], ku, uvOffset));
+		__m128i v = _mm_packs_epi32(
+			Chroma4SSE2(b[0], b[1], kv, uvOffset),
+			Chroma4SSE2(b[2], b[3], kv, uvOffset));
+		u = _mm_packus_epi16(u, u);
+		v = _mm_packus_epi16(v, v);
+
+		if (PLANAR) {
+			_mm_storel_epi64((__m128i *)(c0 + x / 2), u);
+			_mm_storel_epi64((__m128i *)(c1 + x / 2), v);
+		} else {
+			_mm_storeu_si128((__m128i *)(c0 + x),
+					 _mm_unpacklo_epi8(u, v));
+		}
+	}
+
+	BgraRowScalar<PLANAR, K>(s0, s1, d0, d1, c0, c1, x, cx);
+}
+#endif
+
+#ifdef CONVERT_AVX2
+/* same as SumPairsSSE2, but per 128-bit lane, which keeps pixels in order
+ * because the unpacks are per lane as well */
+AVX2_FUNC static inline __m256i SumPairsAVX2(__m256i a, __m256i b)
+{
+	__m256 fa = _mm256_castsi256_ps(a);
+	__m256 fb = _mm256_castsi256_ps(b);
+	__m256i even = _mm256_castps_si256(
+		_mm256_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0)));
+	__m256i odd = _mm256_castps_si256(
+		_mm256_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1)));
+	return _mm256_add_epi32(even, odd);
+}
+
+/* luma of 8 pixels as 32-bit values */
+AVX2_FUNC static inline __m256i Luma8AVX2(__m256i px, __m256i ky,
+					  __m256i offset)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(px, zero), ky);
+	__m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(px, zero), ky);
+	return _mm256_srai_epi32(
+		_mm256_add_epi32(SumPairsAVX2(lo, hi), offset), 14);
+}
+
+/* 16 luma values in order, as bytes in the low 128 bits */
+AVX2_FUNC static inline __m128i Luma16AVX2(const unsigned char *s, __m256i ky,
+					   __m256i offset)
+{
+	__m256i a = Luma8AVX2(_mm256_loadu_si256((const __m256i *)s), ky,
+			      offset);
+	__m256i b = Luma8AVX2(_mm256_loadu_si256((const __m256i *)s + 1), ky,
+			      offset);
+	__m256i words =
+		_mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+	__m256i bytes = _mm256_permute4x64_epi64(
+		_mm256_packus_epi16(words, words), 0xD8);
+	return _mm256_castsi256_si128(bytes);
+}
+
+AVX2_FUNC static inline __m256i BlockSumsAVX2(__m256i r0, __m256i r1)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(r0, zero),
+				      _mm256_unpacklo_epi8(r1, zero));
+	__m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(r0, zero),
+				      _mm256_unpackhi_epi8(r1, zero));
+	return _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi),
+				_mm256_unpackhi_epi64(lo, hi));
+}
+
+template<bool PLANAR, typename K>
+AVX2_FUNC static void BgraRowAVX2(const unsigned char *s0,
+				  const unsigned char *s1, unsigned char *d0,
+				  unsigned char *d1, unsigned char *c0,
+				  unsigned char *c1, int x, int cx)
+{
+	const RgbToYuv &k = K::k;
+	const __m256i ky = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((const __m128i *)k.y));
+	const __m256i ku = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((const __m128i *)k.u));
+	const __m256i kv = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((const __m128i *)k.v));
+	const __m256i yOffset = _mm256_set1_epi32(k.yOffset);
+	const __m256i uvOffset = _mm256_set1_epi32(k.uvOffset);
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+	for (; x + 16 <= cx; x += 16) {
+		_mm_storeu_si128((__m128i *)(d0 + x),
+				 Luma16AVX2(s0 + x * 4, ky, yOffset));
+		if (d1)
+			_mm_storeu_si128((__m128i *)(d1 + x),
+					 Luma16AVX2(s1 + x * 4, ky, yOffset));
+
+		const __m256i *p0 = (const __m256i *)(s0 + x * 4);
+		const __m256i *p1 = (const __m256i *)(s1 + x * 4);
+		__m256i a = BlockSumsAVX2(_mm256_loadu_si256(p0),
+					  _mm256_loadu_si256(p1));
+		__m256i b = BlockSumsAVX2(_mm256_loadu_si256(p0 + 1),
+					  _mm256_loadu_si256(p1 + 1));
+
+		__m256i u = SumPairsAVX2(_mm256_madd_epi16(a, ku),
+					 _mm256_madd_epi16(b, ku));
+		__m256i v = SumPairsAVX2(_mm256_madd_epi16(a, kv),
+					 _mm256_madd_epi16(b, kv));
+		u = _mm256_srai_epi32(_mm256_add_epi32(u, uvOffset), 16);
+		v = _mm256_srai_epi32(_mm256_add_epi32(v, uvOffset), 16);
+
+		/* u and v come out as blocks 0 1 4 5 | 2 3 6 7, the permute
+		 * restores the order after packing them together */
+		__m256i uv = _mm256_permutevar8x32_epi32(
+			_mm256_packs_epi32(u, v), order);
+		uv = _mm256_packus_epi16(uv, uv);
+
+		__m128i u8 = _mm256_castsi256_si128(uv);
+		__m128i v8 = _mm256_extracti128_si256(uv, 1);
+
+		if (PLANAR) {
+			_mm_storel_epi64((__m128i *)(c0 + x / 2), u8);
+			_mm_storel_epi64((__m128i *)(c1 + x / 2), v8);
+		} else {
+			_mm_storeu_si128((__m128i *)(c0 + x),
+					 _mm_unpacklo_epi8(u8, v8));
+		}
+	}
+
+	BgraRowScalar<PLANAR, K>(s0, s1, d0, d1, c0, c1, x, cx);
+}
+#endif
+
+template<RgbRowProc Row, bool PLANAR>
+static void Bgra(const ConvertFrame &frame, int y0, int y1)
+{
+	for (int y = y0; y < y1; y += 2) {
+		const bool pair = y + 1 < frame.cy;
+		const unsigned char *s0 = frame.src[0] + y * frame.srcPitch[0];
+		const unsigned char *s1 = pair ? s0 + frame.srcPitch[0] : s0;
+		unsigned char *d0 = frame.dst[0] + y * frame.dstPitch[0];
+		unsigned char *d1 = pair ? d0 + frame.dstPitch[0] : nullptr;
+		unsigned char *c0 = frame.dst[1] + y / 2 * frame.dstPitch[1];
+		unsigned char *c1 =
+			PLANAR ? frame.dst[2] + y / 2 * frame.dstPitch[2]
+			       : nullptr;
+
+		Row(s0, s1, d0, d1, c0, c1, 0, frame.cx);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+template<typename K>
+static ConvertProc SelectBgra(bool planar, CpuLevel level)
+{
+#ifdef CONVERT_AVX2
+	if (level >= CpuLevel::AVX2)
+		return planar ? Bgra<BgraRowAVX2<true, K>, true>
+			      : Bgra<BgraRowAVX2<false, K>, false>;
+#endif
+#ifdef CONVERT_SSE2
+	if (level >= CpuLevel::SSE2)
+		return planar ? Bgra<BgraRowSSE2<true, K>, true>
+			      : Bgra<BgraRowSSE2<false, K>, false>;
+#endif
+	(void)level;
+	return planar ? Bgra<BgraRowScalar<true, K>, true>
+		      : Bgra<BgraRowScalar<false, K>, false>;
+}
+
+template<ColorMatrix matrix>
+static ConvertProc SelectBgra(bool planar, ColorRange range, CpuLevel level)
+{
+	if (range == ColorRange::Full)
+		return SelectBgra<Coefficients<matrix, ColorRange::Full>>(
+			planar, level);
+	return SelectBgra<Coefficients<matrix, ColorRange::Limited>>(planar,
+								     level);
+}
+
+static ConvertProc SelectBgra(bool planar, ColorMatrix matrix,
+			      ColorRange range, CpuLevel level)
+{
+	switch (matrix) {
+	case ColorMatrix::BT601:
+		return SelectBgra<ColorMatrix::BT601>(planar, range, level);
+	case ColorMatrix::BT2020:
+		return SelectBgra<ColorMatrix::BT2020>(planar, range, level);
+	default:
+		return SelectBgra<ColorMatrix::BT709>(planar, range, level);
+	}
+}
+
+static ConvertProc SelectRgb24(CpuLevel level)
+{
+#ifdef CONVERT_AVX2
+	if (level >= CpuLevel::AVX2)
+		return Rgb24<Rgb24RowAVX2>;
+#endif
+	if (level >= CpuLevel::SSE2)
+		return Rgb24<Rgb24RowSSE2>;
+	return Rgb24<Rgb24RowScalar>;
+}
+
+ConvertProc GetRgbKernel(VideoFormat from, VideoFormat to, ColorMatrix matrix,
+			 ColorRange range, CpuLevel level)
+{
+	switch (from) {
+	case VideoFormat::RGB24:
+		if (to == VideoFormat::XRGB || to == VideoFormat::ARGB)
+			return SelectRgb24(level);
+		return nullptr;
+
+	case VideoFormat::XRGB:
+	case VideoFormat::ARGB:
+		if (to == VideoFormat::NV12)
+			return SelectBgra(false, matrix, range, level);
+		if (to == VideoFormat::I420 || to == VideoFormat::YV12)
+			return SelectBgra(true, matrix, range, level);
+		return nullptr;
+
+	default:
+		return nullptr;
+	}
+}
+
+}; /* namespace DShow */
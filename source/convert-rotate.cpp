@@ -0,0 +1,370 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+
+#include "convert-kernels.hpp"
+
+#include <string.h>
+
+#ifdef CONVERT_SSE2
+#include <emmintrin.h>
+#endif
+
+/*
+ * Rotation of NV12, I420/YV12, Y800 and XRGB/ARGB by 90, 180 and 270 degrees
+ * clockwise.  90 and 270 are transposes, read with a negative source or
+ * destination pitch to mirror them the right way; 180 reverses rows read
+ * bottom to top.
+ *
+ * Transposes work on 8x8 (4x4 for 32-bit pixels) tiles held in registers,
+ * and walk the frame in square blocks of tiles small enough that the cache
+ * lines of both the source and the destination rows of a block stay cached
+ * until the block has used them up, so each side is touched about once.
+ *
+ * Every plane is treated as an array of elements (1 byte for luma, 2 for
+ * NV12's interleaved chroma, 4 for RGB pixels).  4:2:0 frames must have even
+ * dimensions.
+ */
+
+/* elements per side of a cache block */
+#define BLOCK_SIZE 32
+
+namespace DShow {
+
+/* ------------------------------------------------------------------------- */
+/* transpose, dst row j = source column j                                    */
+
+template<int B>
+static void TransposeScalar(const unsigned char *src, ptrdiff_t srcPitch,
+			    unsigned char *dst, ptrdiff_t dstPitch, int i0,
+			    int i1, int j0, int j1)
+{
+	for (int j = j0; j < j1; j++) {
+		unsigned char *d = dst + j * dstPitch;
+		const unsigned char *s = src + j * B;
+
+		for (int i = i0; i < i1; i++)
+			memcpy(d + i * B, s + i * srcPitch, B);
+	}
+}
+
+#ifdef CONVERT_SSE2
+template<int B> struct TileSSE2;
+
+template<> struct TileSSE2<1> {
+	enum { size = 8 };
+
+	static inline void Run(const unsigned char *s, ptrdiff_t sp,
+			       unsigned char *d, ptrdiff_t dp)
+	{
+		__m128i a0 = _mm_loadl_epi64((const __m128i *)(s + 0 * sp));
+		__m128i a1 = _mm_loadl_epi64((const __m128i *)(s + 1 * sp));
+		__m128i a2 = _mm_loadl_epi64((const __m128i *)(s + 2 * sp));
+		__m128i a3 = _mm_loadl_epi64((const __m128i *)(s + 3 * sp));
+		__m128i a4 = _mm_loadl_epi64((const __m128i *)(s + 4 * sp));
+		__m128i a5 = _mm_loadl_epi64((const __m128i *)(s + 5 * sp));
+		__m128i a6 = _mm_loadl_epi64((const __m128i *)(s + 6 * sp));
+		__m128i a7 = _mm_loadl_epi64((const __m128i *)(s + 7 * sp));
+
+		__m128i b0 = _mm_unpacklo_epi8(a0, a1);
+		__m128i b1 = _mm_unpacklo_epi8(a2, a3);
+		__m128i b2 = _mm_unpacklo_epi8(a4, a5);
+		__m128i b3 = _mm_unpacklo_epi8(a6, a7);
+
+		__m128i c0 = _mm_unpacklo_epi16(b0, b1);
+		__m128i c1 = _mm_unpackhi_epi16(b0, b1);
+		__m128i c2 = _mm_unpacklo_epi16(b2, b3);
+		__m128i c3 = _mm_unpackhi_epi16(b2, b3);
+
+		/* two destination rows per register */
+		__m128i d0 = _mm_unpacklo_epi32(c0, c2);
+		__m128i d1 = _mm_unpackhi_epi32(c0, c2);
+		__m128i d2 = _mm_unpacklo_epi32(c1, c3);
+		__m128i d3 = _mm_unpackhi_epi32(c1, c3);
+
+		_mm_storel_epi64((__m128i *)(d + 0 * dp), d0);
+		_mm_storel_epi64((__m128i *)(d + 1 * dp), _mm_srli_si128(d0, 8));
+		_mm_storel_epi64((__m128i *)(d + 2 * dp), d1);
+		_mm_storel_epi64((__m128i *)(d + 3 * dp), _mm_srli_si128(d1, 8));
+		_mm_storel_epi64((__m128i *)(d + 4 * dp), d2);
+		_mm_storel_epi64((__m128i *)(d + 5 * dp), _mm_srli_si128(d2, 8));
+		_mm_storel_epi64((__m128i *)(d + 6 * dp), d3);
+		_mm_storel_epi64((__m128i *)(d + 7 * dp), _mm_srli_si128(d3, 8));
+	}
+};
+
+template<> struct TileSSE2<2> {
+	enum { size = 8 };
+
+	static inline void Run(const unsigned char *s, ptrdiff_t sp,
+			       unsigned char *d, ptrdiff_t dp)
+	{
+		__m128i a0 = _mm_loadu_si128((const __m128i *)(s + 0 * sp));
+		__m128i a1 = _mm_loadu_si128((const __m128i *)(s + 1 * sp));
+		__m128i a2 = _mm_loadu_si128((const __m128i *)(s + 2 * sp));
+		__m128i a3 = _mm_loadu_si128((const __m128i *)(s + 3 * sp));
+		__m128i a4 = _mm_loadu_si128((const __m128i *)(s + 4 * sp));
+		__m128i a5 = _mm_loadu_si128((const __m128i *)(s + 5 * sp));
+		__m128i a6 = _mm_loadu_si128((const __m128i *)(s + 6 * sp));
+		__m128i a7 = _mm_loadu_si128((const __m128i *)(s + 7 * sp));
+
+		__m128i b0 = _mm_unpacklo_epi16(a0, a1);
+		__m128i b1 = _mm_unpackhi_epi16(a0, a1);
+		__m128i b2 = _mm_unpacklo_epi16(a2, a3);
+		__m128i b3 = _mm_unpackhi_epi16(a2, a3);
+		__m128i b4 = _mm_unpacklo_epi16(a4, a5);
+		__m128i b5 = _mm_unpackhi_epi16(a4, a5);
+		__m128i b6 = _mm_unpacklo_epi16(a6, a7);
+		__m128i b7 = _mm_unpackhi_epi16(a6, a7);
+
+		__m128i c0 = _mm_unpacklo_epi32(b0, b2);
+		__m128i c1 = _mm_unpackhi_epi32(b0, b2);
+		__m128i c2 = _mm_unpacklo_epi32(b1, b3);
+		__m128i c3 = _mm_unpackhi_epi32(b1, b3);
+		__m128i c4 = _mm_unpacklo_epi32(b4, b6);
+		__m128i c5 = _mm_unpackhi_epi32(b4, b6);
+		__m128i c6 = _mm_unpacklo_epi32(b5, b7);
+		__m128i c7 = _mm_unpackhi_epi32(b5, b7);
+
+		_mm_storeu_si128((__m128i *)(d + 0 * dp),
+				 _mm_unpacklo_epi64(c0, c4));
+		_mm_storeu_si128((__m128i *)(d + 1 * dp),
+				 _mm_unpackhi_epi64(c0, c4));
+		_mm_storeu_si128((__m128i *)(d + 2 * dp),
+				 _mm_unpacklo_epi64(c1, c5));
+		_mm_storeu_si128((__m128i *)(d + 3 * dp),
+				 _mm_unpackhi_epi64(c1, c5));
+		_mm_storeu_si128((__m128i *)(d + 4 * dp),
+				 _mm_unpacklo_epi64(c2, c6));
+		_mm_storeu_si128((__m128i *)(d + 5 * dp),
+				 _mm_unpackhi_epi64(c2, c6));
+		_mm_storeu_si128((__m128i *)(d + 6 * dp),
+				 _mm_unpacklo_epi64(c3, c7));
+		_mm_storeu_si128((__m128i *)(d + 7 * dp),
+				 _mm_unpackhi_epi64(c3, c7));
+	}
+};
+
+template<> struct TileSSE2<4> {
+	enum { size = 4 };
+
+	static inline void Run(const unsigned char *s, ptrdiff_t sp,
+			       unsigned char *d, ptrdiff_t dp)
+	{
+		__m128i a0 = _mm_loadu_si128((const __m128i *)(s + 0 * sp));
+		__m128i a1 = _mm_loadu_si128((const __m128i *)(s + 1 * sp));
+		__m128i a2 = _mm_loadu_si128((const __m128i *)(s + 2 * sp));
+		__m128i a3 = _mm_loadu_si128((const __m128i *)(s + 3 * sp));
+
+		__m128i b0 = _mm_unpacklo_epi32(a0, a1);
+		__m128i b1 = _mm_unpackhi_epi32(a0, a1);
+		__m128i b2 = _mm_unpacklo_epi32(a2, a3);
+		__m128i b3 = _mm_unpackhi_epi32(a2, a3);
+
+		_mm_storeu_si128((__m128i *)(d + 0 * dp),
+				 _mm_unpacklo_epi64(b0, b2));
+		_mm_storeu_si128((__m128i *)(d + 1 * dp),
+				 _mm_unpackhi_epi64(b0, b2));
+		_mm_storeu_si128((__m128i *)(d + 2 * dp),
+				 _mm_unpacklo_epi64(b1, b3));
+		_mm_storeu_si128((__m128i *)(d + 3 * dp),
+				 _mm_unpackhi_epi64(b1, b3));
+	}
+};
+#endif
+
+/* writes destination rows [y0, y1), each cx elements (source rows) long */
+template<int B, bool simd>
+static void Transpose(const unsigned char *src, ptrdiff_t srcPitch,
+		      unsigned char *dst, ptrdiff_t dstPitch, int cx, int y0,
+		      int y1)
+{
+#ifdef CONVERT_SSE2
+	if (simd) {
+		const int size = TileSSE2<B>::size;
+		const int i1 = cx / size * size;
+		const int j1 = y0 + (y1 - y0) / size * size;
+
+		for (int jb = y0; jb < j1; jb += BLOCK_SIZE) {
+			const int je = jb + BLOCK_SIZE < j1 ? jb + BLOCK_SIZE
+							    : j1;
+
+			for (int ib = 0; ib < i1; ib += BLOCK_SIZE) {
+				const int ie = ib + BLOCK_SIZE < i1
+						       ? ib + BLOCK_SIZE
+						       : i1;
+
+				for (int i = ib; i < ie; i += size) {
+					for (int j = jb; j < je; j += size)
+						TileSSE2<B>::Run(
+							src + i * srcPitch +
+								j * B,
+							srcPitch,
+							dst + j * dstPitch +
+								i * B,
+							dstPitch);
+				}
+			}
+		}
+
+		TransposeScalar<B>(src, srcPitch, dst, dstPitch, i1, cx, y0,
+				   j1);
+		TransposeScalar<B>(src, srcPitch, dst, dstPitch, 0, cx, j1, y1);
+		return;
+	}
+#endif
+
+	TransposeScalar<B>(src, srcPitch, dst, dstPitch, 0, cx, y0, y1);
+}
+
+/* ------------------------------------------------------------------------- */
+/* reverse, dst row y = source row y back to front                           */
+
+#ifdef CONVERT_SSE2
+template<int B> static inline __m128i ReverseSSE2(__m128i v);
+
+template<> inline __m128i ReverseSSE2<4>(__m128i v)
+{
+	return _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+template<> inline __m128i ReverseSSE2<2>(__m128i v)
+{
+	v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+	v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+	return _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+template<> inline __m128i ReverseSSE2<1>(__m128i v)
+{
+	v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+	return ReverseSSE2<2>(v);
+}
+#endif
+
+template<int B, bool simd>
+static void Reverse(const unsigned char *src, ptrdiff_t srcPitch,
+		    unsigned char *dst, ptrdiff_t dstPitch, int cx, int y0,
+		    int y1)
+{
+	for (int y = y0; y < y1; y++) {
+		const unsigned char *s = src + y * srcPitch;
+		unsigned char *d = dst + y * dstPitch;
+		int x = 0;
+
+#ifdef CONVERT_SSE2
+		const int n = 16 / B;
+		if (simd) {
+			for (; x + n <= cx; x += n) {
+				__m128i v = _mm_loadu_si128(
+					(const __m128i *)(s + (cx - x - n) * B));
+				_mm_storeu_si128((__m128i *)(d + x * B),
+						 ReverseSSE2<B>(v));
+			}
+		}
+#endif
+
+		for (; x < cx; x++)
+			memcpy(d + x * B, s + (cx - 1 - x) * B, B);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* cx/cy are the size of the rotated plane */
+template<int rotation, int B, bool simd>
+static inline void RotatePlane(const unsigned char *src, ptrdiff_t srcPitch,
+			       unsigned char *dst, ptrdiff_t dstPitch, int cx,
+			       int cy, int y0, int y1)
+{
+	if (rotation == 180) {
+		Reverse<B, simd>(src + (cy - 1) * srcPitch, -srcPitch, dst,
+				 dstPitch, cx, y0, y1);
+	} else if (rotation == 90) {
+		/* the last source row becomes the first column */
+		Transpose<B, simd>(src + (cx - 1) * srcPitch, -srcPitch, dst,
+				   dstPitch, cx, y0, y1);
+	} else {
+		/* the last source column becomes the first row */
+		Transpose<B, simd>(src, srcPitch, dst + (cy - 1) * dstPitch,
+				   -dstPitch, cx, y0, y1);
+	}
+}
+
+template<int rotation, int lumaBytes, int chromaBytes, int chromaPlanes,
+	 bool simd>
+static void Rotate(const ConvertFrame &frame, int y0, int y1)
+{
+	RotatePlane<rotation, lumaBytes, simd>(
+		frame.src[0], frame.srcPitch[0], frame.dst[0],
+		frame.dstPitch[0], frame.cx, frame.cy, y0, y1);
+
+	for (int i = 1; i <= chromaPlanes; i++)
+		RotatePlane<rotation, chromaBytes, simd>(
+			frame.src[i], frame.srcPitch[i], frame.dst[i],
+			frame.dstPitch[i], frame.cx / 2, frame.cy / 2, y0 / 2,
+			y1 / 2);
+}
+
+template<int rotation, bool simd>
+static ConvertProc GetRotateKernel(VideoFormat format)
+{
+	switch (format) {
+	case VideoFormat::NV12:
+		return Rotate<rotation, 1, 2, 1, simd>;
+	case VideoFormat::I420:
+	case VideoFormat::YV12:
+		return Rotate<rotation, 1, 1, 2, simd>;
+	case VideoFormat::Y800:
+		return Rotate<rotation, 1, 1, 0, simd>;
+	case VideoFormat::XRGB:
+	case VideoFormat::ARGB:
+		return Rotate<rotation, 4, 1, 0, simd>;
+	default:
+		return nullptr;
+	}
+}
+
+template<bool simd>
+static ConvertProc GetRotateKernel(VideoFormat format, int rotation)
+{
+	switch (rotation) {
+	case 90:
+		return GetRotateKernel<90, simd>(format);
+	case 180:
+		return GetRotateKernel<180, simd>(format);
+	case 270:
+		return GetRotateKernel<270, simd>(format);
+	default:
+		return nullptr;
+	}
+}
+
+ConvertProc GetRotateKernel(VideoFormat format, int rotation, CpuLevel level)
+{
+#ifdef CONVERT_SSE2
+	if (level >= CpuLevel::SSE2)
+		return GetRotateKernel<true>(format, rotation);
+#endif
+
+	(void)level;
+	return GetRotateKernel<false>(format, rotation);
+}
+
+}; /* namespace DShow */
@@ -0,0 +1,287 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+
+#include "convert-kernels.hpp"
+
+#ifdef CONVERT_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef CONVERT_AVX2
+#include <immintrin.h>
+#endif
+
+/*
+ * Packed 4:2:2 to 4:2:0.  Luma is copied as is, chroma is averaged over each
+ * pair of rows (rounding up, the same as pavgb) and then either interleaved
+ * (NV12) or split into planes (I420/YV12).
+ *
+ * YPOS is the offset of the luma bytes within each 16-bit word (0 for
+ * YUY2/YVYU, 1 for UYVY/HDYC) and SWAP is set for layouts that store V
+ * before U.
+ */
+
+namespace DShow {
+
+typedef void (*Packed422RowProc)(const unsigned char *s0,
+				 const unsigned char *s1, unsigned char *d0,
+				 unsigned char *d1, unsigned char *c0,
+				 unsigned char *c1, int x, int cx);
+
+template<int YPOS, bool SWAP, bool PLANAR>
+static void Packed422RowScalar(const unsigned char *s0, const unsigned char *s1,
+			       unsigned char *d0, unsigned char *d1,
+			       unsigned char *c0, unsigned char *c1, int x,
+			       int cx)
+{
+	const int CPOS = 1 - YPOS;
+
+	for (; x < cx; x += 2) {
+		const unsigned char *p0 = s0 + x * 2;
+		const unsigned char *p1 = s1 + x * 2;
+		const bool full = x + 1 < cx;
+
+		d0[x] = p0[YPOS];
+		if (full)
+			d0[x + 1] = p0[YPOS + 2];
+		if (d1) {
+			d1[x] = p1[YPOS];
+			if (full)
+				d1[x + 1] = p1[YPOS + 2];
+		}
+
+		unsigned char first = (unsigned char)((p0[CPOS] + p1[CPOS] + 1) >> 1);
+		unsigned char second =
+			(unsigned char)((p0[CPOS + 2] + p1[CPOS + 2] + 1) >> 1);
+		unsigned char u = SWAP ? second : first;
+		unsigned char v = SWAP ? first : second;
+
+		if (PLANAR) {
+			c0[x / 2] = u;
+			c1[x / 2] = v;
+		} else {
+			c0[x] = u;
+			c0[x + 1] = v;
+		}
+	}
+}
+
+#ifdef CONVERT_SSE2
+template<int YPOS>
+static inline __m128i PackLumaSSE2(__m128i a, __m128i b, __m128i mask)
+{
+	if (YPOS)
+		return _mm_packus_epi16(_mm_srli_epi16(a, 8),
+					_mm_srli_epi16(b, 8));
+	return _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+}
+
+template<int YPOS, bool SWAP, bool PLANAR>
+static void Packed422RowSSE2(const unsigned char *s0, const unsigned char *s1,
+			     unsigned char *d0, unsigned char *d1,
+			     unsigned char *c0, unsigned char *c1, int x,
+			     int cx)
+{
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; x + 16 <= cx; x += 16) {
+		const __m128i *p0 = (const __m128i *)(s0 + x * 2);
+		const __m128i *p1 = (const __m128i *)(s1 + x * 2);
+		__m128i a0 = _mm_loadu_si128(p0);
+		__m128i b0 = _mm_loadu_si128(p0 + 1);
+		__m128i a1 = _mm_loadu_si128(p1);
+		__m128i b1 = _mm_loadu_si128(p1 + 1);
+
+		_mm_storeu_si128((__m128i *)(d0 + x),
+				 PackLumaSSE2<YPOS>(a0, b0, mask));
+		if (d1)
+			_mm_storeu_si128((__m128i *)(d1 + x),
+					 PackLumaSSE2<YPOS>(a1, b1, mask));
+
+		/* chroma is packed the same way as luma, just from the other
+		 * byte of each word */
+		__m128i c = PackLumaSSE2<1 - YPOS>(_mm_avg_epu8(a0, a1),
+						   _mm_avg_epu8(b0, b1), mask);
+
+		if (PLANAR) {
+			__m128i first = _mm_packus_epi16(_mm_and_si128(c, mask),
+							 zero);
+			__m128i second =
+				_mm_packus_epi16(_mm_srli_epi16(c, 8), zero);
+
+			_mm_storel_epi64((__m128i *)(c0 + x / 2),
+					 SWAP ? second : first);
+			_mm_storel_epi64((__m128i *)(c1 + x / 2),
+					 SWAP ? first : second);
+		} else {
+			if (SWAP)
+				c = _mm_or_si128(_mm_slli_epi16(c, 8),
+						 _mm_srli_epi16(c, 8));
+			_mm_storeu_si128((__m128i *)(c0 + x), c);
+		}
+	}
+
+	Packed422RowScalar<YPOS, SWAP, PLANAR>(s0, s1, d0, d1, c0, c1, x, cx);
+}
+#endif
+
+#ifdef CONVERT_AVX2
+/* packus works within 128-bit lanes, the permute puts the quadwords back in
+ * order */
+template<int YPOS>
+AVX2_FUNC static inline __m256i PackLumaAVX2(__m256i a, __m256i b,
+					     __m256i mask)
+{
+	__m256i packed;
+	if (YPOS)
+		packed = _mm256_packus_epi16(_mm256_srli_epi16(a, 8),
+					     _mm256_srli_epi16(b, 8));
+	else
+		packed = _mm256_packus_epi16(_mm256_and_si256(a, mask),
+					     _mm256_and_si256(b, mask));
+	return _mm256_permute4x64_epi64(packed, 0xD8);
+}
+
+template<int YPOS, bool SWAP, bool PLANAR>
+AVX2_FUNC static void
+Packed422RowAVX2(const unsigned char *s0, const unsigned char *s1,
+		 unsigned char *d0, unsigned char *d1, unsigned char *c0,
+		 unsigned char *c1, int x, int cx)
+{
+	const __m256i mask = _mm256_set1_epi16(0x00ff);
+	const __m256i zero = _mm256_setzero_si256();
+
+	for (; x + 32 <= cx; x += 32) {
+		const __m256i *p0 = (const __m256i *)(s0 + x * 2);
+		const __m256i *p1 = (const __m256i *)(s1 + x * 2);
+		__m256i a0 = _mm256_loadu_si256(p0);
+		__m256i b0 = _mm256_loadu_si256(p0 + 1);
+		__m256i a1 = _mm256_loadu_si256(p1);
+		__m256i b1 = _mm256_loadu_si256(p1 + 1);
+
+		_mm256_storeu_si256((__m256i *)(d0 + x),
+				    PackLumaAVX2<YPOS>(a0, b0, mask));
+		if (d1)
+			_mm256_storeu_si256((__m256i *)(d1 + x),
+					    PackLumaAVX2<YPOS>(a1, b1, mask));
+
+		__m256i c = PackLumaAVX2<1 - YPOS>(_mm256_avg_epu8(a0, a1),
+						   _mm256_avg_epu8(b0, b1),
+						   mask);
+
+		if (PLANAR) {
+			__m256i first = _mm256_permute4x64_epi64(
+				_mm256_packus_epi16(_mm256_and_si256(c, mask),
+						    zero),
+				0xD8);
+			__m256i second = _mm256_permute4x64_epi64(
+				_mm256_packus_epi16(_mm256_srli_epi16(c, 8),
+						    zero),
+				0xD8);
+
+			_mm_storeu_si128((__m128i *)(c0 + x / 2),
+					 _mm256_castsi256_si128(SWAP ? second
+								     : first));
+			_mm_storeu_si128((__m128i *)(c1 + x / 2),
+					 _mm256_castsi256_si128(SWAP ? first
+								     : second));
+		} else {
+			if (SWAP)
+				c = _mm256_or_si256(_mm256_slli_epi16(c, 8),
+						    _mm256_srli_epi16(c, 8));
+			_mm256_storeu_si256((__m256i *)(c0 + x), c);
+		}
+	}
+
+	Packed422RowScalar<YPOS, SWAP, PLANAR>(s0, s1, d0, d1, c0, c1, x, cx);
+}
+#endif
+
+template<Packed422RowProc Row, bool PLANAR>
+static void Packed422(const ConvertFrame &frame, int y0, int y1)
+{
+	for (int y = y0; y < y1; y += 2) {
+		const bool pair = y + 1 < frame.cy;
+		const unsigned char *s0 = frame.src[0] + y * frame.srcPitch[0];
+		const unsigned char *s1 = pair ? s0 + frame.srcPitch[0] : s0;
+		unsigned char *d0 = frame.dst[0] + y * frame.dstPitch[0];
+		unsigned char *d1 = pair ? d0 + frame.dstPitch[0] : nullptr;
+		unsigned char *c0 = frame.dst[1] + y / 2 * frame.dstPitch[1];
+		unsigned char *c1 =
+			PLANAR ? frame.dst[2] + y / 2 * frame.dstPitch[2]
+			       : nullptr;
+
+		Row(s0, s1, d0, d1, c0, c1, 0, frame.cx);
+	}
+}
+
+template<int YPOS, bool SWAP>
+static ConvertProc SelectPacked422(bool planar, CpuLevel level)
+{
+#ifdef CONVERT_AVX2
+	if (level >= CpuLevel::AVX2)
+		return planar ? Packed422<Packed422RowAVX2<YPOS, SWAP, true>,
+					  true>
+			      : Packed422<Packed422RowAVX2<YPOS, SWAP, false>,
+					  false>;
+#endif
+#ifdef CONVERT_SSE2
+	if (level >= CpuLevel::SSE2)
+		return planar ? Packed422<Packed422RowSSE2<YPOS, SWAP, true>,
+					  true>
+			      : Packed422<Packed422RowSSE2<YPOS, SWAP, false>,
+					  false>;
+#endif
+	(void)level;
+	return planar ? Packed422<Packed422RowScalar<YPOS, SWAP, true>, true>
+		      : Packed422<Packed422RowScalar<YPOS, SWAP, false>, false>;
+}
+
+ConvertProc GetPacked422Kernel(VideoFormat from, VideoFormat to,
+			       CpuLevel level)
+{
+	bool planar;
+
+	switch (to) {
+	case VideoFormat::NV12:
+		planar = false;
+		break;
+	case VideoFormat::I420:
+	case VideoFormat::YV12:
+		planar = true;
+		break;
+	default:
+		return nullptr;
+	}
+
+	switch (from) {
+	case VideoFormat::YUY2:
+		return SelectPacked422<0, false>(planar, level);
+	case VideoFormat::YVYU:
+		return SelectPacked422<0, true>(planar, level);
+	case VideoFormat::UYVY:
+	case VideoFormat::HDYC:
+		return SelectPacked422<1, false>(planar, level);
+	default:
+		return nullptr;
+	}
+}
+
+}; /* namespace DShow */
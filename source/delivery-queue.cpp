@@ -0,0 +1,283 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "delivery-queue.hpp"
+#include "log.hpp"
+
+namespace DShow {
+
+void FrameRing::Reset(size_t capacity_)
+{
+	capacity = capacity_;
+	slots.reset(capacity ? new Slot[capacity] : nullptr);
+
+	for (size_t i = 0; i < capacity; i++)
+		slots[i].seq.store(i, std::memory_order_relaxed);
+
+	pushPos.store(0, std::memory_order_relaxed);
+	popPos.store(0, std::memory_order_relaxed);
+}
+
+bool FrameRing::TryPush(QueuedFrame &frame)
+{
+	size_t pos = pushPos.load(std::memory_order_relaxed);
+	Slot *slot;
+
+	for (;;) {
+		slot = &slots[pos % capacity];
+		size_t seq = slot->seq.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+		if (diff == 0) {
+			if (pushPos.compare_exchange_weak(
+				    pos, pos + 1, std::memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			return false;
+		} else {
+			pos = pushPos.load(std::memory_order_relaxed);
+		}
+	}
+
+	slot->value = std::move(frame);
+	slot->seq.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+bool FrameRing::TryPop(QueuedFrame &frame)
+{
+	size_t pos = popPos.load(std::memory_order_relaxed);
+	Slot *slot;
+
+	for (;;) {
+		slot = &slots[pos % capacity];
+		size_t seq = slot->seq.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+		if (diff == 0) {
+			if (popPos.compare_exchange_weak(
+				    pos, pos + 1, std::memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			return false;
+		} else {
+			pos = popPos.load(std::memory_order_relaxed);
+		}
+	}
+
+	frame = std::move(slot->value);
+	slot->seq.store(pos + capacity, std::memory_order_release);
+	return true;
+}
+
+size_t FrameRing::Count() const
+{
+	size_t push = pushPos.load(std::memory_order_relaxed);
+	size_t pop = popPos.load(std::memory_order_relaxed);
+	return push > pop ? push - pop : 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+DeliveryQueue::DeliveryQueue()
+{
+	dataEvent = CreateEvent(nullptr, false, false, nullptr);
+	spaceEvent = CreateEvent(nullptr, false, false, nullptr);
+}
+
+DeliveryQueue::~DeliveryQueue()
+{
+	Stop();
+	CloseHandle(dataEvent);
+	CloseHandle(spaceEvent);
+}
+
+bool DeliveryQueue::Start(const QueueConfig &config_, DeliverProc deliver_)
+{
+	Stop();
+
+	if (config_.depth <= 0)
+		return false;
+	if (!dataEvent || !spaceEvent) {
+		Error(L"DeliveryQueue: Failed to create events");
+		return false;
+	}
+
+	config = config_;
+	deliver = std::move(deliver_);
+	ring.Reset((size_t)config.depth);
+
+	queued = 0;
+	delivered = 0;
+	droppedOldest = 0;
+	droppedNewest = 0;
+	droppedTimeout = 0;
+	droppedStop = 0;
+	maxQueued = 0;
+
+	ResetEvent(dataEvent);
+	ResetEvent(spaceEvent);
+	stopping = false;
+
+	if (deliver)
+		thread = std::thread(&DeliveryQueue::DeliveryThread, this);
+
+	active = true;
+	return true;
+}
+
+void DeliveryQueue::Stop()
+{
+	if (!active)
+		return;
+
+	active = false;
+	stopping = true;
+	SetEvent(dataEvent);
+	SetEvent(spaceEvent);
+
+	/* the delivery thread empties the ring before it exits, so this only
+	 * releases frames that were never pulled or were pushed too late */
+	if (thread.joinable())
+		thread.join();
+
+	QueuedFrame frame;
+	while (ring.TryPop(frame)) {
+		frame.frame.Release();
+		frame.segments.clear();
+		droppedStop++;
+	}
+
+	deliver = nullptr;
+}
+
+void DeliveryQueue::Push(QueuedFrame &frame)
+{
+	if (!ring.TryPush(frame)) {
+		switch (config.overflow) {
+		case OverflowPolicy::DropOldest: {
+			QueuedFrame oldest;
+			while (!ring.TryPush(frame)) {
+				if (ring.TryPop(oldest)) {
+					oldest.frame.Release();
+					oldest.segments.clear();
+					droppedOldest++;
+				}
+			}
+			break;
+		}
+
+		case OverflowPolicy::DropNewest:
+			frame.frame.Release();
+			frame.segments.clear();
+			droppedNewest++;
+			return;
+
+		case OverflowPolicy::Block: {
+			ULONGLONG start = GetTickCount64();
+			ULONGLONG timeout = (ULONGLONG)config.blockTimeoutMs;
+
+			while (!ring.TryPush(frame)) {
+				ULONGLONG elapsed = GetTickCount64() - start;
+				if (stopping || elapsed >= timeout) {
+					frame.frame.Release();
+					frame.segments.clear();
+					droppedTimeout++;
+					return;
+				}
+
+				WaitForSingleObject(spaceEvent,
+						    (DWORD)(timeout - elapsed));
+			}
+			break;
+		}
+		}
+	}
+
+	queued++;
+
+	long count = (long)ring.Count();
+	if (count > maxQueued)
+		maxQueued = count;
+
+	SetEvent(dataEvent);
+}
+
+bool DeliveryQueue::Pop(QueuedFrame &frame, unsigned long timeoutMs)
+{
+	ULONGLONG start = GetTickCount64();
+
+	while (!ring.TryPop(frame)) {
+		ULONGLONG elapsed = GetTickCount64() - start;
+		if (!active || elapsed >= timeoutMs)
+			return false;
+
+		WaitForSingleObject(dataEvent, (DWORD)(timeoutMs - elapsed));
+	}
+
+	delivered++;
+
+	if (config.overflow == OverflowPolicy::Block)
+		SetEvent(spaceEvent);
+	return true;
+}
+
+void DeliveryQueue::DeliveryThread()
+{
+	HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	QueuedFrame frame;
+
+	for (;;) {
+		/* read before popping, so that everything pushed before Stop
+		 * is seen once the ring turns up empty */
+		bool stop = stopping;
+
+		if (!ring.TryPop(frame)) {
+			if (stop)
+				break;
+			WaitForSingleObject(dataEvent, INFINITE);
+			continue;
+		}
+
+		if (config.overflow == OverflowPolicy::Block)
+			SetEvent(spaceEvent);
+
+		deliver(frame);
+		frame.frame.Release();
+		frame.segments.clear();
+		delivered++;
+	}
+
+	if (SUCCEEDED(hr))
+		CoUninitialize();
+}
+
+void DeliveryQueue::GetStats(QueueStats &stats) const
+{
+	stats.depth = (int)ring.Capacity();
+	stats.queued = queued;
+	stats.delivered = delivered;
+	stats.droppedOldest = droppedOldest;
+	stats.droppedNewest = droppedNewest;
+	stats.droppedTimeout = droppedTimeout;
+	stats.droppedStop = droppedStop;
+	stats.maxQueued = maxQueued;
+}
+
+}; /* namespace DShow */
@@ -0,0 +1,124 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+#include "dshow-base.hpp"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace DShow {
+
+struct QueuedFrame {
+	FrameRef frame;
+
+	/* segments of an encoded access unit, used instead of frame */
+	std::vector<FrameRef> segments;
+
+	long rotation = 0;
+};
+
+/*
+ * Bounded lock-free ring (sequence-per-slot design).  There is a single
+ * producer, but both the consumer and the producer may pop, which is what
+ * allows the producer to discard the oldest entry when the ring is full.
+ */
+class FrameRing {
+	struct Slot {
+		std::atomic<size_t> seq;
+		QueuedFrame value;
+	};
+
+	std::unique_ptr<Slot[]> slots;
+	size_t capacity = 0;
+	std::atomic<size_t> pushPos{0};
+	std::atomic<size_t> popPos{0};
+
+public:
+	void Reset(size_t capacity);
+
+	bool TryPush(QueuedFrame &frame);
+	bool TryPop(QueuedFrame &frame);
+
+	inline size_t Capacity() const { return capacity; }
+	size_t Count() const;
+};
+
+class DeliveryQueue {
+public:
+	typedef std::function<void(QueuedFrame &frame)> DeliverProc;
+
+private:
+	FrameRing ring;
+	QueueConfig config;
+	DeliverProc deliver;
+
+	HANDLE dataEvent = nullptr;
+	HANDLE spaceEvent = nullptr;
+	std::thread thread;
+	std::atomic<bool> active{false};
+	std::atomic<bool> stopping{false};
+
+	std::atomic<long long> queued{0};
+	std::atomic<long long> delivered{0};
+	std::atomic<long long> droppedOldest{0};
+	std::atomic<long long> droppedNewest{0};
+	std::atomic<long long> droppedTimeout{0};
+	std::atomic<long long> droppedStop{0};
+	std::atomic<long> maxQueued{0};
+
+	void DeliveryThread();
+
+public:
+	DeliveryQueue();
+	~DeliveryQueue();
+
+	/**
+	 * Starts the queue.  If deliver is null, no delivery thread is
+	 * created and frames must be pulled with Pop.
+	 */
+	bool Start(const QueueConfig &config, DeliverProc deliver);
+
+	/**
+	 * Stops the queue.  Frames already queued are still delivered if
+	 * there is a delivery thread, otherwise they count as droppedStop.
+	 */
+	void Stop();
+
+	inline bool Active() const { return active; }
+
+	/** Called from the streaming thread only */
+	void Push(QueuedFrame &frame);
+
+	bool Pop(QueuedFrame &frame, unsigned long timeoutMs);
+
+	void GetStats(QueueStats &stats) const;
+
+	inline long long Dropped() const
+	{
+		return droppedOldest + droppedNewest + droppedTimeout +
+		       droppedStop;
+	}
+};
+
+}; /* namespace DShow */
@@ -0,0 +1,113 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "device-watcher.hpp"
+#include "log.hpp"
+
+#define MIN_PROBE_INTERVAL_MS 10
+
+namespace DShow {
+
+DeviceWatcher::DeviceWatcher()
+{
+	stopEvent = CreateEvent(nullptr, true, false, nullptr);
+}
+
+DeviceWatcher::~DeviceWatcher()
+{
+	Stop();
+	CloseHandle(stopEvent);
+}
+
+void DeviceWatcher::AddProbe(unsigned long intervalMs, ProbeProc poll)
+{
+	if (Active()) {
+		Warning(L"DeviceWatcher: Cannot add probes while active");
+		return;
+	}
+
+	if (intervalMs < MIN_PROBE_INTERVAL_MS)
+		intervalMs = MIN_PROBE_INTERVAL_MS;
+
+	Probe probe;
+	probe.poll = std::move(poll);
+	probe.interval = intervalMs;
+	probe.next = 0;
+	probes.push_back(std::move(probe));
+}
+
+bool DeviceWatcher::Start()
+{
+	if (Active() || probes.empty())
+		return true;
+
+	if (!stopEvent) {
+		Error(L"DeviceWatcher: Failed to create stop event");
+		return false;
+	}
+
+	ResetEvent(stopEvent);
+
+	ULONGLONG now = GetTickCount64();
+	for (Probe &probe : probes)
+		probe.next = now + probe.interval;
+
+	thread = std::thread(&DeviceWatcher::WatchThread, this);
+	return true;
+}
+
+void DeviceWatcher::Stop()
+{
+	if (thread.joinable()) {
+		SetEvent(stopEvent);
+		thread.join();
+	}
+
+	probes.clear();
+}
+
+void DeviceWatcher::WatchThread()
+{
+	HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+	for (;;) {
+		ULONGLONG now = GetTickCount64();
+		ULONGLONG next = now + INFINITE;
+
+		for (Probe &probe : probes) {
+			if (now >= probe.next) {
+				probe.poll();
+				probe.next = now + probe.interval;
+			}
+
+			if (probe.next < next)
+				next = probe.next;
+		}
+
+		now = GetTickCount64();
+		DWORD wait = next > now ? (DWORD)(next - now) : 0;
+		if (WaitForSingleObject(stopEvent, wait) == WAIT_OBJECT_0)
+			break;
+	}
+
+	if (SUCCEEDED(hr))
+		CoUninitialize();
+}
+
+}; /* namespace DShow */
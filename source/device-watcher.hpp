@@ -0,0 +1,66 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "dshow-base.hpp"
+
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace DShow {
+
+/*
+ * Polls device properties on a background thread so that driver round trips
+ * (KS property reads, camera control queries) never happen on the streaming
+ * thread.  Probes publish their results through atomics which the receive
+ * path reads.
+ */
+class DeviceWatcher {
+public:
+	typedef std::function<void()> ProbeProc;
+
+private:
+	struct Probe {
+		ProbeProc poll;
+		ULONGLONG interval;
+		ULONGLONG next;
+	};
+
+	std::vector<Probe> probes;
+	std::thread thread;
+	HANDLE stopEvent = nullptr;
+
+	void WatchThread();
+
+public:
+	DeviceWatcher();
+	~DeviceWatcher();
+
+	/** Probes can only be added while the watcher is stopped */
+	void AddProbe(unsigned long intervalMs, ProbeProc poll);
+
+	bool Start();
+	void Stop();
+
+	inline bool Active() const { return thread.joinable(); }
+};
+
+}; /* namespace DShow */
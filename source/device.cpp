@@ -18,6 +18,7 @@
  */
 
 #include "device.hpp"
+#include "frame-hash.hpp"
 #include "dshow-device-defs.hpp"
 #include "dshow-media-type.hpp"
 #include "dshow-formats.hpp"
@@ -36,13 +37,28 @@ extern void SetVendorTonemapperUsage(IBaseFilter *filter, bool enable);
 
 bool SetRocketEnabled(IBaseFilter *encoder, bool enable);
 
-HDevice::HDevice() : initialized(false), active(false) {}
+HDevice::HDevice()
+	: initialized(false),
+	  active(false),
+	  videoFramePool(std::make_shared<FramePool>()),
+	  audioFramePool(std::make_shared<FramePool>()),
+	  videoSinks(std::make_shared<SinkList>()),
+	  audioSinks(std::make_shared<SinkList>())
+{
+	/* spread the devices over the shared workers */
+	static std::atomic<unsigned> nextAffinity{0};
+	videoConverter.SetAffinity(nextAffinity++);
+
+	PublishConfig();
+}
 
 HDevice::~HDevice()
 {
 	if (active)
 		Stop();
 
+	RemoveAllSinks();
+
 	DisconnectFilters();
 
 	/*
@@ -99,19 +115,458 @@ void HDevice::ReleaseAccess()
 	access_mutex.unlock();
 }
 
-inline void HDevice::SendToCallback(bool video, unsigned char *data,
-				    size_t size, long long startTime,
-				    long long stopTime, long rotation)
+void HDevice::PublishConfig()
+{
+	std::shared_ptr<ConfigSnapshot> config =
+		std::make_shared<ConfigSnapshot>();
+	config->video = videoConfig;
+	config->audio = audioConfig;
+	config->videoSinks = videoSinks;
+	config->audioSinks = audioSinks;
+
+	snapshot.Publish(config);
+}
+
+inline void HDevice::SendToCallback(const ConfigSnapshot &config, bool video,
+				    unsigned char *data, size_t size,
+				    long long startTime, long long stopTime,
+				    long rotation, long long synthHostTime)
 {
 	if (!size)
 		return;
+	if (video ? !config.video.callback : !config.audio.callback)
+		return;
+
+	DeliveryTimer timer(video ? videoStats : audioStats,
+			    DeliveryLatency(video, startTime, synthHostTime));
 
 	if (video)
-		videoConfig.callback(videoConfig, data, size, startTime,
-				     stopTime, rotation);
+		config.video.callback(config.video, data, size, startTime,
+				      stopTime, rotation);
 	else
-		audioConfig.callback(audioConfig, data, size, startTime,
-				     stopTime);
+		config.audio.callback(config.audio, data, size, startTime,
+				      stopTime);
+}
+
+void HDevice::DeliverFrame(const ConfigSnapshot &config, bool video,
+			   QueuedFrame &frame)
+{
+	if (!frame.segments.empty()) {
+		const FrameRef *segments = frame.segments.data();
+		size_t count = frame.segments.size();
+		long long startTime = segments[0].StartTime();
+		long long stopTime = segments[0].StopTime();
+
+		DeliveryTimer timer(video ? videoStats : audioStats,
+				    DeliveryLatency(video, startTime, 0));
+
+		if (video)
+			config.video.segmentCallback(config.video, segments,
+						     count, startTime,
+						     stopTime);
+		else
+			config.audio.segmentCallback(config.audio, segments,
+						     count, startTime,
+						     stopTime);
+
+	} else if (video && config.video.frameCallback) {
+		DeliveryTimer timer(videoStats,
+				    DeliveryLatency(true, frame.frame));
+
+		config.video.frameCallback(config.video, frame.frame,
+					   frame.rotation);
+	} else {
+		SendToCallback(config, video, frame.frame.Data(),
+			       frame.frame.Size(), frame.frame.StartTime(),
+			       frame.frame.StopTime(), frame.rotation,
+			       frame.frame.Synthesized()
+				       ? frame.frame.HostStartTime()
+				       : 0);
+	}
+}
+
+/* sink whose callback the current thread is in, so that a sink removing
+ * itself isn't waited for */
+static thread_local const FrameSink *deliveringSink = nullptr;
+
+void HDevice::DeliverToSink(const ConfigSnapshot &config, FrameSink &sink,
+			    const QueuedFrame &frame)
+{
+	const FrameSink *prevSink = deliveringSink;
+	deliveringSink = &sink;
+
+	if (sink.videoCallback)
+		sink.videoCallback(config.video, frame.frame, frame.rotation);
+	else
+		sink.audioCallback(config.audio, frame.frame);
+
+	deliveringSink = prevSink;
+}
+
+void HDevice::SendToSinks(const ConfigSnapshot &config, bool video,
+			  const QueuedFrame &frame)
+{
+	const SinkList &sinks = video ? *config.videoSinks : *config.audioSinks;
+	if (sinks.empty() || !frame.frame.Size())
+		return;
+
+	long long startTime = frame.frame.StartTime();
+	long long sourceInterval = video ? config.video.frameInterval : 0;
+
+	for (const std::shared_ptr<FrameSink> &sink : sinks) {
+		if (!sink->decimator.Accept(startTime, sink->interval,
+					    sourceInterval))
+			continue;
+
+		if (!sink->Enter())
+			continue;
+
+		if (sink->queue.Active()) {
+			/* the queue takes its own reference to the frame */
+			QueuedFrame copy;
+			copy.frame = frame.frame;
+			copy.rotation = frame.rotation;
+			sink->queue.Push(copy);
+		} else {
+			DeliverToSink(config, *sink, frame);
+		}
+
+		sink->Leave();
+	}
+}
+
+inline void HDevice::SendFrameToCallback(const ConfigSnapshot &config,
+					 bool video, QueuedFrame &frame)
+{
+	DeliveryQueue &queue = video ? videoQueue : audioQueue;
+
+	/* sinks go first, pushing to the main queue takes the frame */
+	SendToSinks(config, video, frame);
+
+	if (aligner.Active() && frame.frame.Size()) {
+		if (video)
+			aligner.PushVideo(frame);
+		else
+			aligner.PushAudio(frame.frame);
+	}
+
+	if (queue.Active())
+		queue.Push(frame);
+	else if (frame.frame.Size() || !frame.segments.empty())
+		DeliverFrame(config, video, frame);
+}
+
+static inline bool HasCallback(const VideoConfig &config)
+{
+	return config.callback || config.frameCallback ||
+	       config.segmentCallback;
+}
+
+static inline bool HasCallback(const AudioConfig &config)
+{
+	return config.callback || config.segmentCallback;
+}
+
+int HDevice::AddSink(bool video, const VideoSinkConfig *videoSink,
+		     const AudioSinkConfig *audioSink)
+{
+	std::shared_ptr<FrameSink> sink = std::make_shared<FrameSink>();
+
+	if (video) {
+		sink->videoCallback = videoSink->callback;
+		sink->queueConfig = videoSink->queue;
+		sink->interval = videoSink->frameInterval;
+	} else {
+		sink->audioCallback = audioSink->callback;
+		sink->queueConfig = audioSink->queue;
+	}
+
+	if (video ? !sink->videoCallback : !sink->audioCallback) {
+		Error(L"AddSink: No callback specified");
+		return 0;
+	}
+
+	if (sink->queueConfig.pull) {
+		Error(L"AddSink: Pull mode is not supported for sinks");
+		return 0;
+	}
+
+	if (sink->queueConfig.depth > 0) {
+		FrameSink *ptr = sink.get();
+		DeliveryQueue::DeliverProc deliver = [this,
+						      ptr](QueuedFrame &f) {
+			if (ptr->Enter()) {
+				DeliverToSink(*GetConfig(), *ptr, f);
+				ptr->Leave();
+			}
+		};
+
+		if (!sink->queue.Start(sink->queueConfig, deliver)) {
+			Error(L"AddSink: Failed to start delivery queue");
+			return 0;
+		}
+	}
+
+	ReapSinks();
+
+	std::lock_guard<std::mutex> lock(configMutex);
+
+	std::shared_ptr<const SinkList> &list = video ? videoSinks
+						      : audioSinks;
+	std::shared_ptr<SinkList> newList = std::make_shared<SinkList>(*list);
+
+	sink->id = nextSinkId++;
+	newList->push_back(sink);
+	list = newList;
+
+	PublishConfig();
+	return sink->id;
+}
+
+bool HDevice::RemoveSink(int id)
+{
+	std::shared_ptr<FrameSink> sink;
+
+	{
+		std::lock_guard<std::mutex> lock(configMutex);
+
+		for (std::shared_ptr<const SinkList> *list :
+		     {&videoSinks, &audioSinks}) {
+			std::shared_ptr<SinkList> newList =
+				std::make_shared<SinkList>();
+
+			for (const std::shared_ptr<FrameSink> &entry : **list) {
+				if (entry->id == id)
+					sink = entry;
+				else
+					newList->push_back(entry);
+			}
+
+			if (sink) {
+				*list = newList;
+				break;
+			}
+		}
+
+		if (!sink)
+			return false;
+
+		PublishConfig();
+	}
+
+	/* the streaming thread may still be holding the old list */
+	bool self = deliveringSink == sink.get();
+	sink->Remove(self ? 1 : 0);
+
+	/* a sink removing itself from its own delivery thread can't join
+	 * that thread, it's stopped later from another thread instead */
+	if (self) {
+		std::lock_guard<std::mutex> lock(configMutex);
+		retiredSinks.push_back(sink);
+	} else {
+		StopSinkQueue(*sink);
+	}
+
+	ReapSinks();
+	return true;
+}
+
+void HDevice::StopSinkQueue(FrameSink &sink)
+{
+	sink.queue.Stop();
+
+	std::atomic<long long> &drops = sink.videoCallback
+						? removedVideoSinkDrops
+						: removedAudioSinkDrops;
+	drops += sink.queue.Dropped();
+}
+
+long long HDevice::GetSinkQueueDrops(bool video)
+{
+	std::lock_guard<std::mutex> lock(configMutex);
+	long long drops = video ? removedVideoSinkDrops : removedAudioSinkDrops;
+
+	for (const std::shared_ptr<FrameSink> &sink :
+	     video ? *videoSinks : *audioSinks)
+		drops += sink->queue.Dropped();
+
+	for (const std::shared_ptr<FrameSink> &sink : retiredSinks)
+		if (!!sink->videoCallback == video)
+			drops += sink->queue.Dropped();
+
+	return drops;
+}
+
+void HDevice::ReapSinks()
+{
+	std::vector<std::shared_ptr<FrameSink>> reaped;
+
+	{
+		std::lock_guard<std::mutex> lock(configMutex);
+
+		for (size_t i = retiredSinks.size(); i > 0; i--) {
+			std::shared_ptr<FrameSink> &sink = retiredSinks[i - 1];
+			if (sink.get() == deliveringSink)
+				continue;
+
+			reaped.push_back(std::move(sink));
+			retiredSinks.erase(retiredSinks.begin() + (i - 1));
+		}
+	}
+
+	for (const std::shared_ptr<FrameSink> &sink : reaped)
+		StopSinkQueue(*sink);
+}
+
+void HDevice::RemoveAllSinks()
+{
+	std::shared_ptr<const SinkList> video, audio;
+
+	{
+		std::lock_guard<std::mutex> lock(configMutex);
+		video = videoSinks;
+		audio = audioSinks;
+	}
+
+	for (const std::shared_ptr<const SinkList> &list : {video, audio})
+		for (const std::shared_ptr<FrameSink> &sink : *list)
+			RemoveSink(sink->id);
+
+	ReapSinks();
+}
+
+void HDevice::SendEncodedToCallback(const ConfigSnapshot &config, bool video,
+				    EncodedData &data, bool useFrames,
+				    long rotation)
+{
+	size_t size = data.Size();
+	if (!size)
+		return;
+
+	data.pool->Observe(size);
+
+	if (!data.segments.empty()) {
+		QueuedFrame frame;
+		frame.segments.swap(data.segments);
+		frame.rotation = rotation;
+		SendFrameToCallback(config, video, frame);
+
+		/* keep the list's capacity around for the next access unit */
+		frame.segments.clear();
+		data.segments.swap(frame.segments);
+
+	} else if (useFrames) {
+		QueuedFrame frame;
+		HFrame *assembled = TakeFrame(std::move(data.bytes),
+					      data.lastStartTime,
+					      data.lastStopTime, data.pool);
+		assembled->hostStartTime = data.lastHostStartTime;
+		assembled->hostStopTime = data.lastHostStopTime;
+
+		frame.frame = FrameRef(assembled);
+		frame.rotation = rotation;
+		SendFrameToCallback(config, video, frame);
+
+		data.bytes = data.pool->Acquire();
+
+	} else {
+		SendToCallback(config, video, data.bytes.data(),
+			       data.bytes.size(), data.lastStartTime,
+			       data.lastStopTime, rotation, 0);
+		data.bytes.clear();
+	}
+}
+
+long long HDevice::DeliveryLatency(bool video, long long startTime,
+				   long long synthHostTime)
+{
+	/* synthesized timestamps aren't on the graph's stream time, measure
+	 * those from their host time instead */
+	if (synthHostTime)
+		return GetStatsTime() - synthHostTime;
+
+	CaptureFilter *capture = video ? videoCapture : audioCapture;
+	REFERENCE_TIME now;
+
+	if (!capture || !capture->GetStreamTime(now))
+		return -1;
+
+	return now - startTime;
+}
+
+long long HDevice::DeliveryLatency(bool video, const FrameRef &frame)
+{
+	return DeliveryLatency(video, frame.StartTime(),
+			       frame.Synthesized() ? frame.HostStartTime()
+						   : 0);
+}
+
+void HDevice::SendAudioChunk(std::vector<unsigned char> &&chunk,
+			     long long startTime, long long stopTime)
+{
+	std::shared_ptr<const ConfigSnapshot> config = GetConfig();
+
+	if (audioQueue.Active() || aligner.Active() ||
+	    !config->audioSinks->empty()) {
+		QueuedFrame frame;
+		frame.frame = FrameRef(SetHostTimes(
+			false, TakeFrame(std::move(chunk), startTime, stopTime,
+					 audioCoalescer.GetPool())));
+		SendFrameToCallback(*config, false, frame);
+	} else {
+		SendToCallback(*config, false, chunk.data(), chunk.size(),
+			       startTime, stopTime, 0, 0);
+		audioCoalescer.GetPool()->Recycle(std::move(chunk));
+	}
+}
+
+void HDevice::MapHostTimes(bool video, long long startTime,
+			   long long stopTime, long long &hostStartTime,
+			   long long &hostStopTime)
+{
+	ClockModel &clock = video ? videoClock : audioClock;
+
+	if (!clock.Valid()) {
+		hostStartTime = 0;
+		hostStopTime = 0;
+		return;
+	}
+
+	hostStartTime = clock.Map(startTime);
+	hostStopTime = hostStartTime + clock.MapDuration(stopTime - startTime);
+}
+
+HFrame *HDevice::SetHostTimes(bool video, HFrame *frame)
+{
+	MapHostTimes(video, frame->startTime, frame->stopTime,
+		     frame->hostStartTime, frame->hostStopTime);
+	return frame;
+}
+
+bool HDevice::IsDuplicateFrame(const VideoConfig &config,
+			       const FrameRef &frame)
+{
+	/* compared against a copy of the previous frame's sampled rows rather
+	 * than the frame itself, which would keep its buffer leased */
+	return lastVideoSignature.Update(frame.Data(), frame.Size(),
+					 config.format, config.cx,
+					 config.cy_abs);
+}
+
+HFrame *HDevice::LeaseSample(bool video, IMediaSample *sample,
+			     unsigned char *data, size_t size,
+			     long long startTime, long long stopTime)
+{
+	CaptureFilter *capture = video ? videoCapture : audioCapture;
+	long buffers = capture->GetPin()->GetAllocatorBuffers();
+
+	return LeaseFrame(video ? videoFramePool : audioFramePool, sample,
+			  data, size, startTime, stopTime, buffers);
+}
+
+static inline long NormalizeRotation(long roll)
+{
+	return (roll % 360 + 360) % 360;
 }
 
 void HDevice::Receive(bool isVideo, IMediaSample *sample)
@@ -119,88 +574,277 @@ void HDevice::Receive(bool isVideo, IMediaSample *sample)
 	BYTE *ptr;
 	MediaTypePtr mt;
 	long roll = 0;
-	bool encoded = isVideo ? ((int)videoConfig.format >= 400)
-			       : ((int)audioConfig.format >= 200);
 
 	if (!sample)
 		return;
 
-	if( !access_mutex.try_lock_shared() )
+	/* configuration is read from an immutable snapshot, so changes to it
+	 * never stall or drop samples here */
+	std::shared_ptr<const ConfigSnapshot> config = GetConfig();
+	const VideoConfig &vc = config->video;
+	const AudioConfig &ac = config->audio;
+
+	bool pulled = isVideo && vc.queue.pull && videoQueue.Active();
+	bool fanout = aligner.Active() ||
+		     (isVideo ? !config->videoSinks->empty()
+			      : !config->audioSinks->empty());
+	if (isVideo ? !HasCallback(vc) && !pulled && !fanout
+		    : !HasCallback(ac) && !fanout)
 		return;
 
-	if (isVideo ? !videoConfig.callback : !audioConfig.callback)
-		return;
+	StreamTelemetry &stats = isVideo ? videoStats : audioStats;
+	long long arrival = stats.Arrived(isVideo ? vc.frameInterval : 0);
 
-	if (reactivatePending)
+	if (reactivatePending) {
+		Count(stats.droppedReactivating);
 		return;
+	}
 
-	/* auto-rotation for devices such as streamcam */
-	if (isVideo && rotatableDevice) {
-		ComQIPtr<IAMCameraControl> cc(videoFilter);
-		if (cc) {
-			long ccf = 0;
-			cc->Get(CameraControl_Roll, &roll, &ccf);
+	/* auto-rotation for devices such as streamcam, the roll value is
+	 * polled by the device watcher */
+	if (isVideo && rotatableDevice)
+		roll = watchedRoll.load(std::memory_order_relaxed);
+
+	/* the HDR signal is polled by the device watcher, never here */
+	if (isVideo && vc.reactivateCallback) {
+		const bool hdr = watchedHdrSignal.load(std::memory_order_relaxed);
+		if (deviceHdrSignal != hdr) {
+			deviceHdrSignal = hdr;
+			vc.reactivateCallback();
+			reactivatePending = true;
+			Count(stats.droppedReactivating);
+			return;
 		}
 	}
 
-	if (isVideo && videoConfig.reactivateCallback) {
-		ComQIPtr<IKsPropertySet> propertySet(videoFilter);
-		if (propertySet) {
-			const bool hdr = IsVendorVideoHDR(propertySet);
-			if (deviceHdrSignal != hdr) {
-				deviceHdrSignal = hdr;
-#ifdef ENABLE_HEVC
-				SetVendorVideoFormat(propertySet, hdr);
-#endif
-				videoConfig.reactivateCallback();
-				reactivatePending = true;
-				return;
+	/* some drivers attach the media type to every sample, so only act on
+	 * it if it actually differs from the current one */
+	if (sample->GetMediaType(&mt) == S_OK) {
+		/* the current type is only replaced by this thread while
+		 * streaming */
+		const MediaType &current = isVideo ? videoMediaType
+						   : audioMediaType;
+
+		if (!SameMediaFormat(*mt, current)) {
+			Count(stats.mediaTypeChanges);
+
+			/* audio buffered in the old format goes out with the
+			 * old config */
+			if (!isVideo)
+				audioCoalescer.Flush();
+
+			{
+				std::lock_guard<std::mutex> lock(configMutex);
+
+				if (isVideo) {
+					videoMediaType = mt;
+					ConvertVideoSettings();
+					ResetVideoConverter();
+				} else {
+					audioMediaType = mt;
+					ConvertAudioSettings();
+					StartCoalescer();
+				}
+
+				PublishConfig();
 			}
+
+			/* consumers are called without configMutex held, so
+			 * they can read the config or change sinks */
+			config = GetConfig();
+
+			if (isVideo && config->video.formatChangeCallback)
+				config->video.formatChangeCallback(
+					config->video);
+			else if (!isVideo && config->audio.formatChangeCallback)
+				config->audio.formatChangeCallback(
+					config->audio);
 		}
 	}
 
-	if (sample->GetMediaType(&mt) == S_OK) {
-		if (isVideo) {
-			videoMediaType = mt;
-			ConvertVideoSettings();
-		} else {
-			audioMediaType = mt;
-			ConvertAudioSettings();
+	/* rotation done by the converter is taken out of what consumers are
+	 * told, and changes of it are handled like format changes */
+	if (isVideo && rotatableDevice && config->video.applyRotation) {
+		long rotation = NormalizeRotation(roll);
+
+		if (rotation != deviceRotation) {
+			{
+				std::lock_guard<std::mutex> lock(configMutex);
+				deviceRotation = rotation;
+				UpdateVideoSize();
+				ResetVideoConverter();
+
+				PublishConfig();
+			}
+
+			config = GetConfig();
+
+			if (config->video.formatChangeCallback)
+				config->video.formatChangeCallback(
+					config->video);
 		}
+
+		if (appliedRotation)
+			roll = 0;
 	}
 
+	bool encoded = isVideo ? ((int)config->video.format >= 400)
+			       : ((int)config->audio.format >= 200);
+
 	int size = sample->GetActualDataLength();
-	if (!size)
+	if (!size) {
+		Count(stats.droppedEmpty);
 		return;
+	}
 
-	if (FAILED(sample->GetPointer(&ptr)))
+	if (FAILED(sample->GetPointer(&ptr))) {
+		Count(stats.droppedBadPointer);
 		return;
+	}
 
-	long long startTime, stopTime;
+	long long startTime = 0, stopTime = 0;
 	bool hasTime = SUCCEEDED(sample->GetTime(&startTime, &stopTime));
 
+	/* if requested, raw video samples without timestamps are given
+	 * generated ones instead of being dropped */
+	bool synthesized = false;
+	if (isVideo && !encoded) {
+		if (hasTime) {
+			videoSynth.Observe(startTime, arrival);
+		} else if (config->video.synthesizeTimestamps) {
+			videoSynth.Synthesize(arrival,
+					      config->video.frameInterval,
+					      startTime, stopTime);
+			hasTime = synthesized = true;
+			Count(stats.synthesized);
+		}
+	}
+
+	if (hasTime && !synthesized)
+		(isVideo ? videoClock : audioClock).Update(startTime, arrival);
+
+	/* drop frames above the requested output rate before anything else
+	 * is done with them */
+	if (isVideo && !encoded && hasTime &&
+	    !videoDecimator.Accept(startTime, config->video.outputInterval,
+				   config->video.frameInterval)) {
+		Count(stats.droppedDecimated);
+		return;
+	}
+
+	/* frames that are queued or held by the consumer must outlive the
+	 * sample's delivery */
+	bool detectDuplicates =
+		isVideo && config->video.duplicateFrames != DuplicateMode::Deliver;
+	bool useFrames = isVideo ? videoQueue.Active() || fanout ||
+					   detectDuplicates ||
+					   !!config->video.frameCallback
+				 : audioQueue.Active() || fanout;
+
 	if (encoded) {
 		EncodedData &data = isVideo ? encodedVideo : encodedAudio;
+		bool segmented = isVideo ? config->video.segmentCallback &&
+						   !pulled
+					 : !!config->audio.segmentCallback;
 
 		/* packets that have time are the first packet in a group of
 		 * segments */
 		if (hasTime) {
-			SendToCallback(isVideo, data.bytes.data(),
-				       data.bytes.size(), data.lastStartTime,
-				       data.lastStopTime, roll);
+			SendEncodedToCallback(*config, isVideo, data, useFrames,
+					      roll);
 
-			data.bytes.resize(0);
 			data.lastStartTime = startTime;
 			data.lastStopTime  = stopTime;
+
+			MapHostTimes(isVideo, startTime, stopTime,
+				     data.lastHostStartTime,
+				     data.lastHostStopTime);
 		}
 
-			data.bytes.insert(data.bytes.end(), (unsigned char *)ptr,
-							  (unsigned char *)ptr + size);
+		if (segmented) {
+			HFrame *segment = LeaseSample(isVideo, sample, ptr, size,
+						      hasTime ? startTime : 0,
+						      hasTime ? stopTime : 0);
+			if (hasTime) {
+				segment->hostStartTime = data.lastHostStartTime;
+				segment->hostStopTime = data.lastHostStopTime;
+			}
+
+			data.segments.emplace_back(segment);
+		} else {
+			if (!data.bytes.capacity())
+				data.bytes = data.pool->Acquire();
+
+			data.bytes.insert(data.bytes.end(), ptr, ptr + size);
+		}
+
+	} else if (!isVideo && audioCoalescer.Active()) {
+		audioCoalescer.Push(ptr, size, hasTime, startTime);
 
 	} else if (hasTime) {
-		SendToCallback(isVideo, ptr, size, startTime, stopTime, roll);
+		bool convert = isVideo && videoConverter.Active();
+
+		if (convert && !useFrames) {
+			FrameRef converted(videoConverter.Convert(
+				ptr, size, startTime, stopTime));
+			if (!converted.Valid()) {
+				Count(stats.droppedConversion);
+				return;
+			}
+
+			SendToCallback(*config, isVideo, converted.Data(),
+				       converted.Size(), startTime, stopTime,
+				       roll, synthesized ? arrival : 0);
+
+		} else if (useFrames) {
+			HFrame *leased =
+				convert ? videoConverter.Convert(ptr, size,
+								 startTime,
+								 stopTime)
+					: LeaseSample(isVideo, sample, ptr,
+						      size, startTime,
+						      stopTime);
+			if (!leased) {
+				Count(stats.droppedConversion);
+				return;
+			}
+
+			if (synthesized) {
+				leased->synthesized = true;
+				leased->hostStartTime =
+					videoSynth.ToArrivalTime(startTime);
+				leased->hostStopTime =
+					videoSynth.ToArrivalTime(stopTime);
+			} else {
+				SetHostTimes(isVideo, leased);
+			}
+
+			QueuedFrame frame;
+			frame.frame = FrameRef(leased);
+			frame.rotation = roll;
+
+			if (detectDuplicates &&
+			    IsDuplicateFrame(config->video, frame.frame)) {
+				Count(stats.duplicates);
+
+				if (config->video.duplicateFrames ==
+				    DuplicateMode::Suppress) {
+					Count(stats.droppedDuplicate);
+					return;
+				}
+
+				leased->duplicate = true;
+			}
+
+			SendFrameToCallback(*config, isVideo, frame);
+		} else {
+			SendToCallback(*config, isVideo, ptr, size, startTime,
+				       stopTime, roll, synthesized ? arrival : 0);
+		}
+
+	} else {
+		Count(stats.droppedNoTimestamp);
 	}
-	access_mutex.unlock_shared();
 }
 
 void HDevice::ConvertVideoSettings()
@@ -211,8 +855,8 @@ void HDevice::ConvertVideoSettings()
 	if (bmih) {
 		Debug(L"Video media type changed");
 
-		videoConfig.cx = bmih->biWidth;
-		videoConfig.cy_abs = labs(bmih->biHeight);
+		captureCX = bmih->biWidth;
+		captureCY = labs(bmih->biHeight);
 		videoConfig.cy_flip = bmih->biHeight < 0;
 		videoConfig.frameInterval = vih->AvgTimePerFrame;
 
@@ -221,9 +865,67 @@ void HDevice::ConvertVideoSettings()
 
 		if (same)
 			videoConfig.format = videoConfig.internalFormat;
+
+		videoConfig.colorMatrix = ColorMatrix::BT709;
+		videoConfig.colorRange = ColorRange::Limited;
+		videoConfig.colorTransfer = ColorTransfer::Unspecified;
+		videoConfig.colorSignaled = GetMediaTypeColorimetry(
+			videoMediaType, videoConfig.colorMatrix,
+			videoConfig.colorRange, videoConfig.colorTransfer);
+
+		/* YUV conversions keep the device's colorimetry, RGB is
+		 * converted with the requested one */
+		if (IsRgb(videoConfig.internalFormat) &&
+		    !IsRgb(videoConfig.format) &&
+		    VideoConverter::Supported(videoConfig.internalFormat,
+					      videoConfig.format)) {
+			videoConfig.colorMatrix = videoConfig.conversionMatrix;
+			videoConfig.colorRange = videoConfig.conversionRange;
+			videoConfig.colorTransfer = ColorTransfer::SRGB;
+			videoConfig.colorSignaled = true;
+		}
+
+		UpdateVideoSize();
 	}
 }
 
+/* consumers only ever see the size after scaling and rotation */
+void HDevice::UpdateVideoSize()
+{
+	const VideoFormat from = videoConfig.internalFormat;
+	const VideoFormat to = videoConfig.format;
+
+	bool scale = requestedCX && requestedCY &&
+		     VideoConverter::Scalable(from, to);
+	int cx = scale ? requestedCX : captureCX;
+	int cy = scale ? requestedCY : captureCY;
+
+	bool rotate = videoConfig.applyRotation && deviceRotation % 90 == 0 &&
+		      (from == to || VideoConverter::Supported(from, to)) &&
+		      VideoConverter::Rotatable(to, cx, cy);
+	appliedRotation = rotate ? deviceRotation : 0;
+
+	bool sideways = appliedRotation == 90 || appliedRotation == 270;
+	videoConfig.cx = sideways ? cy : cx;
+	videoConfig.cy_abs = sideways ? cx : cy;
+}
+
+void HDevice::ResetVideoConverter()
+{
+	const VideoFormat from = videoConfig.internalFormat;
+	const VideoFormat to = videoConfig.format;
+
+	if (videoConverter.Reset(videoConfig, captureCX, captureCY,
+				 appliedRotation))
+		Debug(L"Converting %dx%d video from %d to %dx%d %d", captureCX,
+		      captureCY, (int)from, videoConfig.cx, videoConfig.cy_abs,
+		      (int)to);
+	else if (from != to && to != VideoFormat::Any &&
+		 VideoConverter::Supported(from, to))
+		Warning(L"Could not convert %dx%d video from %d to %d",
+			captureCX, captureCY, (int)from, (int)to);
+}
+
 void HDevice::ConvertAudioSettings()
 {
 	WAVEFORMATEX *wfex =
@@ -303,6 +1005,26 @@ bool HDevice::SetupVideoCapture(IBaseFilter *filter, VideoConfig &config)
 	rotatableDevice = videoConfig.name.find(L"StreamCam") !=
 			  std::string::npos;
 
+	cameraControl.Clear();
+	watchedRoll = 0;
+	if (rotatableDevice) {
+		cameraControl = ComQIPtr<IAMCameraControl>(filter);
+		if (cameraControl) {
+			long roll = 0, flags = 0;
+			if (SUCCEEDED(cameraControl->Get(CameraControl_Roll,
+							 &roll, &flags)))
+				watchedRoll = roll;
+		}
+	}
+	deviceRotation = NormalizeRotation(watchedRoll);
+
+	/* devices that don't offer the requested size get the closest one
+	 * (preferably larger), scaled after capture */
+	const bool scale = !config.useDefaultConfig &&
+			   config.scaling != ScaleMode::None;
+	requestedCX = scale ? config.cx : 0;
+	requestedCY = scale ? config.cy_abs : 0;
+
 	success = GetFilterPin(filter, MEDIATYPE_Video, PIN_CATEGORY_CAPTURE,
 			       PINDIR_OUTPUT, &pin);
 	if (!success) {
@@ -359,9 +1081,15 @@ bool HDevice::SetupVideoCapture(IBaseFilter *filter, VideoConfig &config)
 	PinCaptureInfo info;
 	info.callback = [this](IMediaSample *s) { Receive(true, s); };
 	info.expectedMajorType = videoMediaType->majortype;
+	info.canBlock = config.queue.depth > 0 &&
+			config.queue.overflow == OverflowPolicy::Block;
 
-	/* attempt to force intermediary filters for these types */
-	if (videoConfig.format == VideoFormat::XRGB)
+	/* conversions done here don't need an intermediary filter, for the
+	 * rest attempt to force one */
+	if (VideoConverter::Supported(videoConfig.internalFormat,
+				      videoConfig.format))
+		info.expectedSubType = videoMediaType->subtype;
+	else if (videoConfig.format == VideoFormat::XRGB)
 		info.expectedSubType = MEDIASUBTYPE_RGB32;
 	else if (videoConfig.format == VideoFormat::ARGB)
 		info.expectedSubType = MEDIASUBTYPE_ARGB32;
@@ -397,6 +1125,7 @@ bool HDevice::SetVideoConfig(VideoConfig *config)
 	graph->RemoveFilter(videoCapture);
 	videoFilter.Release();
 	videoCapture.Release();
+	cameraControl.Release();
 
 	if (!config)
 		return true;
@@ -432,11 +1161,17 @@ bool HDevice::SetVideoConfig(VideoConfig *config)
 		deviceHdrSignal = hdr;
 	}
 
+	watchedHdrSignal = deviceHdrSignal;
 	videoConfig = *config;
 
 	if (!SetupVideoCapture(filter, videoConfig))
 		return false;
 
+	{
+		std::lock_guard<std::mutex> lock(configMutex);
+		PublishConfig();
+	}
+
 	*config = videoConfig;
 	return true;
 }
@@ -537,6 +1272,8 @@ bool HDevice::SetupAudioCapture(IBaseFilter *filter, AudioConfig &config)
 	PinCaptureInfo info;
 	info.callback = [this](IMediaSample *s) { Receive(false, s); };
 	info.expectedMajorType = audioMediaType->majortype;
+	info.canBlock = config.queue.depth > 0 &&
+			config.queue.overflow == OverflowPolicy::Block;
 	info.expectedSubType = audioMediaType->subtype;
 
 	audioCapture = new CaptureFilter(info);
@@ -640,11 +1377,21 @@ bool HDevice::SetAudioConfig(AudioConfig *config)
 		if (!SetupAudioCapture(filter, audioConfig))
 			return false;
 
+		{
+			std::lock_guard<std::mutex> lock(configMutex);
+			PublishConfig();
+		}
+
 		*config = audioConfig;
 		return true;
 	}
 
-	return SetupAudioOutput(filter, audioConfig);
+	if (!SetupAudioOutput(filter, audioConfig))
+		return false;
+
+	std::lock_guard<std::mutex> lock(configMutex);
+	PublishConfig();
+	return true;
 }
 
 bool HDevice::CreateGraph()
@@ -815,8 +1562,9 @@ bool HDevice::ConnectFilters()
 				    (videoConfig.name.find(L"Stream Engine") !=
 				     std::string::npos);
 
-		if (!streamEngine && audioCapture != nullptr)
-			SetAudioBuffering(10);
+		if (!streamEngine && audioCapture != nullptr &&
+		    audioConfig.bufferingMs > 0)
+			SetAudioBuffering(audioConfig.bufferingMs);
 
 		success = ConnectPins(PIN_CATEGORY_CAPTURE, MEDIATYPE_Audio,
 				      audioFilter, filter);
@@ -862,9 +1610,31 @@ Result HDevice::Start()
 	if (!!rocketEncoder)
 		Sleep(ROCKET_WAIT_TIME_MS);
 
+	videoStats.Reset();
+	audioStats.Reset();
+	videoClock.Reset();
+	audioClock.Reset();
+	videoSynth.Reset();
+	videoDecimator.Reset();
+	ResetVideoConverter();
+	lastVideoSignature.Reset();
+
+	if (!StartQueues())
+		return Result::Error;
+
+	StartCoalescer();
+
+	if (!StartWatcher()) {
+		StopQueues();
+		return Result::Error;
+	}
+
 	hr = control->Run();
 
 	if (FAILED(hr)) {
+		StopQueues();
+		watcher.Stop();
+
 		if (hr == (HRESULT)0x8007001F) {
 			WarningHR(L"Run failed, device already in use", hr);
 			return Result::InUse;
@@ -882,9 +1652,154 @@ Result HDevice::Start()
 void HDevice::Stop()
 {
 	if (active) {
+		watcher.Stop();
 		control->Stop();
+
+		/* the streaming threads are done, the audio still being
+		 * coalesced goes out like any packet that arrived before
+		 * stopping.  The queues and the aligner deliver what they
+		 * hold before they stop, so this reaches them as well. */
+		audioCoalescer.Flush();
+
+		StopQueues();
+		ReapSinks();
 		active = false;
 	}
 }
 
+bool HDevice::StartQueues()
+{
+	if (videoCapture && videoConfig.queue.depth > 0 &&
+	    (videoConfig.queue.pull || HasCallback(videoConfig))) {
+		DeliveryQueue::DeliverProc deliver;
+		if (!videoConfig.queue.pull)
+			deliver = [this](QueuedFrame &f) {
+				DeliverFrame(*GetConfig(), true, f);
+			};
+
+		if (!videoQueue.Start(videoConfig.queue, deliver)) {
+			Error(L"Failed to start video delivery queue");
+			return false;
+		}
+	}
+
+	if (audioCapture && audioConfig.queue.depth > 0 &&
+	    HasCallback(audioConfig)) {
+		DeliveryQueue::DeliverProc deliver =
+			[this](QueuedFrame &f) {
+				DeliverFrame(*GetConfig(), false, f);
+			};
+
+		if (!audioQueue.Start(audioConfig.queue, deliver)) {
+			Error(L"Failed to start audio delivery queue");
+			videoQueue.Stop();
+			return false;
+		}
+	}
+
+	if (videoCapture && audioCapture && avSyncConfig.callback) {
+		DeliveryQueue::DeliverProc deliver = [this](QueuedFrame &f) {
+			std::shared_ptr<const ConfigSnapshot> config =
+				GetConfig();
+			const FrameRef *audio = f.segments.empty()
+							? nullptr
+							: f.segments.data();
+
+			avSyncConfig.callback(config->video, f.frame,
+					      f.rotation, config->audio, audio,
+					      f.segments.size());
+		};
+
+		long long maxWait = (long long)avSyncConfig.maxWaitMs * 10000;
+		if (!aligner.Start(avSyncConfig.queue, maxWait, deliver)) {
+			Error(L"Failed to start audio/video aligner");
+			videoQueue.Stop();
+			audioQueue.Stop();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void HDevice::StopQueues()
+{
+	videoQueue.Stop();
+	audioQueue.Stop();
+	aligner.Stop();
+}
+
+bool HDevice::SetAVSyncConfig(const AVSyncConfig *config)
+{
+	if (!EnsureInactive(L"SetAVSyncConfig"))
+		return false;
+
+	avSyncConfig = config ? *config : AVSyncConfig();
+	return true;
+}
+
+void HDevice::StartCoalescer()
+{
+	int sampleRate = 0;
+	int blockAlign = 0;
+
+	if (audioCapture && (int)audioConfig.format < 200 &&
+	    audioMediaType->formattype == FORMAT_WaveFormatEx &&
+	    audioMediaType->pbFormat) {
+		WAVEFORMATEX *wfex = reinterpret_cast<WAVEFORMATEX *>(
+			audioMediaType->pbFormat);
+		sampleRate = (int)wfex->nSamplesPerSec;
+		blockAlign = (int)wfex->nBlockAlign;
+	}
+
+	audioCoalescer.Reset(audioConfig.coalesceMs, sampleRate, blockAlign,
+			     [this](std::vector<unsigned char> &&chunk,
+				    long long startTime, long long stopTime) {
+				     SendAudioChunk(std::move(chunk), startTime,
+						    stopTime);
+			     });
+}
+
+bool HDevice::StartWatcher()
+{
+	if (videoFilter && videoConfig.reactivateCallback) {
+		ComPtr<IKsPropertySet> propertySet =
+			ComQIPtr<IKsPropertySet>(videoFilter);
+
+		if (propertySet) {
+			watcher.AddProbe(videoConfig.hdrPollIntervalMs, [=]() {
+				const bool hdr = IsVendorVideoHDR(propertySet);
+				if (watchedHdrSignal != hdr) {
+#ifdef ENABLE_HEVC
+					SetVendorVideoFormat(propertySet, hdr);
+#endif
+					watchedHdrSignal = hdr;
+				}
+			});
+		}
+	}
+
+	if (rotatableDevice && cameraControl) {
+		ComPtr<IAMCameraControl> cc = cameraControl;
+
+		watcher.AddProbe(videoConfig.rotationPollIntervalMs, [=]() {
+			long roll = 0, flags = 0;
+			if (SUCCEEDED(cc->Get(CameraControl_Roll, &roll,
+					      &flags)))
+				watchedRoll = roll;
+		});
+	}
+
+	if (!watcher.Start()) {
+		Error(L"Failed to start device watcher");
+
+		/* drops the probes added above, the next Start adds them
+		 * again */
+		watcher.Stop();
+		return false;
+	}
+
+	return true;
+}
+
 } /* namespace DShow */
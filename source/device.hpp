@@ -21,8 +21,23 @@
 
 #include "../dshowcapture.hpp"
 #include "capture-filter.hpp"
-#include <shared_mutex>
+#include "frame.hpp"
+#include "delivery-queue.hpp"
+#include "device-watcher.hpp"
+#include "stream-stats.hpp"
+#include "audio-coalescer.hpp"
+#include "frame-sink.hpp"
+#include "clock-model.hpp"
+#include "timestamp-synth.hpp"
+#include "av-aligner.hpp"
+#include "frame-decimator.hpp"
+#include "frame-hash.hpp"
+#include "video-convert.hpp"
+#include "snapshot-slot.hpp"
+#include <atomic>
+#include <mutex>
 
+#include <memory>
 #include <string>
 #include <vector>
 using namespace std;
@@ -32,7 +47,21 @@ namespace DShow {
 struct EncodedData {
 	long long lastStartTime = 0;
 	long long lastStopTime = 0;
+	long long lastHostStartTime = 0;
+	long long lastHostStopTime = 0;
 	vector<unsigned char> bytes;
+	vector<FrameRef> segments;
+	std::shared_ptr<BufferPool> pool;
+
+	inline EncodedData() : pool(std::make_shared<BufferPool>()) {}
+
+	inline size_t Size() const
+	{
+		size_t size = bytes.size();
+		for (const FrameRef &segment : segments)
+			size += segment.Size();
+		return size;
+	}
 };
 
 struct EncodedDevice {
@@ -47,6 +76,16 @@ struct EncodedDevice {
 	DWORD samplesPerSec;
 };
 
+/* Immutable copy of the device configuration read by the streaming and
+ * delivery threads.  A new snapshot is published whenever the configuration
+ * changes, and old snapshots are freed once the last reader lets go. */
+struct ConfigSnapshot {
+	VideoConfig video;
+	AudioConfig audio;
+	std::shared_ptr<const SinkList> videoSinks;
+	std::shared_ptr<const SinkList> audioSinks;
+};
+
 struct HDevice {
 	ComPtr<IGraphBuilder> graph;
 	ComPtr<ICaptureGraphBuilder2> builder;
@@ -58,28 +97,85 @@ struct HDevice {
 	ComPtr<CaptureFilter> audioCapture;
 	ComPtr<IBaseFilter> audioOutput;
 	ComPtr<IBaseFilter> rocketEncoder;
+	ComPtr<IAMCameraControl> cameraControl;
 	MediaType videoMediaType;
 	MediaType audioMediaType;
 	VideoConfig videoConfig;
 	AudioConfig audioConfig;
 
+	/* size asked for when scaling, and size actually negotiated */
+	int requestedCX = 0;
+	int requestedCY = 0;
+	int captureCX = 0;
+	int captureCY = 0;
+
+	/* last roll of the device (0-359), and the part of it applied by
+	 * videoConverter */
+	long deviceRotation = 0;
+	long appliedRotation = 0;
+
 	bool encodedDevice = false;
 	bool rotatableDevice = false;
 	bool deviceHdrSignal = false;
-	bool reactivatePending = false;
+	std::atomic<bool> watchedHdrSignal{false};
+	std::atomic<long> watchedRoll{0};
+	std::atomic<bool> reactivatePending{false};
 	bool initialized;
 	bool active;
 
 	EncodedData encodedVideo;
 	EncodedData encodedAudio;
 
-	mutable std::shared_mutex      access_mutex;
+	std::shared_ptr<FramePool> videoFramePool;
+	std::shared_ptr<FramePool> audioFramePool;
+	DeliveryQueue videoQueue;
+	DeliveryQueue audioQueue;
+	AudioCoalescer audioCoalescer;
+
+	/* replaced as a whole under configMutex, never modified in place */
+	std::shared_ptr<const SinkList> videoSinks;
+	std::shared_ptr<const SinkList> audioSinks;
+	int nextSinkId = 1;
+
+	/* sinks that removed themselves, their queues still need stopping */
+	std::vector<std::shared_ptr<FrameSink>> retiredSinks;
+
+	/* queue drops of sinks that are gone */
+	std::atomic<long long> removedVideoSinkDrops{0};
+	std::atomic<long long> removedAudioSinkDrops{0};
+
+	AVSyncConfig avSyncConfig;
+	AVAligner aligner;
+	DeviceWatcher watcher;
+
+	StreamTelemetry videoStats;
+	StreamTelemetry audioStats;
+
+	/* only used by the streaming threads */
+	ClockModel videoClock;
+	ClockModel audioClock;
+	TimestampSynth videoSynth;
+	FrameDecimator videoDecimator;
+	VideoConverter videoConverter;
+
+	/* last distinct frame, for duplicate detection */
+	FrameSignature lastVideoSignature;
+
+	/* only excludes other GetAccess callers, see Device::GetAccess */
+	std::mutex access_mutex;
+
+	/* guards videoConfig/audioConfig against concurrent format changes
+	 * from the video and audio streaming threads */
+	std::mutex configMutex;
+	SnapshotSlot<ConfigSnapshot> snapshot;
 
 	HDevice();
 	~HDevice();
 
 	void ConvertVideoSettings();
+	void UpdateVideoSize();
 	void ConvertAudioSettings();
+	void ResetVideoConverter();
 
 	bool EnsureInitialized(const wchar_t *func);
 	bool EnsureActive(const wchar_t *func);
@@ -87,9 +183,53 @@ struct HDevice {
 	void GetAccess();
 	void ReleaseAccess();
 
-	inline void SendToCallback(bool video, unsigned char *data, size_t size,
+	/* modelled by tests/config-snapshot-stress.cpp, keep it in line */
+	void PublishConfig();
+	inline std::shared_ptr<const ConfigSnapshot> GetConfig() const
+	{
+		return snapshot.Load();
+	}
+
+	inline void SendToCallback(const ConfigSnapshot &config, bool video,
+				   unsigned char *data, size_t size,
 				   long long startTime, long long stopTime,
+				   long rotation, long long synthHostTime);
+	inline void SendFrameToCallback(const ConfigSnapshot &config,
+					bool video, QueuedFrame &frame);
+	void SendEncodedToCallback(const ConfigSnapshot &config, bool video,
+				   EncodedData &data, bool useFrames,
 				   long rotation);
+	void DeliverFrame(const ConfigSnapshot &config, bool video,
+			  QueuedFrame &frame);
+	void DeliverToSink(const ConfigSnapshot &config, FrameSink &sink,
+			   const QueuedFrame &frame);
+	void SendToSinks(const ConfigSnapshot &config, bool video,
+			 const QueuedFrame &frame);
+
+	int AddSink(bool video, const VideoSinkConfig *videoSink,
+		    const AudioSinkConfig *audioSink);
+	bool RemoveSink(int id);
+	void RemoveAllSinks();
+	void ReapSinks();
+	void StopSinkQueue(FrameSink &sink);
+	long long GetSinkQueueDrops(bool video);
+	long long DeliveryLatency(bool video, long long startTime,
+				  long long synthHostTime);
+	long long DeliveryLatency(bool video, const FrameRef &frame);
+	void MapHostTimes(bool video, long long startTime, long long stopTime,
+			  long long &hostStartTime, long long &hostStopTime);
+	HFrame *SetHostTimes(bool video, HFrame *frame);
+	bool IsDuplicateFrame(const VideoConfig &config, const FrameRef &frame);
+	HFrame *LeaseSample(bool video, IMediaSample *sample,
+			    unsigned char *data, size_t size,
+			    long long startTime, long long stopTime);
+	void SendAudioChunk(std::vector<unsigned char> &&chunk,
+			    long long startTime, long long stopTime);
+	bool StartQueues();
+	void StopQueues();
+	bool SetAVSyncConfig(const AVSyncConfig *config);
+	void StartCoalescer();
+	bool StartWatcher();
 
 	void Receive(bool video, IMediaSample *sample);
 
@@ -228,6 +228,8 @@ bool HDevice::SetupEncodedVideoCapture(IBaseFilter *filter, VideoConfig &config,
 	pci.callback = [this](IMediaSample *s) { Receive(true, s); };
 	pci.expectedMajorType = mtVideo->majortype;
 	pci.expectedSubType = mtVideo->subtype;
+	pci.canBlock = config.queue.depth > 0 &&
+		       config.queue.overflow == OverflowPolicy::Block;
 
 	videoCapture = new CaptureFilter(pci);
 	videoFilter = demuxer;
@@ -21,6 +21,7 @@
 #include <mutex>
 #include "dshow-enum.hpp"
 #include "dshow-formats.hpp"
+#include "format-score.hpp"
 #include "log.hpp"
 
 #undef DEFINE_GUID
@@ -122,6 +123,7 @@ static bool Get_FORMAT_VideoInfo_Data(VideoInfo &info, const AM_MEDIA_TYPE &mt,
 		info.granularityCY = 1;
 	}
 
+	info.bandwidth = EstimateCapBandwidth(info);
 	return true;
 }
 
@@ -159,15 +161,20 @@ static bool Get_FORMAT_WaveFormatEx_Data(AudioInfo &info,
 struct ClosestVideoData {
 	VideoConfig &config;
 	MediaType &mt;
-	long long bestVal;
-	bool found;
+	VideoRequest request;
+	VideoScoreWeights weights;
+	VideoSelection selection;
 
 	ClosestVideoData &operator=(ClosestVideoData const &) = delete;
 	ClosestVideoData &operator=(ClosestVideoData &&) = delete;
 
 	inline ClosestVideoData(VideoConfig &config, MediaType &mt)
-		: config(config), mt(mt), bestVal(0), found(false)
+		: config(config), mt(mt)
 	{
+		request.cx = config.cx;
+		request.cy = config.cy_abs;
+		request.frameInterval = config.frameInterval;
+		request.bandwidthBudget = (double)config.bandwidthBudget;
 	}
 };
 
@@ -176,18 +183,6 @@ static inline void ClampToGranularity(LONG &val, int minVal, int granularity)
 	val -= ((val - minVal) % granularity);
 }
 
-static inline int GetFormatRating(VideoFormat format)
-{
-	if (format >= VideoFormat::I420 && format < VideoFormat::YVYU)
-		return 0;
-	else if (format >= VideoFormat::YVYU && format < VideoFormat::MJPEG)
-		return 5;
-	else if (format == VideoFormat::MJPEG)
-		return 10;
-
-	return 15;
-}
-
 static bool ClosestVideoMTCallback(ClosestVideoData &data,
 				   const AM_MEDIA_TYPE &mt, const BYTE *capData)
 {
@@ -208,59 +203,29 @@ static bool ClosestVideoMTCallback(ClosestVideoData &data,
 	    data.config.internalFormat != info.format)
 		return true;
 
-	int xVal = 0;
-	int yVal = 0;
-	int formatVal = 0;
-	long long frameVal = 0;
+	const VideoCandidate candidate = FitVideoCap(
+		info, data.request, CanScale(data.config, info.format));
+	const VideoScore score =
+		ScoreVideoCandidate(data.request, candidate, data.weights);
 
-	if (data.config.cx < info.minCX)
-		xVal = info.minCX - data.config.cx;
-	else if (data.config.cx > info.maxCX)
-		xVal = data.config.cx - info.maxCX;
+	if (data.selection.Consider(candidate, score)) {
+		if (candidate.fitsCX)
+			bmih->biWidth = candidate.cx;
 
-	const int absMinCY = abs(info.minCY);
-	const int absMaxCY = abs(info.maxCY);
-	if (data.config.cy_abs < absMinCY)
-		yVal = absMinCY - data.config.cy_abs;
-	else if (data.config.cy_abs > absMaxCY)
-		yVal = data.config.cy_abs - absMaxCY;
+		if (candidate.fitsCY)
+			bmih->biHeight = data.config.cy_flip ? -candidate.cy
+							     : candidate.cy;
 
-	const long long frameInterval = data.config.frameInterval;
-	if (frameInterval < info.minInterval)
-		frameVal = info.minInterval - frameInterval;
-	else if (frameInterval > info.maxInterval)
-		frameVal = frameInterval - info.maxInterval;
-
-	formatVal = GetFormatRating(info.format);
-
-	long long totalVal = frameVal + yVal + xVal + formatVal;
-
-	if (!data.found || data.bestVal > totalVal) {
-		if (xVal == 0) {
-			bmih->biWidth = data.config.cx;
-			ClampToGranularity(bmih->biWidth, info.minCX,
-					   info.granularityCX);
-		}
-
-		if (yVal == 0) {
-			LONG cy_abs_clamp = data.config.cy_abs;
-			ClampToGranularity(cy_abs_clamp, info.minCY,
-					   info.granularityCY);
-			bmih->biHeight = data.config.cy_flip ? -cy_abs_clamp
-							     : cy_abs_clamp;
-		}
-
-		if (frameVal == 0) {
+		if (candidate.intervalInRange) {
 			// Close enough. Fixes GV-USB2 29.97 FPS setting.
-			if (abs(vih->AvgTimePerFrame - frameInterval) > 1)
-				vih->AvgTimePerFrame = frameInterval;
+			if (abs(vih->AvgTimePerFrame - candidate.frameInterval) >
+			    1)
+				vih->AvgTimePerFrame = candidate.frameInterval;
 		}
 
-		data.found = true;
-		data.bestVal = totalVal;
 		data.mt = copiedMT;
 
-		if (totalVal == 0)
+		if (score.total == 0.0)
 			return false;
 	}
 
@@ -288,7 +253,15 @@ bool GetClosestVideoMediaType(IBaseFilter *filter, VideoConfig &config,
 		return false;
 	}
 
-	return data.found;
+	const VideoSelection &best = data.selection;
+	if (best.found && config.bandwidthBudget > 0 &&
+	    best.score.estimatedBandwidth > (double)config.bandwidthBudget)
+		Warning(L"GetClosestVideoMediaType: No format fits the bandwidth "
+			L"budget of %lld bytes/s, using one with about %lld",
+			config.bandwidthBudget,
+			(long long)best.score.estimatedBandwidth);
+
+	return best.found;
 }
 
 struct ClosestAudioData {
@@ -442,7 +415,8 @@ bool EnumAudioCaps(IPin *pin, vector<AudioInfo> &caps)
 static bool decklinkVideoPresent = false;
 
 static bool EnumDevice(const GUID &type, IMoniker *deviceInfo,
-		       EnumDeviceCallback callback, void *param, bool activate)
+		       EnumDeviceCallback callback, void *param, bool activate,
+		       EnumActivateCallback activateCallback)
 {
 	ComPtr<IPropertyBag> propertyData;
 	ComPtr<IBaseFilter> filter;
@@ -474,6 +448,11 @@ static bool EnumDevice(const GUID &type, IMoniker *deviceInfo,
 
 	hr = propertyData->Read(L"DevicePath", &devicePath, NULL);
 
+	if (activate && activateCallback)
+		activate = activateCallback(param, deviceName.bstrVal,
+					    SUCCEEDED(hr) ? devicePath.bstrVal
+							  : nullptr);
+
 	if (activate) {
 		hr = deviceInfo->BindToObject(NULL, 0, IID_IBaseFilter,
 						(void **)&filter);
@@ -534,7 +513,8 @@ static void CheckForDecklinkVideo(bool activate)
 		    nullptr, activate);
 }
 
-bool EnumDevices(const GUID &type, EnumDeviceCallback callback, void *param, bool activate)
+bool EnumDevices(const GUID &type, EnumDeviceCallback callback, void *param, bool activate,
+		 EnumActivateCallback activateCallback)
 {
 	lock_guard<recursive_mutex> lock(enumMutex);
 	ComPtr<ICreateDevEnum> deviceEnum;
@@ -566,7 +546,8 @@ bool EnumDevices(const GUID &type, EnumDeviceCallback callback, void *param, boo
 
 	if (hr == S_OK) {
 		while (enumMoniker->Next(1, &deviceInfo, &count) == S_OK) {
-			if (!EnumDevice(type, deviceInfo, callback, param, activate))
+			if (!EnumDevice(type, deviceInfo, callback, param,
+					activate, activateCallback))
 				return true;
 		}
 	}
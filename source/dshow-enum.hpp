@@ -41,6 +41,12 @@ typedef bool (*EnumDeviceCallback)(void *param, IBaseFilter *filter,
 				   const wchar_t *deviceName,
 				   const wchar_t *devicePath);
 
-bool EnumDevices(const GUID &type, EnumDeviceCallback callback, void *param, bool activate);
+/* Returns false if the device doesn't need to be bound to its filter after
+ * all, in which case the device callback receives a null filter */
+typedef bool (*EnumActivateCallback)(void *param, const wchar_t *deviceName,
+				     const wchar_t *devicePath);
+
+bool EnumDevices(const GUID &type, EnumDeviceCallback callback, void *param, bool activate,
+		 EnumActivateCallback activateCallback = nullptr);
 
 }; /* namespace DShow */
@@ -78,6 +78,8 @@ DWORD VFormatToFourCC(VideoFormat format)
 		return MAKEFOURCC('Y', '8', '0', '0');
 	case VideoFormat::P010:
 		return MAKEFOURCC('P', '0', '1', '0');
+	case VideoFormat::P016:
+		return MAKEFOURCC('P', '0', '1', '6');
 
 	/* packed YUV formats */
 	case VideoFormat::YVYU:
@@ -112,6 +114,8 @@ GUID VFormatToSubType(VideoFormat format)
 		return MEDIASUBTYPE_ARGB32;
 	case VideoFormat::XRGB:
 		return MEDIASUBTYPE_RGB32;
+	case VideoFormat::RGB24:
+		return MEDIASUBTYPE_RGB24;
 
 	/* planar YUV formats */
 	case VideoFormat::I420:
@@ -155,6 +159,8 @@ WORD VFormatBits(VideoFormat format)
 	case VideoFormat::ARGB:
 	case VideoFormat::XRGB:
 		return 32;
+	case VideoFormat::RGB24:
+		return 24;
 
 	/* planar YUV formats */
 	case VideoFormat::I420:
@@ -163,6 +169,10 @@ WORD VFormatBits(VideoFormat format)
 		return 12;
 	case VideoFormat::Y800:
 		return 8;
+	case VideoFormat::P010:
+	case VideoFormat::I010:
+	case VideoFormat::P016:
+		return 24;
 
 	/* packed YUV formats */
 	case VideoFormat::YVYU:
@@ -181,13 +191,17 @@ WORD VFormatPlanes(VideoFormat format)
 	/* raw formats */
 	case VideoFormat::ARGB:
 	case VideoFormat::XRGB:
+	case VideoFormat::RGB24:
 		return 1;
 
 	/* planar YUV formats */
 	case VideoFormat::I420:
+	case VideoFormat::I010:
 		return 3;
 	case VideoFormat::NV12:
 	case VideoFormat::YV12:
+	case VideoFormat::P010:
+	case VideoFormat::P016:
 		return 2;
 	case VideoFormat::Y800:
 		return 1;
@@ -283,7 +297,7 @@ bool GetMediaTypeVFormat(const AM_MEDIA_TYPE &mt, VideoFormat &format)
 
 	/* raw formats */
 	if (mt.subtype == MEDIASUBTYPE_RGB24)
-		format = VideoFormat::XRGB;
+		format = VideoFormat::RGB24;
 	else if (mt.subtype == MEDIASUBTYPE_RGB32)
 		format = VideoFormat::XRGB;
 	else if (mt.subtype == MEDIASUBTYPE_ARGB32)
@@ -332,4 +346,84 @@ bool GetMediaTypeVFormat(const AM_MEDIA_TYPE &mt, VideoFormat &format)
 	return true;
 }
 
+/*
+ * With AMCONTROL_COLORINFO_PRESENT, the upper 24 bits of dwControlFlags hold
+ * the rest of a DXVA_ExtendedFormat (the lower 8 are the AMCONTROL flags).
+ * Values are the MFNominalRange/MFVideoTransferMatrix/MFVideoTransferFunction
+ * ones, which extend the DXVA2 ones with BT.2020, PQ and HLG.
+ */
+#define EXT_RANGE(flags) (((flags) >> 12) & 0x7)
+#define EXT_MATRIX(flags) (((flags) >> 15) & 0x7)
+#define EXT_TRANSFER(flags) (((flags) >> 27) & 0x1f)
+
+bool GetMediaTypeColorimetry(const AM_MEDIA_TYPE &mt, ColorMatrix &matrix,
+			     ColorRange &range, ColorTransfer &transfer)
+{
+	if (mt.formattype != FORMAT_VideoInfo2 || !mt.pbFormat ||
+	    mt.cbFormat < sizeof(VIDEOINFOHEADER2))
+		return false;
+
+	const VIDEOINFOHEADER2 *vih =
+		reinterpret_cast<const VIDEOINFOHEADER2 *>(mt.pbFormat);
+	const DWORD flags = vih->dwControlFlags;
+	bool found = false;
+
+	if ((flags & AMCONTROL_COLORINFO_PRESENT) == 0)
+		return false;
+
+	switch (EXT_RANGE(flags)) {
+	case 1: /* 0-255 */
+		range = ColorRange::Full;
+		found = true;
+		break;
+	case 2: /* 16-235 */
+		range = ColorRange::Limited;
+		found = true;
+		break;
+	}
+
+	switch (EXT_MATRIX(flags)) {
+	case 1:
+		matrix = ColorMatrix::BT709;
+		found = true;
+		break;
+	case 2:
+		matrix = ColorMatrix::BT601;
+		found = true;
+		break;
+	case 4: /* 10-bit */
+	case 5: /* 12-bit */
+		matrix = ColorMatrix::BT2020;
+		found = true;
+		break;
+	}
+
+	switch (EXT_TRANSFER(flags)) {
+	case 1: /* 1.0 */
+		transfer = ColorTransfer::Linear;
+		found = true;
+		break;
+	case 5:  /* 709 */
+	case 12: /* 2020 constant luminance */
+	case 13: /* 2020 */
+		transfer = ColorTransfer::BT709;
+		found = true;
+		break;
+	case 7:
+		transfer = ColorTransfer::SRGB;
+		found = true;
+		break;
+	case 15: /* ST 2084 */
+		transfer = ColorTransfer::PQ;
+		found = true;
+		break;
+	case 16:
+		transfer = ColorTransfer::HLG;
+		found = true;
+		break;
+	}
+
+	return found;
+}
+
 }; /* namespace DShow */
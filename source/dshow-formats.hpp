@@ -34,4 +34,10 @@ GUID VFormatToSubType(VideoFormat format);
 
 bool GetMediaTypeVFormat(const AM_MEDIA_TYPE &mt, VideoFormat &format);
 
+/* Returns false if the media type doesn't signal its colorimetry, in which
+ * case the outputs are left alone.  Values it doesn't signal (or that have
+ * no equivalent) are left alone too. */
+bool GetMediaTypeColorimetry(const AM_MEDIA_TYPE &mt, ColorMatrix &matrix,
+			     ColorRange &range, ColorTransfer &transfer);
+
 }; /*namespace DShow */
@@ -77,6 +77,121 @@ BITMAPINFOHEADER *GetBitmapInfoHeader(AM_MEDIA_TYPE &mt)
 	return NULL;
 }
 
+/* some drivers report a frame interval that wobbles by a few units from
+ * sample to sample, only a larger difference is a real rate change */
+#define INTERVAL_TOLERANCE_DIV 1000
+
+static inline bool SameInterval(REFERENCE_TIME a, REFERENCE_TIME b)
+{
+	REFERENCE_TIME diff = a > b ? a - b : b - a;
+	REFERENCE_TIME larger = a > b ? a : b;
+	return diff * INTERVAL_TOLERANCE_DIV <= larger;
+}
+
+static bool SameVideoFormat(const AM_MEDIA_TYPE &a, const AM_MEDIA_TYPE &b)
+{
+	/* VIDEOINFOHEADER2 starts out like VIDEOINFOHEADER, bit rates and
+	 * source/target rects are ignored */
+	const VIDEOINFOHEADER *vihA =
+		reinterpret_cast<const VIDEOINFOHEADER *>(a.pbFormat);
+	const VIDEOINFOHEADER *vihB =
+		reinterpret_cast<const VIDEOINFOHEADER *>(b.pbFormat);
+	const BITMAPINFOHEADER *bmihA = GetBitmapInfoHeader(a);
+	const BITMAPINFOHEADER *bmihB = GetBitmapInfoHeader(b);
+
+	if (bmihA->biWidth != bmihB->biWidth ||
+	    bmihA->biHeight != bmihB->biHeight ||
+	    bmihA->biCompression != bmihB->biCompression ||
+	    bmihA->biBitCount != bmihB->biBitCount)
+		return false;
+
+	if (!SameInterval(vihA->AvgTimePerFrame, vihB->AvgTimePerFrame))
+		return false;
+
+	if (a.formattype == FORMAT_VideoInfo2) {
+		const VIDEOINFOHEADER2 *vih2A =
+			reinterpret_cast<const VIDEOINFOHEADER2 *>(a.pbFormat);
+		const VIDEOINFOHEADER2 *vih2B =
+			reinterpret_cast<const VIDEOINFOHEADER2 *>(b.pbFormat);
+
+		/* the control flags carry the colorimetry */
+		if (vih2A->dwInterlaceFlags != vih2B->dwInterlaceFlags ||
+		    vih2A->dwControlFlags != vih2B->dwControlFlags)
+			return false;
+	}
+
+	return true;
+}
+
+static bool SameAudioFormat(const AM_MEDIA_TYPE &a, const AM_MEDIA_TYPE &b)
+{
+	const WAVEFORMATEX *wfexA =
+		reinterpret_cast<const WAVEFORMATEX *>(a.pbFormat);
+	const WAVEFORMATEX *wfexB =
+		reinterpret_cast<const WAVEFORMATEX *>(b.pbFormat);
+
+	/* nAvgBytesPerSec is ignored, encoded formats may vary it */
+	if (wfexA->wFormatTag != wfexB->wFormatTag ||
+	    wfexA->nChannels != wfexB->nChannels ||
+	    wfexA->nSamplesPerSec != wfexB->nSamplesPerSec ||
+	    wfexA->nBlockAlign != wfexB->nBlockAlign ||
+	    wfexA->wBitsPerSample != wfexB->wBitsPerSample)
+		return false;
+
+	if (wfexA->wFormatTag == WAVE_FORMAT_EXTENSIBLE &&
+	    a.cbFormat >= sizeof(WAVEFORMATEXTENSIBLE) &&
+	    b.cbFormat >= sizeof(WAVEFORMATEXTENSIBLE)) {
+		const WAVEFORMATEXTENSIBLE *extA =
+			reinterpret_cast<const WAVEFORMATEXTENSIBLE *>(
+				a.pbFormat);
+		const WAVEFORMATEXTENSIBLE *extB =
+			reinterpret_cast<const WAVEFORMATEXTENSIBLE *>(
+				b.pbFormat);
+
+		if (extA->SubFormat != extB->SubFormat ||
+		    extA->dwChannelMask != extB->dwChannelMask)
+			return false;
+	}
+
+	return true;
+}
+
+static inline bool HasFormat(const AM_MEDIA_TYPE &mt, size_t size)
+{
+	return mt.pbFormat && mt.cbFormat >= size;
+}
+
+bool SameMediaFormat(const AM_MEDIA_TYPE &a, const AM_MEDIA_TYPE &b)
+{
+	if (a.majortype != b.majortype || a.subtype != b.subtype ||
+	    a.formattype != b.formattype)
+		return false;
+
+	if (a.formattype == FORMAT_VideoInfo &&
+	    HasFormat(a, sizeof(VIDEOINFOHEADER)) &&
+	    HasFormat(b, sizeof(VIDEOINFOHEADER)))
+		return SameVideoFormat(a, b);
+
+	if (a.formattype == FORMAT_VideoInfo2 &&
+	    HasFormat(a, sizeof(VIDEOINFOHEADER2)) &&
+	    HasFormat(b, sizeof(VIDEOINFOHEADER2)))
+		return SameVideoFormat(a, b);
+
+	if (a.formattype == FORMAT_WaveFormatEx &&
+	    HasFormat(a, sizeof(WAVEFORMATEX)) &&
+	    HasFormat(b, sizeof(WAVEFORMATEX)))
+		return SameAudioFormat(a, b);
+
+	/* anything else has to match exactly */
+	if (a.cbFormat != b.cbFormat)
+		return false;
+	if (!a.cbFormat)
+		return true;
+
+	return a.pbFormat && b.pbFormat &&
+	       memcmp(a.pbFormat, b.pbFormat, a.cbFormat) == 0;
+}
+
 const BITMAPINFOHEADER *GetBitmapInfoHeader(const AM_MEDIA_TYPE &mt)
 {
 	if (mt.formattype == FORMAT_VideoInfo) {
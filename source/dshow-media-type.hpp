@@ -29,6 +29,14 @@ void FreeMediaType(AM_MEDIA_TYPE &mt);
 BITMAPINFOHEADER *GetBitmapInfoHeader(AM_MEDIA_TYPE &mt);
 const BITMAPINFOHEADER *GetBitmapInfoHeader(const AM_MEDIA_TYPE &mt);
 
+/**
+ * Whether a media type attached to a sample describes the same format as the
+ * current one.  Only the fields the device configuration is derived from are
+ * compared for video and audio, so bit rates, source/target rects and small
+ * frame interval jitter don't count as a change.
+ */
+bool SameMediaFormat(const AM_MEDIA_TYPE &a, const AM_MEDIA_TYPE &b);
+
 class MediaTypePtr;
 
 class MediaType {
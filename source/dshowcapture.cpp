@@ -23,8 +23,13 @@
 #include "dshow-dialogbox.hpp"
 #include "device.hpp"
 #include "dshow-device-defs.hpp"
+#include "caps-cache.hpp"
+#include "format-score.hpp"
 #include "log.hpp"
 
+#include <atomic>
+#include <memory>
+#include <thread>
 #include <vector>
 
 namespace DShow {
@@ -111,7 +116,7 @@ bool Device::GetVideoConfig(VideoConfig &config) const
 	if (context->videoCapture == NULL)
 		return false;
 
-	config = context->videoConfig;
+	config = context->GetConfig()->video;
 	return true;
 }
 
@@ -120,7 +125,7 @@ bool Device::GetAudioConfig(AudioConfig &config) const
 	if (context->audioCapture == NULL)
 		return false;
 
-	config = context->audioConfig;
+	config = context->GetConfig()->audio;
 	return true;
 }
 
@@ -142,6 +147,83 @@ bool Device::GetAudioDeviceId(DeviceId &id) const
 	return true;
 }
 
+bool Device::ReadVideoFrame(FrameRef &frame, unsigned long timeoutMs,
+			    long *rotation)
+{
+	QueuedFrame queued;
+
+	if (!context->videoConfig.queue.pull)
+		return false;
+	if (!context->videoQueue.Pop(queued, timeoutMs))
+		return false;
+
+	frame = std::move(queued.frame);
+	if (rotation)
+		*rotation = queued.rotation;
+	return true;
+}
+
+bool Device::GetVideoQueueStats(QueueStats &stats) const
+{
+	if (context->videoConfig.queue.depth <= 0)
+		return false;
+
+	context->videoQueue.GetStats(stats);
+	return true;
+}
+
+bool Device::GetAudioQueueStats(QueueStats &stats) const
+{
+	if (context->audioConfig.queue.depth <= 0)
+		return false;
+
+	context->audioQueue.GetStats(stats);
+	return true;
+}
+
+static void AddQueueDrops(StreamStats &stats, const DeliveryQueue &queue)
+{
+	QueueStats queueStats;
+	queue.GetStats(queueStats);
+
+	stats.droppedQueue = queueStats.droppedOldest +
+			     queueStats.droppedNewest +
+			     queueStats.droppedTimeout +
+			     queueStats.droppedStop;
+}
+
+int Device::AddVideoSink(const VideoSinkConfig &config)
+{
+	return context->AddSink(true, &config, nullptr);
+}
+
+int Device::AddAudioSink(const AudioSinkConfig &config)
+{
+	return context->AddSink(false, nullptr, &config);
+}
+
+bool Device::RemoveSink(int id)
+{
+	return context->RemoveSink(id);
+}
+
+bool Device::SetAVSyncConfig(const AVSyncConfig *config)
+{
+	return context->SetAVSyncConfig(config);
+}
+
+void Device::GetStats(CaptureStats &stats) const
+{
+	context->videoStats.Get(stats.video);
+	context->audioStats.Get(stats.audio);
+
+	AddQueueDrops(stats.video, context->videoQueue);
+	AddQueueDrops(stats.audio, context->audioQueue);
+
+	stats.video.droppedSinkQueues = context->GetSinkQueueDrops(true);
+	stats.audio.droppedSinkQueues = context->GetSinkQueueDrops(false);
+}
+
 void Device::OpenDialog(void *hwnd, DialogType type) const
 {
 	ComPtr<IUnknown> ptr;
@@ -227,6 +309,7 @@ static void EnumEncodedVideo(std::vector<VideoDevice> &devices,
 	caps.granularityCX = caps.granularityCY = 1;
 	caps.minInterval = caps.maxInterval = info.frameInterval;
 	caps.format = info.videoFormat;
+	caps.bandwidth = EstimateCapBandwidth(caps);
 
 	device.caps.push_back(caps);
 	devices.push_back(device);
@@ -305,11 +388,177 @@ static bool EnumVideoDevice(std::vector<VideoDevice> &devices,
 	return true;
 }
 
+/* ------------------------------------------------------------------------- */
+
+template<typename T> struct CachedEnumData {
+	typedef bool (*EnumProc)(std::vector<T> &devices, IBaseFilter *filter,
+				 const wchar_t *deviceName,
+				 const wchar_t *devicePath);
+
+	EnumProc enumDevice;
+	std::vector<T> &devices;
+	CapsCache &cache;
+	T cached;
+	bool hit = false;
+
+	/* devices returned from the cache, checked again afterwards */
+	std::vector<T> hits;
+
+	inline CachedEnumData(EnumProc enumDevice, std::vector<T> &devices,
+			      CapsCache &cache)
+		: enumDevice(enumDevice), devices(devices), cache(cache)
+	{
+	}
+};
+
+template<typename T> struct RevalidateData {
+	typename CachedEnumData<T>::EnumProc enumDevice;
+	std::vector<T> cached;
+	std::vector<T> current;
+};
+
+template<typename T>
+static const T *FindDevice(const std::vector<T> &devices,
+			   const wchar_t *devicePath)
+{
+	if (devicePath)
+		for (const T &device : devices)
+			if (_wcsicmp(device.path.c_str(), devicePath) == 0)
+				return &device;
+
+	return nullptr;
+}
+
+template<typename T>
+static bool ActivateUncachedDevice(CachedEnumData<T> &data,
+				   const wchar_t *deviceName,
+				   const wchar_t *devicePath)
+{
+	data.hit = devicePath && data.cache.Find(devicePath, data.cached);
+
+	DSHOW_UNUSED(deviceName);
+	return !data.hit;
+}
+
+template<typename T>
+static bool EnumCachedDevice(CachedEnumData<T> &data, IBaseFilter *filter,
+			     const wchar_t *deviceName,
+			     const wchar_t *devicePath)
+{
+	if (data.hit) {
+		data.hit = false;
+		data.cached.name = deviceName;
+		data.hits.push_back(data.cached);
+		data.devices.push_back(std::move(data.cached));
+		return true;
+	}
+
+	size_t count = data.devices.size();
+	data.enumDevice(data.devices, filter, deviceName, devicePath);
+
+	if (filter && data.devices.size() == count + 1)
+		data.cache.Store(data.devices.back());
+	return true;
+}
+
+template<typename T>
+static bool ActivateCachedDevice(RevalidateData<T> &data,
+				 const wchar_t *deviceName,
+				 const wchar_t *devicePath)
+{
+	DSHOW_UNUSED(deviceName);
+	return FindDevice(data.cached, devicePath) != nullptr;
+}
+
+template<typename T>
+static bool EnumRevalidatedDevice(RevalidateData<T> &data, IBaseFilter *filter,
+				  const wchar_t *deviceName,
+				  const wchar_t *devicePath)
+{
+	if (filter && FindDevice(data.cached, devicePath))
+		data.enumDevice(data.current, filter, deviceName, devicePath);
+	return true;
+}
+
+/* Opens the devices that came from the cache after all, caching and
+ * reporting any that turn out to have changed */
+template<typename T>
+static void RevalidateDevices(const GUID &type,
+			      typename CachedEnumData<T>::EnumProc enumDevice,
+			      std::vector<T> &hits)
+{
+	static std::atomic<bool> active(false);
+
+	/* one that's still running is just as good */
+	if (hits.empty() || active.exchange(true))
+		return;
+
+	std::shared_ptr<RevalidateData<T>> data =
+		std::make_shared<RevalidateData<T>>();
+	data->enumDevice = enumDevice;
+	data->cached = std::move(hits);
+
+	/* detached for the same reason the worker pool is never destroyed,
+	 * the thread only uses its own data and the cache's globals */
+	std::thread([type, data] {
+		HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+		EnumDevices(type, EnumDeviceCallback(EnumRevalidatedDevice<T>),
+			    data.get(), true,
+			    EnumActivateCallback(ActivateCachedDevice<T>));
+
+		std::vector<const T *> changed;
+		CapsCache cache;
+		cache.Open();
+
+		for (const T &device : data->current) {
+			const T *cached =
+				FindDevice(data->cached, device.path.c_str());
+			if (cached && !CapsCache::SameCaps(*cached, device)) {
+				cache.Store(device);
+				changed.push_back(&device);
+			}
+		}
+
+		cache.Close();
+
+		for (const T *device : changed)
+			CapsCache::ReportChanged(*device);
+
+		if (SUCCEEDED(hr))
+			CoUninitialize();
+		active = false;
+	}).detach();
+}
+
+template<typename T>
+static bool EnumDevicesCached(const GUID &type,
+			      typename CachedEnumData<T>::EnumProc enumDevice,
+			      std::vector<T> &devices, bool activate)
+{
+	CapsCache cache;
+
+	if (!activate || !cache.Open())
+		return EnumDevices(type, EnumDeviceCallback(enumDevice),
+				   &devices, activate);
+
+	CachedEnumData<T> data(enumDevice, devices, cache);
+	bool success = EnumDevices(
+		type, EnumDeviceCallback(EnumCachedDevice<T>), &data, true,
+		EnumActivateCallback(ActivateUncachedDevice<T>));
+	cache.Close();
+
+	RevalidateDevices(type, enumDevice, data.hits);
+	return success;
+}
+
+/* ------------------------------------------------------------------------- */
+
 bool Device::EnumVideoDevices(std::vector<VideoDevice> &devices, bool activate)
 {
 	devices.clear();
-	return EnumDevices(CLSID_VideoInputDeviceCategory,
-			   EnumDeviceCallback(EnumVideoDevice), &devices, activate);
+	return EnumDevicesCached(CLSID_VideoInputDeviceCategory,
+				 EnumVideoDevice, devices, activate);
 }
 
 static bool EnumAudioDevice(vector<AudioDevice> &devices, IBaseFilter *filter,
@@ -338,8 +587,8 @@ static bool EnumAudioDevice(vector<AudioDevice> &devices, IBaseFilter *filter,
 bool Device::EnumAudioDevices(vector<AudioDevice> &devices, bool activate)
 {
 	devices.clear();
-	return EnumDevices(CLSID_AudioInputDeviceCategory,
-			   EnumDeviceCallback(EnumAudioDevice), &devices, activate);
+	return EnumDevicesCached(CLSID_AudioInputDeviceCategory,
+				 EnumAudioDevice, devices, activate);
 }
 
 }; /* namespace DShow */
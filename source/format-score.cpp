@@ -0,0 +1,253 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "format-score.hpp"
+#include "video-scale.hpp"
+
+#include <math.h>
+#include <stdlib.h>
+
+/* scaling a larger size down costs far less than delivering the wrong size,
+ * but still prefer the smallest larger size */
+#define SCALE_COST 0.1
+
+/* bandwidth term reaches 1 at this many times the bandwidth of the request
+ * in NV12 */
+#define BANDWIDTH_RANGE_LOG2 3.0
+
+namespace DShow {
+
+/* ------------------------------------------------------------------------- */
+
+static int FitSize(int requested, int minVal, int maxVal, int granularity,
+		   bool scalable, bool &fits, bool &scaled)
+{
+	fits = false;
+	scaled = false;
+
+	if (requested < minVal) {
+		fits = scaled = scalable;
+		return minVal;
+	} else if (requested > maxVal) {
+		return maxVal;
+	}
+
+	if (granularity > 1)
+		requested -= (requested - minVal) % granularity;
+
+	fits = true;
+	return requested;
+}
+
+bool CanScale(VideoFormat from, VideoFormat to)
+{
+	return VideoScaler::Supported(to) &&
+	       (from == to ||
+		GetConvertKernel(from, to, ColorMatrix::BT709,
+				 ColorRange::Limited, CpuLevel::Scalar));
+}
+
+bool CanScale(const VideoConfig &config, VideoFormat format)
+{
+	if (config.scaling == ScaleMode::None)
+		return false;
+
+	VideoFormat output = config.format == VideoFormat::Any ? format
+							       : config.format;
+	return CanScale(format, output);
+}
+
+VideoCandidate FitVideoCap(const VideoInfo &cap, const VideoRequest &request,
+			   bool scalable)
+{
+	VideoCandidate candidate;
+	bool fitsX, fitsY, scaledX, scaledY;
+
+	candidate.format = cap.format;
+	candidate.cx = FitSize(request.cx, cap.minCX, cap.maxCX,
+			       cap.granularityCX, scalable, fitsX, scaledX);
+	candidate.cy = FitSize(request.cy, abs(cap.minCY), abs(cap.maxCY),
+			       cap.granularityCY, scalable, fitsY, scaledY);
+	candidate.fitsCX = fitsX;
+	candidate.fitsCY = fitsY;
+	candidate.scaled = scaledX || scaledY;
+
+	if (request.frameInterval < cap.minInterval) {
+		candidate.frameInterval = cap.minInterval;
+	} else if (request.frameInterval > cap.maxInterval) {
+		candidate.frameInterval = cap.maxInterval;
+	} else {
+		candidate.frameInterval = request.frameInterval;
+		candidate.intervalInRange = true;
+	}
+
+	return candidate;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static double GetBitsPerPixel(VideoFormat format)
+{
+	switch (format) {
+	/* raw formats, as in VFormatBits */
+	case VideoFormat::ARGB:
+	case VideoFormat::XRGB:
+		return 32.0;
+	case VideoFormat::RGB24:
+		return 24.0;
+
+	case VideoFormat::I420:
+	case VideoFormat::NV12:
+	case VideoFormat::YV12:
+		return 12.0;
+	case VideoFormat::Y800:
+		return 8.0;
+	case VideoFormat::P010:
+	case VideoFormat::I010:
+	case VideoFormat::P016:
+		return 24.0;
+
+	case VideoFormat::YVYU:
+	case VideoFormat::YUY2:
+	case VideoFormat::UYVY:
+	case VideoFormat::HDYC:
+		return 16.0;
+
+	/* typical webcam and capture card bitrates */
+	case VideoFormat::MJPEG:
+		return 2.0;
+	case VideoFormat::H264:
+	case VideoFormat::HEVC:
+		return 0.2;
+
+	default:
+		return 32.0;
+	}
+}
+
+double EstimateVideoBandwidth(VideoFormat format, int cx, int cy,
+			      long long frameInterval)
+{
+	if (frameInterval <= 0)
+		return 0.0;
+
+	double frameBytes = (double)cx * (double)abs(cy) *
+			    GetBitsPerPixel(format) / 8.0;
+	return frameBytes * 10000000.0 / (double)frameInterval;
+}
+
+long long EstimateCapBandwidth(const VideoInfo &cap)
+{
+	long long interval = cap.minInterval > 0 ? cap.minInterval
+						 : cap.maxInterval;
+	return (long long)EstimateVideoBandwidth(cap.format, cap.maxCX,
+						 cap.maxCY, interval);
+}
+
+/* relative cost of getting frames into a usable state */
+static double GetDecodeCost(VideoFormat format)
+{
+	if (format >= VideoFormat::I420 && format < VideoFormat::YVYU)
+		return 0.0;
+	else if (format >= VideoFormat::YVYU && format < VideoFormat::MJPEG)
+		return 1.0 / 3.0;
+	else if (format == VideoFormat::MJPEG)
+		return 2.0 / 3.0;
+
+	return 1.0;
+}
+
+/* 0 when equal, 1 when twice or half the requested value */
+static inline double GetRatioError(double value, double requested)
+{
+	if (value <= 0.0 || requested <= 0.0)
+		return 0.0;
+
+	double error = fabs(log2(value / requested));
+	return error < 1.0 ? error : 1.0;
+}
+
+static inline double Saturate(double val)
+{
+	return val < 0.0 ? 0.0 : (val > 1.0 ? 1.0 : val);
+}
+
+VideoScore ScoreVideoCandidate(const VideoRequest &request,
+			       const VideoCandidate &candidate,
+			       const VideoScoreWeights &weights)
+{
+	VideoScore score;
+
+	double errorX = GetRatioError(candidate.cx, request.cx);
+	double errorY = GetRatioError(candidate.cy, request.cy);
+	if (candidate.scaled) {
+		errorX *= SCALE_COST;
+		errorY *= SCALE_COST;
+	}
+	score.resolution = (errorX + errorY) * 0.5;
+
+	score.frameRate = GetRatioError((double)candidate.frameInterval,
+					(double)request.frameInterval);
+
+	score.decode = GetDecodeCost(candidate.format);
+
+	/* anything above what the request takes in NV12 */
+	const int refCX = request.cx > 0 ? request.cx : candidate.cx;
+	const int refCY = request.cy > 0 ? request.cy : candidate.cy;
+	const long long refInterval = request.frameInterval > 0
+					      ? request.frameInterval
+					      : candidate.frameInterval;
+	double reference = EstimateVideoBandwidth(VideoFormat::NV12, refCX,
+						  refCY, refInterval);
+	double bandwidth = EstimateVideoBandwidth(
+		candidate.format, candidate.cx, candidate.cy,
+		candidate.frameInterval);
+	if (reference > 0.0 && bandwidth > 0.0)
+		score.bandwidth = Saturate(log2(bandwidth / reference) /
+					   BANDWIDTH_RANGE_LOG2);
+
+	/* 1 at twice the budget */
+	if (request.bandwidthBudget > 0.0 &&
+	    bandwidth > request.bandwidthBudget)
+		score.overBudget =
+			Saturate(log2(bandwidth / request.bandwidthBudget));
+
+	score.estimatedBandwidth = bandwidth;
+
+	score.total = score.resolution * weights.resolution +
+		      score.frameRate * weights.frameRate +
+		      score.decode * weights.decode +
+		      score.bandwidth * weights.bandwidth +
+		      score.overBudget * weights.overBudget;
+	return score;
+}
+
+bool VideoSelection::Consider(const VideoCandidate &newCandidate,
+			      const VideoScore &newScore)
+{
+	if (found && score.total <= newScore.total)
+		return false;
+
+	found = true;
+	candidate = newCandidate;
+	score = newScore;
+	return true;
+}
+
+}; /* namespace DShow */
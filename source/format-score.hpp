@@ -0,0 +1,125 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+
+namespace DShow {
+
+/*
+ * Cost model for picking the video cap closest to a requested config.  Each
+ * term is normalized to [0, 1] before it's weighted, 1 being about as bad as
+ * it gets (twice or half the requested size or frame rate, the most
+ * expensive format to decode), so that no single term drowns out the others
+ * merely because of the units it's measured in.
+ *
+ * Doesn't depend on DirectShow, caps are plain VideoInfos.
+ */
+
+struct VideoRequest {
+	int cx = 0;
+	int cy = 0;
+	long long frameInterval = 0;
+
+	/* bytes per second, 0 if unlimited */
+	double bandwidthBudget = 0.0;
+};
+
+/* What capturing with a cap would actually produce for a request */
+struct VideoCandidate {
+	VideoFormat format = VideoFormat::Any;
+	int cx = 0;
+	int cy = 0;
+	long long frameInterval = 0;
+
+	/* whether cx, cy and the interval can be set on the cap's media
+	 * type, otherwise the cap's own values are captured */
+	bool fitsCX = false;
+	bool fitsCY = false;
+	bool intervalInRange = false;
+
+	/* captured larger and scaled down to the requested size */
+	bool scaled = false;
+};
+
+struct VideoScoreWeights {
+	double resolution = 1.0;
+	double frameRate = 1.0;
+	double decode = 0.25;
+	double bandwidth = 0.25;
+
+	/* the other terms add up to at most 2.5, which this reaches at about
+	 * 1.54 times the budget (1.29 at 1.25 times, 4 at twice the budget).
+	 * A cap further over budget loses to any cap within it, one slightly
+	 * over can still beat a cap with the wrong size and frame rate. */
+	double overBudget = 4.0;
+};
+
+struct VideoScore {
+	double resolution = 0.0;
+	double frameRate = 0.0;
+	double decode = 0.0;
+	double bandwidth = 0.0;
+	double overBudget = 0.0;
+
+	double total = 0.0;
+
+	/* of the candidate, in bytes per second */
+	double estimatedBandwidth = 0.0;
+};
+
+/**
+ * Fits a request into a cap.  If scalable is set, caps that are larger than
+ * the request are captured at their minimum size and scaled down.
+ */
+VideoCandidate FitVideoCap(const VideoInfo &cap, const VideoRequest &request,
+			   bool scalable);
+
+/* Whether frames captured in one format can be converted to another and
+ * scaled, see VideoConfig::scaling */
+bool CanScale(VideoFormat from, VideoFormat to);
+
+/* Whether caps of a format can be captured larger than the requested size
+ * and scaled down to it under config, decided per cap for FitVideoCap */
+bool CanScale(const VideoConfig &config, VideoFormat format);
+
+/* Estimated bytes per second, with typical compression for encoded formats */
+double EstimateVideoBandwidth(VideoFormat format, int cx, int cy,
+			      long long frameInterval);
+
+/* For VideoInfo::bandwidth */
+long long EstimateCapBandwidth(const VideoInfo &cap);
+
+VideoScore ScoreVideoCandidate(const VideoRequest &request,
+			       const VideoCandidate &candidate,
+			       const VideoScoreWeights &weights);
+
+/* Best of the candidates considered so far, earlier ones win ties */
+struct VideoSelection {
+	bool found = false;
+	VideoCandidate candidate;
+	VideoScore score;
+
+	/* returns true if the candidate is now the best one */
+	bool Consider(const VideoCandidate &candidate, const VideoScore &score);
+};
+
+}; /* namespace DShow */
@@ -0,0 +1,52 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "frame-decimator.hpp"
+
+namespace DShow {
+
+bool FrameDecimator::Accept(long long startTime, long long interval,
+			    long long sourceInterval)
+{
+	if (interval <= 0)
+		return true;
+
+	/* frames may arrive up to half a source frame early and still count
+	 * as being on time */
+	long long tolerance = sourceInterval > 0 ? sourceInterval / 2
+						 : interval / 8;
+
+	/* the spacing check stops the schedule from letting two adjacent
+	 * frames through when the source is slightly slower than a multiple
+	 * of the output rate (59.94 -> 30) */
+	if (timed && (startTime + tolerance < nextTime ||
+		      startTime - lastTime < interval - tolerance))
+		return false;
+
+	/* resync after the first frame or a gap in the stream */
+	if (!timed || startTime - nextTime > interval)
+		nextTime = startTime;
+
+	nextTime += interval;
+	lastTime = startTime;
+	timed = true;
+	return true;
+}
+
+}; /* namespace DShow */
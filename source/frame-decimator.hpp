@@ -0,0 +1,47 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+namespace DShow {
+
+/*
+ * Timestamp-based frame rate limiter.  Rather than keeping every Nth frame, a
+ * frame is kept when it reaches the next output time, which keeps rates such
+ * as 59.94 -> 30 or 50 -> 25 evenly paced.  All times are in 100-nanosecond
+ * units.
+ */
+class FrameDecimator {
+	long long nextTime = 0;
+	long long lastTime = 0;
+	bool timed = false;
+
+public:
+	inline void Reset() { timed = false; }
+
+	/**
+	 * Decides whether to keep a frame.  interval is the output interval
+	 * (0 keeps everything), sourceInterval the input's nominal interval,
+	 * or 0 if unknown.
+	 */
+	bool Accept(long long startTime, long long interval,
+		    long long sourceInterval);
+};
+
+}; /* namespace DShow */
@@ -0,0 +1,228 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "frame-hash.hpp"
+
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define HASH_SSE2 1
+#endif
+
+/* number of rows sampled per frame */
+#define SAMPLE_ROWS 64
+
+#define HASH_KEY_LO 0xbe4ba423396cfeb8ULL
+#define HASH_KEY_HI 0x1cad21f72c81017cULL
+#define HASH_PRIME 0x9e3779b185ebca87ULL
+
+namespace DShow {
+
+static inline unsigned long long Mix(unsigned long long h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/*
+ * Multiply-accumulate over 16-byte blocks (the same construction as XXH3's
+ * accumulator), then a scalar tail for the remaining bytes.
+ */
+static unsigned long long HashRow(const unsigned char *data, size_t size,
+				  unsigned long long seed)
+{
+	size_t blocks = size / 16;
+	unsigned long long lanes[2];
+
+#ifdef HASH_SSE2
+	__m128i key = _mm_set_epi64x((long long)(HASH_KEY_HI ^ seed),
+				     (long long)(HASH_KEY_LO + seed));
+	__m128i acc = _mm_setzero_si128();
+
+	for (size_t i = 0; i < blocks; i++) {
+		__m128i block = _mm_loadu_si128((const __m128i *)data + i);
+		__m128i keyed = _mm_xor_si128(block, key);
+		__m128i product =
+			_mm_mul_epu32(keyed, _mm_srli_epi64(keyed, 32));
+		acc = _mm_add_epi64(acc, _mm_add_epi64(block, product));
+	}
+
+	_mm_storeu_si128((__m128i *)lanes, acc);
+#else
+	const unsigned long long keys[2] = {HASH_KEY_LO + seed,
+					    HASH_KEY_HI ^ seed};
+	lanes[0] = lanes[1] = 0;
+
+	for (size_t i = 0; i < blocks; i++) {
+		for (int lane = 0; lane < 2; lane++) {
+			unsigned long long word;
+			memcpy(&word, data + i * 16 + lane * 8, 8);
+
+			unsigned long long keyed = word ^ keys[lane];
+			lanes[lane] += word + (keyed & 0xffffffffULL) *
+						      (keyed >> 32);
+		}
+	}
+#endif
+
+	unsigned long long hash = lanes[0] ^ Mix(lanes[1] + seed);
+	for (size_t i = blocks * 16; i < size; i++)
+		hash = (hash ^ data[i]) * HASH_PRIME;
+
+	return Mix(hash ^ size);
+}
+
+static size_t LumaRowBytes(VideoFormat format, int cx)
+{
+	switch (format) {
+	case VideoFormat::I420:
+	case VideoFormat::NV12:
+	case VideoFormat::YV12:
+	case VideoFormat::Y800:
+		return (size_t)cx;
+	case VideoFormat::P010:
+	case VideoFormat::I010:
+	case VideoFormat::P016:
+	case VideoFormat::YVYU:
+	case VideoFormat::YUY2:
+	case VideoFormat::UYVY:
+	case VideoFormat::HDYC:
+		return (size_t)cx * 2;
+	case VideoFormat::RGB24:
+		return (size_t)cx * 3;
+	case VideoFormat::ARGB:
+	case VideoFormat::XRGB:
+		return (size_t)cx * 4;
+	default:
+		return 0;
+	}
+}
+
+/* rows [0, rows) every step rows, plus the last one */
+struct SampleLayout {
+	size_t rowBytes;
+	size_t rows;
+	size_t step;
+
+	inline size_t Count() const
+	{
+		return (rows + step - 1) / step + ((rows - 1) % step ? 1 : 0);
+	}
+
+	inline size_t Row(size_t i) const
+	{
+		size_t row = i * step;
+		return row < rows ? row : rows - 1;
+	}
+};
+
+static SampleLayout GetSampleLayout(size_t size, VideoFormat format, int cx,
+				    int cy)
+{
+	SampleLayout layout;
+	layout.rowBytes = cx > 0 ? LumaRowBytes(format, cx) : 0;
+	layout.rows = cy > 0 ? (size_t)cy : 0;
+
+	/* unknown layout, sample the buffer as a whole instead */
+	if (!layout.rowBytes || !layout.rows ||
+	    layout.rowBytes * layout.rows > size) {
+		layout.rows = size < SAMPLE_ROWS ? 1 : SAMPLE_ROWS;
+		layout.rowBytes = size / layout.rows;
+	}
+
+	layout.step = layout.rows > SAMPLE_ROWS ? layout.rows / SAMPLE_ROWS
+						: 1;
+	return layout;
+}
+
+/* the last row is always included, which is where bottom-up formats start */
+static unsigned long long Fingerprint(const unsigned char *data, size_t size,
+				      const SampleLayout &layout)
+{
+	unsigned long long hash = HASH_PRIME ^ size;
+
+	for (size_t i = 0; i < layout.Count(); i++) {
+		size_t row = layout.Row(i);
+		hash = Mix(hash + HashRow(data + row * layout.rowBytes,
+					  layout.rowBytes, row));
+	}
+
+	return hash ? hash : 1;
+}
+
+unsigned long long FrameFingerprint(const unsigned char *data, size_t size,
+				    VideoFormat format, int cx, int cy)
+{
+	if (!data || !size)
+		return 0;
+
+	return Fingerprint(data, size, GetSampleLayout(size, format, cx, cy));
+}
+
+/* ------------------------------------------------------------------------- */
+
+bool FrameSignature::Update(const unsigned char *data, size_t size,
+			    VideoFormat format, int cx, int cy)
+{
+	if (!data || !size) {
+		Reset();
+		return false;
+	}
+
+	const SampleLayout layout = GetSampleLayout(size, format, cx, cy);
+	const unsigned long long hash = Fingerprint(data, size, layout);
+	const size_t count = layout.Count();
+
+	bool same = hash == fingerprint && size == frameSize &&
+		    layout.rowBytes * count == sample.size();
+
+	for (size_t i = 0; same && i < count; i++) {
+		const unsigned char *row =
+			data + layout.Row(i) * layout.rowBytes;
+		same = memcmp(row, sample.data() + i * layout.rowBytes,
+			      layout.rowBytes) == 0;
+	}
+
+	if (same)
+		return true;
+
+	fingerprint = hash;
+	frameSize = size;
+	sample.resize(layout.rowBytes * count);
+
+	for (size_t i = 0; i < count; i++)
+		memcpy(sample.data() + i * layout.rowBytes,
+		       data + layout.Row(i) * layout.rowBytes,
+		       layout.rowBytes);
+	return false;
+}
+
+void FrameSignature::Reset()
+{
+	fingerprint = 0;
+	frameSize = 0;
+	sample.clear();
+}
+
+}; /* namespace DShow */
@@ -0,0 +1,61 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+
+#include <stddef.h>
+#include <vector>
+
+namespace DShow {
+
+/**
+ * Fingerprint of a raw video frame, hashed over a sample of its luma rows
+ * (or a sample of the buffer for formats without a known row layout).  Equal
+ * frames always have equal fingerprints; the reverse needs to be confirmed
+ * by comparing the data.
+ */
+unsigned long long FrameFingerprint(const unsigned char *data, size_t size,
+				    VideoFormat format, int cx, int cy);
+
+/**
+ * Fingerprint of the last distinct frame along with a private copy of the
+ * rows it was hashed over, for telling whether a frame repeats the previous
+ * one without holding on to the previous frame (and the buffer it was leased
+ * from).  Only the sampled rows are compared, so a change confined to the
+ * rows in between goes unnoticed.
+ */
+class FrameSignature {
+	unsigned long long fingerprint = 0;
+	size_t frameSize = 0;
+	std::vector<unsigned char> sample;
+
+public:
+	/**
+	 * Returns true if the frame matches the signature, otherwise the
+	 * signature becomes the frame's
+	 */
+	bool Update(const unsigned char *data, size_t size,
+		    VideoFormat format, int cx, int cy);
+
+	void Reset();
+};
+
+}; /* namespace DShow */
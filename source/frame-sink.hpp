@@ -0,0 +1,91 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "delivery-queue.hpp"
+#include "frame-decimator.hpp"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace DShow {
+
+/*
+ * Additional consumer of a stream.  Sinks share the frames given to the main
+ * callback, each with its own delivery queue and frame rate limit.
+ */
+struct FrameSink {
+	int id = 0;
+	VideoFrameProc videoCallback;
+	AudioFrameProc audioCallback;
+	QueueConfig queueConfig;
+	long long interval = 0;
+
+	/* only touched by the streaming thread */
+	FrameDecimator decimator;
+
+	DeliveryQueue queue;
+
+private:
+	/* number of threads handing a frame to the sink.  The callback is
+	 * not called with the mutex held, so that it can remove sinks. */
+	std::mutex mutex;
+	std::condition_variable idle;
+	int busy = 0;
+	bool removed = false;
+
+public:
+	/* returns false once the sink has been removed */
+	inline bool Enter()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (removed)
+			return false;
+
+		busy++;
+		return true;
+	}
+
+	inline void Leave()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		busy--;
+		if (removed)
+			idle.notify_all();
+	}
+
+	/*
+	 * Marks the sink removed and waits until no other thread is handing
+	 * it a frame.  ownCalls is 1 when called from within a delivery to
+	 * the sink itself, which would otherwise wait for itself.
+	 */
+	inline void Remove(int ownCalls)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		removed = true;
+		idle.wait(lock, [&] { return busy <= ownCalls; });
+	}
+};
+
+typedef std::vector<std::shared_ptr<FrameSink>> SinkList;
+
+}; /* namespace DShow */
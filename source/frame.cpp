@@ -0,0 +1,252 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "frame.hpp"
+
+#define MAX_POOLED_BUFFERS 8
+#define MIN_POOLED_BUFFER_SIZE (64 * 1024)
+
+namespace DShow {
+
+std::vector<unsigned char> BufferPool::Acquire()
+{
+	std::vector<unsigned char> buffer;
+	size_t size = learnedSize;
+
+	/* leave headroom so that slightly larger access units (e.g. I-frames
+	 * in a mostly P-frame stream) still fit without reallocating */
+	size += size / 4;
+	if (size < MIN_POOLED_BUFFER_SIZE)
+		size = MIN_POOLED_BUFFER_SIZE;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!buffers.empty()) {
+			buffer = std::move(buffers.back());
+			buffers.pop_back();
+		}
+	}
+
+	buffer.clear();
+	if (buffer.capacity() < size)
+		buffer.reserve(size);
+	return buffer;
+}
+
+std::vector<unsigned char> BufferPool::Acquire(size_t size)
+{
+	std::vector<unsigned char> buffer;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!buffers.empty()) {
+			buffer = std::move(buffers.back());
+			buffers.pop_back();
+		}
+	}
+
+	buffer.resize(size);
+	return buffer;
+}
+
+void BufferPool::Recycle(std::vector<unsigned char> &&buffer)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (buffers.size() < MAX_POOLED_BUFFERS)
+		buffers.push_back(std::move(buffer));
+}
+
+void BufferPool::Observe(size_t size)
+{
+	/* follow increases immediately, but decay slowly so that a single
+	 * small access unit doesn't shrink the buffers again */
+	size_t learned = learnedSize;
+	learned -= learned / 64;
+	learnedSize = size > learned ? size : learned;
+}
+
+HFrame::~HFrame()
+{
+	if (pool && sample)
+		pool->outstanding--;
+	if (bufferPool)
+		bufferPool->Recycle(std::move(copy));
+}
+
+void HFrame::AddRef()
+{
+	InterlockedIncrement(&refCount);
+}
+
+void HFrame::Release()
+{
+	if (!InterlockedDecrement(&refCount))
+		delete this;
+}
+
+HFrame *LeaseFrame(const std::shared_ptr<FramePool> &pool, IMediaSample *sample,
+		   unsigned char *data, size_t size, long long startTime,
+		   long long stopTime, long allocatorBuffers)
+{
+	/* always leave at least one buffer for the upstream filter to fill,
+	 * otherwise the device stalls until the consumer lets go */
+	long leased = ++pool->outstanding;
+	if (leased >= allocatorBuffers) {
+		pool->outstanding--;
+		return CopyFrame(data, size, startTime, stopTime);
+	}
+
+	HFrame *frame = new HFrame;
+	frame->sample = sample;
+	frame->pool = pool;
+	frame->data = data;
+	frame->size = size;
+	frame->startTime = startTime;
+	frame->stopTime = stopTime;
+	return frame;
+}
+
+HFrame *CopyFrame(const unsigned char *data, size_t size, long long startTime,
+		  long long stopTime)
+{
+	HFrame *frame = new HFrame;
+	frame->copy.assign(data, data + size);
+	frame->data = frame->copy.data();
+	frame->size = size;
+	frame->startTime = startTime;
+	frame->stopTime = stopTime;
+	return frame;
+}
+
+HFrame *TakeFrame(std::vector<unsigned char> &&bytes, long long startTime,
+		  long long stopTime,
+		  const std::shared_ptr<BufferPool> &bufferPool)
+{
+	HFrame *frame = new HFrame;
+	frame->copy = std::move(bytes);
+	frame->bufferPool = bufferPool;
+	frame->data = frame->copy.data();
+	frame->size = frame->copy.size();
+	frame->startTime = startTime;
+	frame->stopTime = stopTime;
+	return frame;
+}
+
+/* ------------------------------------------------------------------------- */
+
+FrameRef::FrameRef(HFrame *frame_) : frame(frame_) {}
+
+FrameRef::FrameRef(const FrameRef &ref) : frame(ref.frame)
+{
+	if (frame)
+		frame->AddRef();
+}
+
+FrameRef::FrameRef(FrameRef &&ref) noexcept : frame(ref.frame)
+{
+	ref.frame = nullptr;
+}
+
+FrameRef::~FrameRef()
+{
+	Release();
+}
+
+FrameRef &FrameRef::operator=(const FrameRef &ref)
+{
+	if (frame != ref.frame) {
+		if (ref.frame)
+			ref.frame->AddRef();
+		Release();
+		frame = ref.frame;
+	}
+
+	return *this;
+}
+
+FrameRef &FrameRef::operator=(FrameRef &&ref) noexcept
+{
+	if (this != &ref) {
+		Release();
+		frame = ref.frame;
+		ref.frame = nullptr;
+	}
+
+	return *this;
+}
+
+bool FrameRef::Valid() const
+{
+	return frame != nullptr;
+}
+
+void FrameRef::Release()
+{
+	if (frame) {
+		frame->Release();
+		frame = nullptr;
+	}
+}
+
+unsigned char *FrameRef::Data() const
+{
+	return frame ? frame->data : nullptr;
+}
+
+size_t FrameRef::Size() const
+{
+	return frame ? frame->size : 0;
+}
+
+long long FrameRef::StartTime() const
+{
+	return frame ? frame->startTime : 0;
+}
+
+long long FrameRef::StopTime() const
+{
+	return frame ? frame->stopTime : 0;
+}
+
+long long FrameRef::HostStartTime() const
+{
+	return frame ? frame->hostStartTime : 0;
+}
+
+long long FrameRef::HostStopTime() const
+{
+	return frame ? frame->hostStopTime : 0;
+}
+
+bool FrameRef::Synthesized() const
+{
+	return frame ? frame->synthesized : false;
+}
+
+bool FrameRef::Duplicate() const
+{
+	return frame ? frame->duplicate : false;
+}
+
+bool FrameRef::Copied() const
+{
+	return frame ? !frame->sample : false;
+}
+
+}; /* namespace DShow */
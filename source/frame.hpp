@@ -0,0 +1,116 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+#include "dshow-base.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace DShow {
+
+/*
+ * Tracks how many samples of a single stream are currently leased out to
+ * consumers.  Shared between the device and all of its frames so that frames
+ * can safely outlive the device that produced them.
+ */
+struct FramePool {
+	std::atomic<long> outstanding{0};
+};
+
+/*
+ * Recycles the buffers used to assemble encoded access units.  The capacity
+ * handed out is learned from the sizes of recently completed access units so
+ * that appending segments to a buffer practically never reallocates.
+ */
+class BufferPool {
+	std::mutex mutex;
+	std::vector<std::vector<unsigned char>> buffers;
+	std::atomic<size_t> learnedSize{0};
+
+public:
+	std::vector<unsigned char> Acquire();
+
+	/**
+	 * Returns a buffer of exactly the given size for data that is written
+	 * in full.  Recycled buffers keep their size, so the memory is only
+	 * initialized when the size changes.
+	 */
+	std::vector<unsigned char> Acquire(size_t size);
+	void Recycle(std::vector<unsigned char> &&buffer);
+
+	/** Updates the learned capacity with a completed access unit size */
+	void Observe(size_t size);
+};
+
+struct HFrame {
+	volatile long refCount = 1;
+
+	ComPtr<IMediaSample> sample;
+	std::vector<unsigned char> copy;
+	std::shared_ptr<FramePool> pool;
+	std::shared_ptr<BufferPool> bufferPool;
+
+	unsigned char *data = nullptr;
+	size_t size = 0;
+	long long startTime = 0;
+	long long stopTime = 0;
+	long long hostStartTime = 0;
+	long long hostStopTime = 0;
+	bool synthesized = false;
+	bool duplicate = false;
+
+	HFrame() = default;
+	HFrame(const HFrame &) = delete;
+	HFrame &operator=(const HFrame &) = delete;
+	~HFrame();
+
+	void AddRef();
+	void Release();
+};
+
+/**
+ * Leases a sample to the consumer without copying it.  If leasing the sample
+ * would leave the upstream allocator without a free buffer, the data is
+ * copied out instead and the sample is left to return to the allocator.
+ *
+ * @param  allocatorBuffers  Buffer count of the upstream allocator, or 0 if
+ *                           unknown (which always copies)
+ */
+HFrame *LeaseFrame(const std::shared_ptr<FramePool> &pool, IMediaSample *sample,
+		   unsigned char *data, size_t size, long long startTime,
+		   long long stopTime, long allocatorBuffers);
+
+/** Creates a frame from data that is only valid for the current call. */
+HFrame *CopyFrame(const unsigned char *data, size_t size, long long startTime,
+		  long long stopTime);
+
+/**
+ * Creates a frame that takes ownership of an already assembled buffer.  If a
+ * buffer pool is given, the buffer is returned to it when the frame is freed.
+ */
+HFrame *TakeFrame(std::vector<unsigned char> &&bytes, long long startTime,
+		  long long stopTime,
+		  const std::shared_ptr<BufferPool> &bufferPool = nullptr);
+
+}; /* namespace DShow */
@@ -0,0 +1,50 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+namespace DShow {
+
+/*
+ * Holds the current version of an immutable value.  Readers load it without
+ * ever blocking the writer or each other, and keep the version they loaded
+ * alive for as long as they hold on to it; a replaced version is freed once
+ * its last reader lets go.  Writers have to be serialized by the caller.
+ *
+ * Portable, so that it can be stress tested on its own.
+ */
+template<typename T> class SnapshotSlot {
+	std::shared_ptr<const T> current;
+
+public:
+	inline std::shared_ptr<const T> Load() const
+	{
+		return std::atomic_load(&current);
+	}
+
+	inline void Publish(std::shared_ptr<const T> value)
+	{
+		std::atomic_store(&current, std::move(value));
+	}
+};
+
+}; /* namespace DShow */
@@ -0,0 +1,159 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "stream-stats.hpp"
+
+namespace DShow {
+
+long long GetStatsTime()
+{
+	static long long frequency = 0;
+	LARGE_INTEGER counter;
+
+	if (!frequency) {
+		LARGE_INTEGER freq;
+		QueryPerformanceFrequency(&freq);
+		frequency = freq.QuadPart;
+	}
+
+	QueryPerformanceCounter(&counter);
+
+	/* split to avoid overflowing on long uptimes */
+	long long sec = counter.QuadPart / frequency;
+	long long rem = counter.QuadPart % frequency;
+	return sec * 10000000LL + rem * 10000000LL / frequency;
+}
+
+static inline int GetBucket(long long us)
+{
+	int bucket = 0;
+	while (us >= 2 && bucket < DSHOW_STATS_HISTOGRAM_BUCKETS - 1) {
+		us >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+void Histogram::Reset()
+{
+	for (auto &bucket : buckets)
+		bucket.store(0, std::memory_order_relaxed);
+
+	count.store(0, std::memory_order_relaxed);
+	sumUs.store(0, std::memory_order_relaxed);
+	maxUs.store(0, std::memory_order_relaxed);
+}
+
+void Histogram::Add(long long us)
+{
+	if (us < 0)
+		us = 0;
+
+	buckets[GetBucket(us)].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	sumUs.fetch_add(us, std::memory_order_relaxed);
+
+	if (us > maxUs.load(std::memory_order_relaxed))
+		maxUs.store(us, std::memory_order_relaxed);
+}
+
+void Histogram::Get(StatsHistogram &out) const
+{
+	for (int i = 0; i < DSHOW_STATS_HISTOGRAM_BUCKETS; i++)
+		out.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+
+	out.count = count.load(std::memory_order_relaxed);
+	out.sumUs = sumUs.load(std::memory_order_relaxed);
+	out.maxUs = maxUs.load(std::memory_order_relaxed);
+}
+
+void StreamTelemetry::Reset()
+{
+	samples.store(0, std::memory_order_relaxed);
+	delivered.store(0, std::memory_order_relaxed);
+	mediaTypeChanges.store(0, std::memory_order_relaxed);
+	droppedNoTimestamp.store(0, std::memory_order_relaxed);
+	synthesized.store(0, std::memory_order_relaxed);
+	droppedEmpty.store(0, std::memory_order_relaxed);
+	droppedBadPointer.store(0, std::memory_order_relaxed);
+	droppedReactivating.store(0, std::memory_order_relaxed);
+	droppedDecimated.store(0, std::memory_order_relaxed);
+	duplicates.store(0, std::memory_order_relaxed);
+	droppedDuplicate.store(0, std::memory_order_relaxed);
+	droppedConversion.store(0, std::memory_order_relaxed);
+
+	arrivalInterval.Reset();
+	arrivalJitter.Reset();
+	deliveryLatency.Reset();
+	callbackDuration.Reset();
+
+	lastArrival = 0;
+}
+
+void StreamTelemetry::Get(StreamStats &stats) const
+{
+	stats.samples = samples.load(std::memory_order_relaxed);
+	stats.delivered = delivered.load(std::memory_order_relaxed);
+	stats.mediaTypeChanges =
+		mediaTypeChanges.load(std::memory_order_relaxed);
+	stats.droppedNoTimestamp =
+		droppedNoTimestamp.load(std::memory_order_relaxed);
+	stats.synthesized = synthesized.load(std::memory_order_relaxed);
+	stats.droppedEmpty = droppedEmpty.load(std::memory_order_relaxed);
+	stats.droppedBadPointer =
+		droppedBadPointer.load(std::memory_order_relaxed);
+	stats.droppedReactivating =
+		droppedReactivating.load(std::memory_order_relaxed);
+	stats.droppedDecimated =
+		droppedDecimated.load(std::memory_order_relaxed);
+	stats.duplicates = duplicates.load(std::memory_order_relaxed);
+	stats.droppedDuplicate =
+		droppedDuplicate.load(std::memory_order_relaxed);
+	stats.droppedConversion =
+		droppedConversion.load(std::memory_order_relaxed);
+	stats.droppedQueue = 0;
+	stats.droppedSinkQueues = 0;
+
+	arrivalInterval.Get(stats.arrivalInterval);
+	arrivalJitter.Get(stats.arrivalJitter);
+	deliveryLatency.Get(stats.deliveryLatency);
+	callbackDuration.Get(stats.callbackDuration);
+}
+
+long long StreamTelemetry::Arrived(long long frameInterval)
+{
+	long long now = GetStatsTime();
+	Count(samples);
+
+	if (lastArrival) {
+		long long interval = now - lastArrival;
+		arrivalInterval.Add(interval / 10);
+
+		if (frameInterval > 0) {
+			long long jitter = interval - frameInterval;
+			arrivalJitter.Add((jitter < 0 ? -jitter : jitter) / 10);
+		}
+	}
+
+	lastArrival = now;
+	return now;
+}
+
+}; /* namespace DShow */
@@ -0,0 +1,113 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+#include "dshow-base.hpp"
+
+#include <atomic>
+
+namespace DShow {
+
+/*
+ * Lock-free histogram, each stream only ever has one writer per histogram so
+ * relaxed atomics are enough for readers to see consistent-enough values.
+ */
+class Histogram {
+	std::atomic<long long> buckets[DSHOW_STATS_HISTOGRAM_BUCKETS];
+	std::atomic<long long> count;
+	std::atomic<long long> sumUs;
+	std::atomic<long long> maxUs;
+
+public:
+	Histogram() { Reset(); }
+
+	void Reset();
+	void Add(long long us);
+	void Get(StatsHistogram &out) const;
+};
+
+struct StreamTelemetry {
+	std::atomic<long long> samples;
+	std::atomic<long long> delivered;
+	std::atomic<long long> mediaTypeChanges;
+
+	std::atomic<long long> droppedNoTimestamp;
+	std::atomic<long long> synthesized;
+	std::atomic<long long> droppedEmpty;
+	std::atomic<long long> droppedBadPointer;
+	std::atomic<long long> droppedReactivating;
+	std::atomic<long long> droppedDecimated;
+	std::atomic<long long> duplicates;
+	std::atomic<long long> droppedDuplicate;
+	std::atomic<long long> droppedConversion;
+
+	Histogram arrivalInterval;
+	Histogram arrivalJitter;
+	Histogram deliveryLatency;
+	Histogram callbackDuration;
+
+	/* only touched by the streaming thread */
+	long long lastArrival;
+
+	StreamTelemetry() { Reset(); }
+
+	void Reset();
+	void Get(StreamStats &stats) const;
+
+	/**
+	 * Records the arrival of a sample, frameInterval may be 0.  Returns
+	 * the arrival time (see GetStatsTime).
+	 */
+	long long Arrived(long long frameInterval);
+};
+
+static inline void Count(std::atomic<long long> &counter)
+{
+	counter.fetch_add(1, std::memory_order_relaxed);
+}
+
+/** High resolution timestamp in 100-nanosecond units */
+long long GetStatsTime();
+
+/*
+ * Measures a single callback invocation.  latency is the sample's stream
+ * time latency at delivery in 100-nanosecond units, or negative if unknown.
+ */
+class DeliveryTimer {
+	StreamTelemetry &stats;
+	long long start;
+
+public:
+	inline DeliveryTimer(StreamTelemetry &stats_, long long latency)
+		: stats(stats_), start(GetStatsTime())
+	{
+		if (latency >= 0)
+			stats.deliveryLatency.Add(latency / 10);
+	}
+
+	inline ~DeliveryTimer()
+	{
+		stats.callbackDuration.Add((GetStatsTime() - start) / 10);
+		Count(stats.delivered);
+	}
+};
+
+}; /* namespace DShow */
@@ -0,0 +1,100 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "timestamp-synth.hpp"
+
+/* fraction of the arrival error corrected per sample */
+#define PULL_DIVISOR 8
+#define OFFSET_SMOOTHING 16.0
+#define INTERVAL_SMOOTHING 16.0
+
+namespace DShow {
+
+void TimestampSynth::Reset()
+{
+	started = false;
+	offsetValid = false;
+	offset = 0.0;
+	arrivalInterval = 0.0;
+}
+
+void TimestampSynth::Observe(long long startTime, long long arrival)
+{
+	double sampleOffset = (double)(startTime - arrival);
+
+	if (!offsetValid) {
+		offset = sampleOffset;
+		offsetValid = true;
+	} else {
+		offset += (sampleOffset - offset) / OFFSET_SMOOTHING;
+	}
+
+	if (started && arrival > lastArrival)
+		arrivalInterval += ((double)(arrival - lastArrival) -
+				    arrivalInterval) /
+				   INTERVAL_SMOOTHING;
+
+	started = true;
+	lastStart = startTime;
+	lastArrival = arrival;
+}
+
+void TimestampSynth::Synthesize(long long arrival, long long frameInterval,
+				long long &startTime, long long &stopTime)
+{
+	/* without any real timestamps, start the timeline at 0 */
+	if (!offsetValid) {
+		offset = -(double)arrival;
+		offsetValid = true;
+	}
+
+	if (started && arrival > lastArrival)
+		arrivalInterval += ((double)(arrival - lastArrival) -
+				    arrivalInterval) /
+				   INTERVAL_SMOOTHING;
+
+	long long interval = frameInterval > 0 ? frameInterval
+					       : (long long)arrivalInterval;
+	long long measured = arrival + (long long)offset;
+
+	if (!started || interval <= 0) {
+		startTime = measured;
+	} else {
+		long long predicted = lastStart + interval;
+		long long error = measured - predicted;
+
+		/* a gap (dropped frames) or a large stall resyncs directly,
+		 * otherwise only drift towards the arrival time */
+		if (error > interval || error < -interval)
+			startTime = measured;
+		else
+			startTime = predicted + error / PULL_DIVISOR;
+	}
+
+	if (started && startTime <= lastStart)
+		startTime = lastStart + 1;
+
+	stopTime = startTime + (interval > 0 ? interval : 0);
+
+	started = true;
+	lastStart = startTime;
+	lastArrival = arrival;
+}
+
+}; /* namespace DShow */
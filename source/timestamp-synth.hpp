@@ -0,0 +1,63 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+namespace DShow {
+
+/*
+ * Generates timestamps for samples that arrive without any.  Times follow the
+ * nominal frame interval, pulled gently towards the (smoothed) arrival time so
+ * that arrival jitter doesn't reach the consumer, and jump ahead after gaps.
+ * Generated times are always increasing.  All times are in 100-nanosecond
+ * units; arrival times are host times.
+ */
+class TimestampSynth {
+	bool started = false;
+	long long lastStart = 0;
+	long long lastArrival = 0;
+
+	/* device time minus arrival time, tracked from real timestamps */
+	bool offsetValid = false;
+	double offset = 0.0;
+
+	/* used when the nominal interval is unknown */
+	double arrivalInterval = 0.0;
+
+public:
+	void Reset();
+
+	/** Records a sample that did have a timestamp */
+	void Observe(long long startTime, long long arrival);
+
+	/**
+	 * Generates times for a sample that arrived at the given time.
+	 * frameInterval is the nominal interval, or 0 if unknown.
+	 */
+	void Synthesize(long long arrival, long long frameInterval,
+			long long &startTime, long long &stopTime);
+
+	/** Converts a generated time back to the arrival (host) timeline */
+	inline long long ToArrivalTime(long long time) const
+	{
+		return time - (long long)offset;
+	}
+};
+
+}; /* namespace DShow */
@@ -0,0 +1,188 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+
+#include "video-convert.hpp"
+#include "format-score.hpp"
+
+namespace DShow {
+
+bool VideoConverter::Supported(VideoFormat from, VideoFormat to)
+{
+	return GetConvertKernel(from, to, ColorMatrix::BT709,
+				ColorRange::Limited, CpuLevel::Scalar) != nullptr;
+}
+
+bool VideoConverter::Scalable(VideoFormat from, VideoFormat to)
+{
+	return CanScale(from, to);
+}
+
+bool VideoConverter::Rotatable(VideoFormat format, int cx, int cy)
+{
+	if (!GetRotateKernel(format, 90, CpuLevel::Scalar))
+		return false;
+
+	/* chroma of odd sizes wouldn't line up with luma anymore */
+	const bool subsampled = format == VideoFormat::NV12 ||
+				format == VideoFormat::I420 ||
+				format == VideoFormat::YV12;
+	return !subsampled || (cx % 2 == 0 && cy % 2 == 0);
+}
+
+bool VideoConverter::Reset(const VideoConfig &config, int captureCX,
+			   int captureCY, int rotation)
+{
+	const VideoFormat from = config.internalFormat;
+	const VideoFormat to = config.format;
+	const bool sideways = rotation == 90 || rotation == 270;
+	const int scaledCX = sideways ? config.cy_abs : config.cx;
+	const int scaledCY = sideways ? config.cx : config.cy_abs;
+
+	Clear();
+
+	ConvertProc kernel = GetConvertKernel(from, to, config.conversionMatrix,
+					      config.conversionRange,
+					      GetCpuLevel());
+	if (!kernel && from != to)
+		return false;
+
+	/* bottom-up RGB stays bottom-up, which mirrors the direction of
+	 * rotation in memory */
+	if (sideways && IsRgb(to) && !config.cy_flip)
+		rotation = 360 - rotation;
+
+	ConvertProc rotateKernel = nullptr;
+	if (rotation) {
+		rotateKernel = GetRotateKernel(to, rotation, GetCpuLevel());
+		if (!rotateKernel || !Rotatable(to, scaledCX, scaledCY))
+			return false;
+	}
+
+	bool scaleFrames = false;
+	if (config.scaling != ScaleMode::None && Scalable(from, to) &&
+	    (captureCX != scaledCX || captureCY != scaledCY)) {
+		if (!scaler.Reset(to, captureCX, captureCY, scaledCX, scaledCY,
+				  config.scaling))
+			return false;
+		scaleFrames = true;
+	}
+
+	if (!kernel && !scaleFrames && !rotateKernel)
+		return false;
+
+	if (!GetPlaneLayout(from, captureCX, captureCY, input) ||
+	    !GetPlaneLayout(to, captureCX, captureCY, converted))
+		return false;
+
+	scaled = scaleFrames ? scaler.OutputLayout() : converted;
+
+	PlaneLayout out = scaled;
+	if (rotateKernel &&
+	    !GetPlaneLayout(to, config.cx, config.cy_abs, out))
+		return false;
+
+	/* buffers of the previous size are of no use anymore */
+	if (!pool || output.size != out.size)
+		pool = std::make_shared<BufferPool>();
+
+	output = out;
+	convertedData.resize(kernel && (scaleFrames || rotateKernel)
+				     ? converted.size
+				     : 0);
+	convertedData.shrink_to_fit();
+	scaledData.resize(scaleFrames && rotateKernel ? scaled.size : 0);
+	scaledData.shrink_to_fit();
+
+	/* RGB is bottom-up unless the height was negative, YUV never is */
+	flip = IsRgb(from) && !IsRgb(to) && !config.cy_flip;
+
+	proc = kernel;
+	scale = scaleFrames;
+	rotate = rotateKernel;
+	cx = captureCX;
+	cy = captureCY;
+	outputCX = config.cx;
+	outputCY = config.cy_abs;
+	return true;
+}
+
+void VideoConverter::Clear()
+{
+	proc = nullptr;
+	scale = false;
+	rotate = nullptr;
+}
+
+HFrame *VideoConverter::Convert(const unsigned char *data, size_t size,
+				long long startTime, long long stopTime)
+{
+	if (size < input.size)
+		return nullptr;
+
+	std::vector<unsigned char> bytes = pool->Acquire(output.size);
+
+	if (proc) {
+		unsigned char *dst = scale || rotate ? convertedData.data()
+						     : bytes.data();
+
+		ConvertFrame frame;
+		for (int i = 0; i < 3; i++) {
+			frame.src[i] = data + input.offset[i];
+			frame.srcPitch[i] = input.pitch[i];
+			frame.dst[i] = dst + converted.offset[i];
+			frame.dstPitch[i] = converted.pitch[i];
+		}
+		frame.cx = cx;
+		frame.cy = cy;
+
+		if (flip) {
+			frame.src[0] += (cy - 1) * input.pitch[0];
+			frame.srcPitch[0] = -input.pitch[0];
+		}
+
+		RunSliced(proc, frame, affinity);
+		data = dst;
+	}
+
+	if (scale) {
+		unsigned char *dst = rotate ? scaledData.data() : bytes.data();
+
+		scaler.Scale(data, dst, affinity);
+		data = dst;
+	}
+
+	if (rotate) {
+		ConvertFrame frame;
+		for (int i = 0; i < 3; i++) {
+			frame.src[i] = data + scaled.offset[i];
+			frame.srcPitch[i] = scaled.pitch[i];
+			frame.dst[i] = bytes.data() + output.offset[i];
+			frame.dstPitch[i] = output.pitch[i];
+		}
+		frame.cx = outputCX;
+		frame.cy = outputCY;
+
+		RunSliced(rotate, frame, affinity);
+	}
+
+	return TakeFrame(std::move(bytes), startTime, stopTime, pool);
+}
+
+}; /* namespace DShow */
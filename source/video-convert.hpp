@@ -0,0 +1,101 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+#include "convert-kernels.hpp"
+#include "frame.hpp"
+#include "video-scale.hpp"
+
+#include <memory>
+#include <vector>
+
+namespace DShow {
+
+/*
+ * Converts raw frames from the negotiated format (VideoConfig::internalFormat)
+ * to the one the consumer asked for (VideoConfig::format), so that devices
+ * that only offer packed formats don't need a DirectShow intermediary filter.
+ * Output buffers are recycled once the consumer lets go of the frame.
+ *
+ * Only used from the video streaming thread.
+ */
+class VideoConverter {
+	ConvertProc proc = nullptr;
+	VideoScaler scaler;
+	bool scale = false;
+	ConvertProc rotate = nullptr;
+	PlaneLayout input;
+	PlaneLayout converted;
+	PlaneLayout scaled;
+	PlaneLayout output;
+	bool flip = false;
+	int cx = 0;
+	int cy = 0;
+	int outputCX = 0;
+	int outputCY = 0;
+	unsigned affinity = 0;
+	std::shared_ptr<BufferPool> pool;
+
+	/* frames waiting for the next stage */
+	std::vector<unsigned char> convertedData;
+	std::vector<unsigned char> scaledData;
+
+public:
+	static bool Supported(VideoFormat from, VideoFormat to);
+
+	/** Whether video in this format can be delivered scaled */
+	static bool Scalable(VideoFormat from, VideoFormat to);
+
+	/** Whether frames of this format and size can be rotated */
+	static bool Rotatable(VideoFormat format, int cx, int cy);
+
+	/**
+	 * Sets up the conversion from config.internalFormat to config.format
+	 * for a new format or frame size, followed by scaling from
+	 * captureCX/captureCY to config.cx/cy_abs if config.scaling is set,
+	 * and clockwise rotation by 90, 180 or 270 degrees.  config.cx/cy_abs
+	 * are the size after rotation.  Returns false (and passes frames
+	 * through unchanged) if nothing needs to be done or it can't be done.
+	 *
+	 * Bottom-up RGB video is flipped while converting it to YUV.
+	 */
+	bool Reset(const VideoConfig &config, int captureCX, int captureCY,
+		   int rotation);
+	void Clear();
+
+	inline bool Active() const
+	{
+		return proc != nullptr || scale || rotate != nullptr;
+	}
+
+	/** Preferred workers for the slices of this converter's frames */
+	inline void SetAffinity(unsigned hint) { affinity = hint; }
+
+	/**
+	 * Converts a sample into a new frame, or returns null if the sample is
+	 * too small for the configured frame size.
+	 */
+	HFrame *Convert(const unsigned char *data, size_t size,
+			long long startTime, long long stopTime);
+};
+
+}; /* namespace DShow */
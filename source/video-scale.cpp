@@ -0,0 +1,455 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+
+#include "video-scale.hpp"
+
+#include <algorithm>
+#include <math.h>
+
+#ifdef CONVERT_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef CONVERT_AVX2
+#include <immintrin.h>
+#endif
+
+#define WEIGHT_ROUND (1 << (WEIGHT_BITS - 1))
+
+namespace DShow {
+
+void ScaleFilter::Reset(int srcSize, int dstSize, ScaleMode mode)
+{
+	const double ratio = (double)srcSize / (double)dstSize;
+
+	start.assign(dstSize, 0);
+
+	/* area averaging only makes sense when several source samples fall
+	 * into each output sample */
+	if (mode == ScaleMode::Area && srcSize > dstSize) {
+		taps = std::min((int)ceil(ratio) + 1, srcSize);
+		weights.assign((size_t)dstSize * taps, 0);
+
+		for (int i = 0; i < dstSize; i++) {
+			const double a = i * ratio;
+			const double b = a + ratio;
+			const int first = std::max(
+				std::min((int)floor(a), srcSize - taps), 0);
+			short *w = &weights[(size_t)i * taps];
+			double covered = 0.0;
+			int sum = 0, largest = 0;
+
+			/* round the running total, many small weights rounded
+			 * one by one can be off by more than the largest */
+			for (int k = 0; k < taps; k++) {
+				const int j = first + k;
+				double overlap = std::min(b, (double)(j + 1)) -
+						 std::max(a, (double)j);
+				if (overlap <= 0.0)
+					continue;
+
+				covered += overlap;
+				const int total =
+					(int)lround(covered / ratio * WEIGHT_ONE);
+				w[k] = (short)(total - sum);
+				sum = total;
+				if (w[k] > w[largest])
+					largest = k;
+			}
+
+			/* rounding leftovers go to the largest weight */
+			w[largest] = (short)(w[largest] + WEIGHT_ONE - sum);
+			start[i] = first;
+		}
+
+		return;
+	}
+
+	taps = srcSize > 1 ? 2 : 1;
+	weights.assign((size_t)dstSize * taps, 0);
+
+	for (int i = 0; i < dstSize; i++) {
+		short *w = &weights[(size_t)i * taps];
+
+		if (taps == 1) {
+			w[0] = WEIGHT_ONE;
+			continue;
+		}
+
+		double center = (i + 0.5) * ratio - 0.5;
+		center = std::max(0.0, std::min(center, srcSize - 1.0));
+
+		int first = (int)floor(center);
+		double frac = center - first;
+		if (first >= srcSize - 1) {
+			first = srcSize - 2;
+			frac = 1.0;
+		}
+
+		w[1] = (short)lround(frac * WEIGHT_ONE);
+		w[0] = (short)(WEIGHT_ONE - w[1]);
+		start[i] = first;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* vertical pass                                                             */
+
+static void VerticalScalar(const unsigned char *const *rows, const short *w,
+			   int taps, unsigned char *dst, int x, int n)
+{
+	for (; x < n; x++) {
+		int sum = WEIGHT_ROUND;
+		for (int k = 0; k < taps; k++)
+			sum += w[k] * rows[k][x];
+
+		sum >>= WEIGHT_BITS;
+		dst[x] = (unsigned char)(sum > 255 ? 255 : sum);
+	}
+}
+
+/* taps are applied in pairs with pmaddwd, interleaving the two rows' words
+ * so that each product pair lands in one 32-bit lane */
+#ifdef CONVERT_SSE2
+static void VerticalSSE2(const unsigned char *const *rows, const short *w,
+			 int taps, unsigned char *dst, int x, int n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi32(WEIGHT_ROUND);
+
+	for (; x + 16 <= n; x += 16) {
+		__m128i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+
+		for (int k = 0; k < taps; k += 2) {
+			const bool pair = k + 1 < taps;
+			__m128i a = _mm_loadu_si128((const __m128i *)(rows[k] +
+								      x));
+			__m128i b = pair ? _mm_loadu_si128((const __m128i *)(rows[k + 1] +
+									     x))
+					 : zero;
+			__m128i wk = _mm_set1_epi32(
+				(unsigned short)w[k] |
+				((pair ? (unsigned short)w[k + 1] : 0) << 16));
+
+			__m128i alo = _mm_unpacklo_epi8(a, zero);
+			__m128i ahi = _mm_unpackhi_epi8(a, zero);
+			__m128i blo = _mm_unpacklo_epi8(b, zero);
+			__m128i bhi = _mm_unpackhi_epi8(b, zero);
+
+			acc0 = _mm_add_epi32(
+				acc0,
+				_mm_madd_epi16(_mm_unpacklo_epi16(alo, blo), wk));
+			acc1 = _mm_add_epi32(
+				acc1,
+				_mm_madd_epi16(_mm_unpackhi_epi16(alo, blo), wk));
+			acc2 = _mm_add_epi32(
+				acc2,
+				_mm_madd_epi16(_mm_unpacklo_epi16(ahi, bhi), wk));
+			acc3 = _mm_add_epi32(
+				acc3,
+				_mm_madd_epi16(_mm_unpackhi_epi16(ahi, bhi), wk));
+		}
+
+		__m128i lo = _mm_packs_epi32(_mm_srai_epi32(acc0, WEIGHT_BITS),
+					     _mm_srai_epi32(acc1, WEIGHT_BITS));
+		__m128i hi = _mm_packs_epi32(_mm_srai_epi32(acc2, WEIGHT_BITS),
+					     _mm_srai_epi32(acc3, WEIGHT_BITS));
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(lo, hi));
+	}
+
+	VerticalScalar(rows, w, taps, dst, x, n);
+}
+#endif
+
+/* the unpacks and packs are both per lane, so bytes come back out in the
+ * order they went in */
+#ifdef CONVERT_AVX2
+AVX2_FUNC static void VerticalAVX2(const unsigned char *const *rows,
+				   const short *w, int taps,
+				   unsigned char *dst, int x, int n)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i round = _mm256_set1_epi32(WEIGHT_ROUND);
+
+	for (; x + 32 <= n; x += 32) {
+		__m256i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+
+		for (int k = 0; k < taps; k += 2) {
+			const bool pair = k + 1 < taps;
+			__m256i a = _mm256_loadu_si256(
+				(const __m256i *)(rows[k] + x));
+			__m256i b = pair ? _mm256_loadu_si256((const __m256i *)(rows[k + 1] +
+										x))
+					 : zero;
+			__m256i wk = _mm256_set1_epi32(
+				(unsigned short)w[k] |
+				((pair ? (unsigned short)w[k + 1] : 0) << 16));
+
+			__m256i alo = _mm256_unpacklo_epi8(a, zero);
+			__m256i ahi = _mm256_unpackhi_epi8(a, zero);
+			__m256i blo = _mm256_unpacklo_epi8(b, zero);
+			__m256i bhi = _mm256_unpackhi_epi8(b, zero);
+
+			acc0 = _mm256_add_epi32(
+				acc0, _mm256_madd_epi16(
+					      _mm256_unpacklo_epi16(alo, blo), wk));
+			acc1 = _mm256_add_epi32(
+				acc1, _mm256_madd_epi16(
+					      _mm256_unpackhi_epi16(alo, blo), wk));
+			acc2 = _mm256_add_epi32(
+				acc2, _mm256_madd_epi16(
+					      _mm256_unpacklo_epi16(ahi, bhi), wk));
+			acc3 = _mm256_add_epi32(
+				acc3, _mm256_madd_epi16(
+					      _mm256_unpackhi_epi16(ahi, bhi), wk));
+		}
+
+		__m256i lo = _mm256_packs_epi32(
+			_mm256_srai_epi32(acc0, WEIGHT_BITS),
+			_mm256_srai_epi32(acc1, WEIGHT_BITS));
+		__m256i hi = _mm256_packs_epi32(
+			_mm256_srai_epi32(acc2, WEIGHT_BITS),
+			_mm256_srai_epi32(acc3, WEIGHT_BITS));
+		_mm256_storeu_si256((__m256i *)(dst + x),
+				    _mm256_packus_epi16(lo, hi));
+	}
+
+	VerticalScalar(rows, w, taps, dst, x, n);
+}
+#endif
+
+VerticalProc GetVerticalProc(CpuLevel level)
+{
+#ifdef CONVERT_AVX2
+	if (level >= CpuLevel::AVX2)
+		return VerticalAVX2;
+#endif
+#ifdef CONVERT_SSE2
+	if (level >= CpuLevel::SSE2)
+		return VerticalSSE2;
+#endif
+	(void)level;
+	return VerticalScalar;
+}
+
+/* ------------------------------------------------------------------------- */
+/* horizontal pass                                                           */
+
+/* the stride is a template parameter so that the sample addressing folds
+ * into the loads, bilinear gets its own loop without the inner one */
+template<int stride>
+static void Horizontal(const unsigned char *src, unsigned char *dst,
+		       const ScaleFilter &filter, int offset)
+{
+	const int taps = filter.taps;
+	const int count = (int)filter.start.size();
+	const int *start = filter.start.data();
+	const short *w = filter.weights.data();
+
+	src += offset;
+	dst += offset;
+
+	if (taps == 2) {
+		for (int i = 0; i < count; i++, w += 2) {
+			const unsigned char *s = src + start[i] * stride;
+			int sum = WEIGHT_ROUND + w[0] * s[0] + w[1] * s[stride];
+			dst[i * stride] = (unsigned char)(sum >> WEIGHT_BITS);
+		}
+		return;
+	}
+
+	for (int i = 0; i < count; i++, w += taps) {
+		const unsigned char *s = src + start[i] * stride;
+		int sum = WEIGHT_ROUND;
+
+		for (int k = 0; k < taps; k++)
+			sum += w[k] * s[k * stride];
+
+		sum >>= WEIGHT_BITS;
+		dst[i * stride] = (unsigned char)(sum > 255 ? 255 : sum);
+	}
+}
+
+static void Horizontal(const unsigned char *src, unsigned char *dst,
+		       const ScaleFilter &filter, int stride, int offset)
+{
+	switch (stride) {
+	case 1:
+		Horizontal<1>(src, dst, filter, offset);
+		break;
+	case 2:
+		Horizontal<2>(src, dst, filter, offset);
+		break;
+	default:
+		Horizontal<4>(src, dst, filter, offset);
+		break;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+bool VideoScaler::Supported(VideoFormat format)
+{
+	switch (format) {
+	case VideoFormat::XRGB:
+	case VideoFormat::ARGB:
+	case VideoFormat::I420:
+	case VideoFormat::NV12:
+	case VideoFormat::YV12:
+	case VideoFormat::Y800:
+	case VideoFormat::YVYU:
+	case VideoFormat::YUY2:
+	case VideoFormat::UYVY:
+	case VideoFormat::HDYC:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool VideoScaler::Reset(VideoFormat format_, int srcCX, int srcCY, int dstCX_,
+			int dstCY_, ScaleMode mode)
+{
+	if (!Supported(format_) || mode == ScaleMode::None ||
+	    !GetPlaneLayout(format_, srcCX, srcCY, input) ||
+	    !GetPlaneLayout(format_, dstCX_, dstCY_, output))
+		return false;
+
+	format = format_;
+	vertical = GetVerticalProc(GetCpuLevel());
+	dstCX = dstCX_;
+	dstCY = dstCY_;
+
+	const int srcChromaCX = (srcCX + 1) / 2;
+	const int srcChromaCY = (srcCY + 1) / 2;
+	const int dstChromaCX = (dstCX + 1) / 2;
+	const int dstChromaCY = (dstCY + 1) / 2;
+
+	lumaX.Reset(srcCX, dstCX, mode);
+	lumaY.Reset(srcCY, dstCY, mode);
+	chromaX.Reset(srcChromaCX, dstChromaCX, mode);
+	chromaY.Reset(srcChromaCY, dstChromaCY, mode);
+
+	const Plane luma = {&lumaY, srcCX, dstCY, 1, {{&lumaX, 1, 0}}, 1};
+	const Plane chroma = {&chromaY, srcChromaCX, dstChromaCY, 1,
+			      {{&chromaX, 1, 0}}, 2};
+
+	switch (format) {
+	case VideoFormat::I420:
+	case VideoFormat::YV12:
+		planes[0] = luma;
+		planes[1] = planes[2] = chroma;
+		planeCount = 3;
+		break;
+
+	case VideoFormat::NV12:
+		planes[0] = luma;
+		planes[1] = {&chromaY, srcChromaCX * 2, dstChromaCY, 2,
+			     {{&chromaX, 2, 0}, {&chromaX, 2, 1}}, 2};
+		planeCount = 2;
+		break;
+
+	case VideoFormat::Y800:
+		planes[0] = luma;
+		planeCount = 1;
+		break;
+
+	case VideoFormat::YVYU:
+	case VideoFormat::YUY2:
+		planes[0] = {&lumaY,
+			     srcChromaCX * 4,
+			     dstCY,
+			     3,
+			     {{&lumaX, 2, 0}, {&chromaX, 4, 1}, {&chromaX, 4, 3}},
+			     1};
+		planeCount = 1;
+		break;
+
+	case VideoFormat::UYVY:
+	case VideoFormat::HDYC:
+		planes[0] = {&lumaY,
+			     srcChromaCX * 4,
+			     dstCY,
+			     3,
+			     {{&lumaX, 2, 1}, {&chromaX, 4, 0}, {&chromaX, 4, 2}},
+			     1};
+		planeCount = 1;
+		break;
+
+	default: /* XRGB, ARGB */
+		planes[0] = {&lumaY,
+			     srcCX * 4,
+			     dstCY,
+			     4,
+			     {{&lumaX, 4, 0},
+			      {&lumaX, 4, 1},
+			      {&lumaX, 4, 2},
+			      {&lumaX, 4, 3}},
+			     1};
+		planeCount = 1;
+		break;
+	}
+
+	return true;
+}
+
+void VideoScaler::ScaleRows(const Plane &plane, const unsigned char *src,
+			    ptrdiff_t srcPitch, unsigned char *dst,
+			    ptrdiff_t dstPitch, int y0, int y1) const
+{
+	thread_local std::vector<unsigned char> row;
+	thread_local std::vector<const unsigned char *> rows;
+
+	const ScaleFilter &filter = *plane.filterY;
+	row.resize(plane.srcRowBytes);
+	rows.resize(filter.taps);
+
+	for (int y = y0; y < y1; y++) {
+		for (int k = 0; k < filter.taps; k++)
+			rows[k] = src + (filter.start[y] + k) * srcPitch;
+
+		vertical(rows.data(), &filter.weights[(size_t)y * filter.taps],
+			 filter.taps, row.data(), 0, plane.srcRowBytes);
+
+		unsigned char *out = dst + y * dstPitch;
+		for (int c = 0; c < plane.channelCount; c++) {
+			const Channel &channel = plane.channels[c];
+			Horizontal(row.data(), out, *channel.filter,
+				   channel.stride, channel.offset);
+		}
+	}
+}
+
+void VideoScaler::Scale(const unsigned char *src, unsigned char *dst,
+			unsigned affinity) const
+{
+	RunSliced(dstCX, dstCY, affinity, [&](int y0, int y1) {
+		for (int i = 0; i < planeCount; i++) {
+			const Plane &plane = planes[i];
+			const int div = plane.rowDivisor;
+
+			ScaleRows(plane, src + input.offset[i], input.pitch[i],
+				  dst + output.offset[i], output.pitch[i],
+				  y0 / div,
+				  std::min((y1 + div - 1) / div, plane.dstRows));
+		}
+	});
+}
+
+}; /* namespace DShow */
@@ -0,0 +1,105 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+
+#pragma once
+
+#include "../dshowcapture.hpp"
+#include "convert-kernels.hpp"
+
+#include <vector>
+
+#define WEIGHT_BITS 14
+#define WEIGHT_ONE (1 << WEIGHT_BITS)
+
+namespace DShow {
+
+/*
+ * Separable filter for one axis: output i is the weighted sum of taps
+ * consecutive source samples starting at start[i], with weights that
+ * sum to WEIGHT_ONE.
+ */
+struct ScaleFilter {
+	int taps = 0;
+	std::vector<int> start;
+	std::vector<short> weights;
+
+	void Reset(int srcSize, int dstSize, ScaleMode mode);
+};
+
+/*
+ * Vertical pass over one row: dst[x] for x in [x, n) is the sum of rows[k][x]
+ * weighted by w[k] for each of the taps rows.
+ */
+typedef void (*VerticalProc)(const unsigned char *const *rows,
+			     const short *w, int taps, unsigned char *dst,
+			     int x, int n);
+
+VerticalProc GetVerticalProc(CpuLevel level);
+
+/*
+ * Scales raw frames without changing their format.  Every plane is filtered
+ * vertically first (SIMD, over whole rows) and then horizontally, one
+ * channel at a time.
+ */
+class VideoScaler {
+	struct Channel {
+		const ScaleFilter *filter;
+		int stride;
+		int offset;
+	};
+
+	struct Plane {
+		const ScaleFilter *filterY;
+		int srcRowBytes;
+		int dstRows;
+		int channelCount;
+		Channel channels[4];
+		/* rows of this plane per luma row, 2 for 4:2:0 chroma */
+		int rowDivisor;
+	};
+
+	VideoFormat format = VideoFormat::Any;
+	int dstCX = 0;
+	int dstCY = 0;
+	PlaneLayout input;
+	PlaneLayout output;
+	ScaleFilter lumaX, lumaY, chromaX, chromaY;
+	Plane planes[3];
+	int planeCount = 0;
+	VerticalProc vertical = nullptr;
+
+	void ScaleRows(const Plane &plane, const unsigned char *src,
+		       ptrdiff_t srcPitch, unsigned char *dst,
+		       ptrdiff_t dstPitch, int y0, int y1) const;
+
+public:
+	static bool Supported(VideoFormat format);
+
+	bool Reset(VideoFormat format, int srcCX, int srcCY, int dstCX,
+		   int dstCY, ScaleMode mode);
+
+	inline const PlaneLayout &InputLayout() const { return input; }
+	inline const PlaneLayout &OutputLayout() const { return output; }
+
+	void Scale(const unsigned char *src, unsigned char *dst,
+		   unsigned affinity) const;
+};
+
+}; /* namespace DShow */
@@ -0,0 +1,215 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+
+#include "worker-pool.hpp"
+
+#include <algorithm>
+
+/* more threads than this only add contention on memory bound work */
+#define MAX_WORKERS 15
+
+namespace DShow {
+
+WorkerPool::WorkerPool(unsigned count)
+{
+	for (unsigned i = 0; i < count; i++)
+		workers.emplace_back(new Worker);
+	for (unsigned i = 0; i < count; i++)
+		threads.emplace_back(&WorkerPool::WorkerThread, this, i);
+}
+
+WorkerPool::~WorkerPool()
+{
+	for (std::unique_ptr<Worker> &worker : workers) {
+		std::lock_guard<std::mutex> lock(worker->mutex);
+		worker->stopping = true;
+		worker->wake.notify_one();
+	}
+
+	for (std::thread &thread : threads)
+		thread.join();
+}
+
+WorkerPool &WorkerPool::Get()
+{
+	/* never destroyed: joining threads from static destructors can
+	 * deadlock on the loader lock when the library is unloaded, and the
+	 * workers hold no resources besides themselves */
+	static WorkerPool *pool = [] {
+		unsigned cores = std::thread::hardware_concurrency();
+		unsigned count = cores > 1 ? cores - 1 : 0;
+		return new WorkerPool(std::min(count, (unsigned)MAX_WORKERS));
+	}();
+	return *pool;
+}
+
+/* ------------------------------------------------------------------------- */
+
+bool WorkerPool::PopTask(Worker &worker, Task &task)
+{
+	std::lock_guard<std::mutex> lock(worker.mutex);
+	if (worker.tasks.empty())
+		return false;
+
+	task = worker.tasks.front();
+	worker.tasks.pop_front();
+	return true;
+}
+
+bool WorkerPool::StealTask(size_t thief, Task &task)
+{
+	for (size_t i = 1; i < workers.size(); i++) {
+		Worker &victim = *workers[(thief + i) % workers.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+
+		if (!victim.tasks.empty()) {
+			task = victim.tasks.back();
+			victim.tasks.pop_back();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool WorkerPool::TakeBack(Job &job, Task &task)
+{
+	for (std::unique_ptr<Worker> &worker : workers) {
+		std::lock_guard<std::mutex> lock(worker->mutex);
+		std::deque<Task> &tasks = worker->tasks;
+
+		for (auto it = tasks.begin(); it != tasks.end(); ++it) {
+			if (it->job == &job) {
+				task = *it;
+				tasks.erase(it);
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void WorkerPool::RunTask(const Task &task)
+{
+	Job &job = *task.job;
+	job.proc(job.param, task.slice);
+
+	if (job.remaining.fetch_sub(1) == 1) {
+		std::lock_guard<std::mutex> lock(mutex);
+		job.done = true;
+		finished.notify_all();
+	}
+}
+
+/* wakes up to count sleeping workers to steal */
+void WorkerPool::Poke(size_t count)
+{
+	for (size_t i = 0; i < workers.size() && count > 0; i++) {
+		Worker &worker = *workers[i];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+
+		if (worker.sleeping && !worker.poked && worker.tasks.empty()) {
+			worker.poked = true;
+			worker.wake.notify_one();
+			count--;
+		}
+	}
+}
+
+void WorkerPool::WorkerThread(size_t index)
+{
+	Worker &self = *workers[index];
+	Task task;
+
+	for (;;) {
+		const unsigned seen = dealtToBusy.load();
+
+		if (PopTask(self, task) || StealTask(index, task)) {
+			RunTask(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(self.mutex);
+		self.sleeping = true;
+		self.wake.wait(lock, [&] {
+			return !self.tasks.empty() || self.poked ||
+			       self.stopping || dealtToBusy.load() != seen;
+		});
+		if (self.stopping)
+			return;
+		self.sleeping = false;
+		self.poked = false;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+void WorkerPool::Run(SliceProc proc, void *param, int count,
+		     unsigned affinity)
+{
+	if (count <= 1 || workers.empty()) {
+		for (int i = 0; i < count; i++)
+			proc(param, i);
+		return;
+	}
+
+	Job job;
+	job.proc = proc;
+	job.param = param;
+	job.remaining = count;
+
+	/* deal slices 1 and up, the calling thread takes slice 0 itself */
+	const size_t n = workers.size();
+	const size_t first = affinity % n;
+	const size_t targets = std::min((size_t)count - 1, n);
+	size_t busy = 0;
+
+	for (size_t i = 0; i < targets; i++) {
+		Worker &worker = *workers[(first + i) % n];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+
+		for (int slice = (int)i + 1; slice < count; slice += (int)n)
+			worker.tasks.push_back(Task{&job, slice});
+
+		if (worker.sleeping)
+			worker.wake.notify_one();
+		else
+			busy++;
+	}
+
+	/* slices dealt to workers still busy with something else can be
+	 * stolen by idle ones */
+	if (busy) {
+		dealtToBusy++;
+		Poke(busy);
+	}
+
+	RunTask(Task{&job, 0});
+
+	Task task;
+	while (TakeBack(job, task))
+		RunTask(task);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [&] { return job.done; });
+}
+
+}; /* namespace DShow */
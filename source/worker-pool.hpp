@@ -0,0 +1,128 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace DShow {
+
+/*
+ * Worker threads shared by all devices, used to split per-frame work
+ * (conversion and the like) into horizontal slices.
+ *
+ * Every worker has its own queue.  A job's slices are dealt round-robin to
+ * the queues starting at the worker its affinity hint picks, and only those
+ * workers are woken, so each device's frames tend to be handled by the same
+ * threads (and caches) and concurrent devices start on different ones.  The
+ * submitting thread runs the first slice itself and then takes back any of
+ * its slices that haven't been started yet.  Workers that run out of work
+ * steal from the back of the other queues, so a slice dealt to a worker
+ * busy with another device's frame doesn't wait for it.
+ */
+class WorkerPool {
+public:
+	typedef void (*SliceProc)(void *param, int slice);
+
+private:
+	struct Job {
+		SliceProc proc;
+		void *param;
+		std::atomic<int> remaining{0};
+
+		/* set once the last slice is done, guarded by the pool's
+		 * mutex so that the job isn't freed under whoever ran it */
+		bool done = false;
+	};
+
+	struct Task {
+		Job *job;
+		int slice;
+	};
+
+	struct Worker {
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::deque<Task> tasks;
+
+		/* waiting on wake, and woken to steal rather than for its
+		 * own tasks */
+		bool sleeping = false;
+		bool poked = false;
+		bool stopping = false;
+	};
+
+	std::mutex mutex;
+	std::condition_variable finished;
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	/* bumped whenever slices are dealt to busy workers, so that workers
+	 * on their way to sleep look for something to steal once more */
+	std::atomic<unsigned> dealtToBusy{0};
+	std::vector<std::thread> threads;
+
+	bool PopTask(Worker &worker, Task &task);
+	bool StealTask(size_t thief, Task &task);
+	bool TakeBack(Job &job, Task &task);
+	void RunTask(const Task &task);
+	void Poke(size_t count);
+	void WorkerThread(size_t index);
+
+	void Run(SliceProc proc, void *param, int count, unsigned affinity);
+
+	template<typename F> static void Thunk(void *param, int slice)
+	{
+		(*static_cast<F *>(param))(slice);
+	}
+
+public:
+	/** Starts count worker threads.  Devices share the pool from Get() */
+	explicit WorkerPool(unsigned count);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool &) = delete;
+	WorkerPool &operator=(const WorkerPool &) = delete;
+
+	/** The process-wide pool, created on first use */
+	static WorkerPool &Get();
+
+	/** Worker threads plus the calling thread */
+	inline int Concurrency() const { return (int)threads.size() + 1; }
+
+	/**
+	 * Calls func(slice) for every slice in [0, count), and returns once
+	 * all of them are done.  Runs everything on the calling thread if
+	 * there is only one slice or no workers.
+	 */
+	template<typename F> void Run(int count, unsigned affinity, F &&func)
+	{
+		typedef typename std::remove_reference<F>::type Func;
+		Run(&Thunk<Func>, (void *)&func, count, affinity);
+	}
+};
+
+}; /* namespace DShow */
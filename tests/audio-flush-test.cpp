@@ -0,0 +1,130 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * Stops the way HDevice::Stop does, flushing the audio coalescer and then
+ * stopping the queues, and checks that a partial chunk still reaches the
+ * consumer through a delivery queue and through the A/V aligner.  Windows
+ * only.
+ */
+
+#include "audio-coalescer.hpp"
+#include "av-aligner.hpp"
+#include "delivery-queue.hpp"
+#include "test-util.hpp"
+
+#include <vector>
+
+using namespace DShow;
+
+#define SAMPLE_RATE 48000
+#define BLOCK_ALIGN 4
+#define CHUNK_MS 20
+
+/* 10 ms, half a chunk */
+#define PARTIAL_BYTES (SAMPLE_RATE / 100 * BLOCK_ALIGN)
+
+static void PushPartialChunk(AudioCoalescer &coalescer)
+{
+	std::vector<unsigned char> packet(PARTIAL_BYTES, 0x55);
+	coalescer.Push(packet.data(), packet.size(), true, 0);
+}
+
+static void TestQueue()
+{
+	DeliveryQueue queue;
+	QueueConfig config;
+	config.depth = 8;
+
+	std::atomic<size_t> bytes{0};
+	std::atomic<int> frames{0};
+	CHECK(queue.Start(config, [&](QueuedFrame &frame) {
+		/* slow enough that the chunk is still queued at Stop */
+		Sleep(20);
+		bytes += frame.frame.Size();
+		frames++;
+	}));
+
+	AudioCoalescer coalescer;
+	coalescer.Reset(CHUNK_MS, SAMPLE_RATE, BLOCK_ALIGN,
+			[&](std::vector<unsigned char> &&chunk,
+			    long long startTime, long long stopTime) {
+				QueuedFrame frame;
+				frame.frame = FrameRef(
+					TakeFrame(std::move(chunk), startTime,
+						  stopTime, coalescer.GetPool()));
+				queue.Push(frame);
+			});
+
+	PushPartialChunk(coalescer);
+	CHECK(frames.load() == 0);
+
+	coalescer.Flush();
+	queue.Stop();
+
+	CHECK(frames.load() == 1);
+	CHECK(bytes.load() == PARTIAL_BYTES);
+	CHECK(queue.Dropped() == 0);
+}
+
+static void TestAligner()
+{
+	AVAligner aligner;
+	QueueConfig config;
+	config.depth = 8;
+
+	size_t audioBytes = 0;
+	int videoFrames = 0;
+	CHECK(aligner.Start(config, 400000, [&](QueuedFrame &bundle) {
+		if (bundle.frame.Valid())
+			videoFrames++;
+		for (const FrameRef &segment : bundle.segments)
+			audioBytes += segment.Size();
+	}));
+
+	/* a video frame waiting for audio that only covers part of it */
+	unsigned char pixels[16] = {};
+	QueuedFrame video;
+	video.frame = FrameRef(CopyFrame(pixels, sizeof(pixels), 0, 333333));
+	aligner.PushVideo(video);
+
+	AudioCoalescer coalescer;
+	coalescer.Reset(CHUNK_MS, SAMPLE_RATE, BLOCK_ALIGN,
+			[&](std::vector<unsigned char> &&chunk,
+			    long long startTime, long long stopTime) {
+				aligner.PushAudio(FrameRef(
+					TakeFrame(std::move(chunk), startTime,
+						  stopTime, coalescer.GetPool())));
+			});
+
+	PushPartialChunk(coalescer);
+	coalescer.Flush();
+	aligner.Stop();
+
+	CHECK(videoFrames == 1);
+	CHECK(audioBytes == PARTIAL_BYTES);
+}
+
+int main()
+{
+	TestQueue();
+	TestAligner();
+
+	return TestResult("audio-flush-test");
+}
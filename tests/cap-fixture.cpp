@@ -0,0 +1,234 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "cap-fixture.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace DShow;
+
+struct FormatName {
+	VideoFormat format;
+	const char *name;
+};
+
+static const FormatName formatNames[] = {
+	{VideoFormat::ARGB, "ARGB"},   {VideoFormat::XRGB, "XRGB"},
+	{VideoFormat::RGB24, "RGB24"}, {VideoFormat::I420, "I420"},
+	{VideoFormat::NV12, "NV12"},   {VideoFormat::YV12, "YV12"},
+	{VideoFormat::Y800, "Y800"},   {VideoFormat::P010, "P010"},
+	{VideoFormat::YVYU, "YVYU"},   {VideoFormat::YUY2, "YUY2"},
+	{VideoFormat::UYVY, "UYVY"},   {VideoFormat::HDYC, "HDYC"},
+	{VideoFormat::MJPEG, "MJPEG"}, {VideoFormat::H264, "H264"},
+	{VideoFormat::HEVC, "HEVC"},
+};
+
+const char *VideoFormatName(VideoFormat format)
+{
+	for (const FormatName &entry : formatNames)
+		if (entry.format == format)
+			return entry.name;
+	return "?";
+}
+
+static bool ParseFormat(const std::string &str, VideoFormat &format)
+{
+	for (const FormatName &entry : formatNames) {
+		if (str == entry.name) {
+			format = entry.format;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool ParseSize(const std::string &str, int &cx, int &cy)
+{
+	char end;
+	return sscanf(str.c_str(), "%dx%d%c", &cx, &cy, &end) == 2 &&
+	       cx > 0 && cy > 0;
+}
+
+static bool ParseInterval(const std::string &str, long long &interval)
+{
+	char *end;
+	double fps = strtod(str.c_str(), &end);
+	if (*end || fps <= 0.0)
+		return false;
+
+	interval = llround(10000000.0 / fps);
+	return true;
+}
+
+/* "a" or "a-b" */
+static void SplitRange(const std::string &str, std::string &min,
+		       std::string &max)
+{
+	size_t dash = str.find('-');
+	min = str.substr(0, dash);
+	max = dash == std::string::npos ? min : str.substr(dash + 1);
+}
+
+static bool ParseCap(std::istringstream &words, VideoInfo &cap)
+{
+	std::string format, size, fps, min, max;
+	if (!(words >> format >> size >> fps))
+		return false;
+
+	cap = {};
+	cap.granularityCX = 1;
+	cap.granularityCY = 1;
+
+	if (!ParseFormat(format, cap.format))
+		return false;
+
+	SplitRange(size, min, max);
+	if (!ParseSize(min, cap.minCX, cap.minCY) ||
+	    !ParseSize(max, cap.maxCX, cap.maxCY))
+		return false;
+
+	/* the highest frame rate is the shortest interval */
+	SplitRange(fps, min, max);
+	if (!ParseInterval(min, cap.maxInterval) ||
+	    !ParseInterval(max, cap.minInterval))
+		return false;
+
+	std::string word;
+	while (words >> word) {
+		if (word != "step" || !(words >> size) ||
+		    !ParseSize(size, cap.granularityCX, cap.granularityCY))
+			return false;
+	}
+
+	cap.bandwidth = EstimateCapBandwidth(cap);
+	return cap.minCX <= cap.maxCX && cap.minCY <= cap.maxCY &&
+	       cap.minInterval <= cap.maxInterval;
+}
+
+static bool ParseExpectation(std::istringstream &words,
+			     CapExpectation &expectation)
+{
+	std::string size, fps, word;
+	if (!(words >> size >> fps) ||
+	    !ParseSize(size, expectation.request.cx, expectation.request.cy) ||
+	    !ParseInterval(fps, expectation.request.frameInterval))
+		return false;
+
+	while (words >> word && word != "->") {
+		if (word == "scale") {
+			expectation.config.scaling = ScaleMode::Bilinear;
+		} else if (word == "to") {
+			if (!(words >> word) ||
+			    !ParseFormat(word, expectation.config.format))
+				return false;
+		} else if (word == "budget") {
+			if (!(words >> expectation.request.bandwidthBudget))
+				return false;
+		} else if (word == "only") {
+			if (!(words >> word) ||
+			    !ParseFormat(word,
+					 expectation.config.internalFormat))
+				return false;
+		} else {
+			return false;
+		}
+	}
+
+	std::string format;
+	return word == "->" && words >> format >> size >> fps &&
+	       ParseFormat(format, expectation.format) &&
+	       ParseSize(size, expectation.cx, expectation.cy) &&
+	       ParseInterval(fps, expectation.frameInterval) &&
+	       !(words >> word);
+}
+
+bool LoadCapFixture(const char *path, CapFixture &fixture)
+{
+	std::ifstream file(path);
+	if (!file) {
+		fprintf(stderr, "%s: could not open\n", path);
+		return false;
+	}
+
+	fixture = CapFixture();
+	fixture.path = path;
+
+	std::string line;
+	int lineNumber = 0;
+
+	while (std::getline(file, line)) {
+		lineNumber++;
+
+		std::istringstream words(line);
+		std::string keyword;
+		if (!(words >> keyword) || keyword[0] == '#')
+			continue;
+
+		bool valid = false;
+		if (keyword == "cap") {
+			VideoInfo cap;
+			valid = ParseCap(words, cap);
+			if (valid)
+				fixture.caps.push_back(cap);
+		} else if (keyword == "expect") {
+			CapExpectation expectation;
+			expectation.line = lineNumber;
+			valid = ParseExpectation(words, expectation);
+			if (valid)
+				fixture.expectations.push_back(expectation);
+		}
+
+		if (!valid) {
+			fprintf(stderr, "%s:%d: invalid line: %s\n", path,
+				lineNumber, line.c_str());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+VideoSelection NegotiateVideoCap(const std::vector<VideoInfo> &caps,
+				 const VideoRequest &request,
+				 const VideoScoreWeights &weights,
+				 const VideoConfig &config)
+{
+	VideoSelection selection;
+
+	for (const VideoInfo &cap : caps) {
+		if (config.internalFormat != VideoFormat::Any &&
+		    config.internalFormat != cap.format)
+			continue;
+
+		const VideoCandidate candidate = FitVideoCap(
+			cap, request, CanScale(config, cap.format));
+		const VideoScore score =
+			ScoreVideoCandidate(request, candidate, weights);
+
+		if (selection.Consider(candidate, score) && score.total == 0.0)
+			break;
+	}
+
+	return selection;
+}
@@ -0,0 +1,62 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "format-score.hpp"
+
+#include <string>
+#include <vector>
+
+/*
+ * Synthetic cap lists modeled on typical devices, and the modes requests
+ * should negotiate to, read from the files in fixtures/caps (see the README
+ * there).
+ */
+
+struct CapExpectation {
+	int line = 0;
+
+	DShow::VideoRequest request;
+	/* scaling, format and internalFormat, as they affect negotiation */
+	DShow::VideoConfig config;
+
+	DShow::VideoFormat format = DShow::VideoFormat::Any;
+	int cx = 0;
+	int cy = 0;
+	long long frameInterval = 0;
+};
+
+struct CapFixture {
+	std::string path;
+	std::vector<DShow::VideoInfo> caps;
+	std::vector<CapExpectation> expectations;
+};
+
+/* Prints what's wrong to stderr and returns false if the file is invalid */
+bool LoadCapFixture(const char *path, CapFixture &fixture);
+
+const char *VideoFormatName(DShow::VideoFormat format);
+
+/* Picks a cap the way GetClosestVideoMediaType does */
+DShow::VideoSelection
+NegotiateVideoCap(const std::vector<DShow::VideoInfo> &caps,
+		  const DShow::VideoRequest &request,
+		  const DShow::VideoScoreWeights &weights,
+		  const DShow::VideoConfig &config);
@@ -0,0 +1,140 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * Cost of ClockModel::Update plus Map per sample, and how far mapped times
+ * land from the actual capture times, over synthetic traces.
+ *
+ * With --csv, prints the jittery trace along with the mapped times instead,
+ * for plotting.
+ */
+
+#include "clock-model.hpp"
+#include "clock-trace.hpp"
+#include "test-util.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DShow;
+
+struct Scenario {
+	const char *name;
+	ClockTraceParams params;
+};
+
+static std::vector<Scenario> GetScenarios(int samples)
+{
+	std::vector<Scenario> scenarios(4);
+
+	scenarios[0].name = "clean";
+
+	scenarios[1].name = "jitter 2ms, drift 200ppm";
+	scenarios[1].params.jitter = 20000;
+	scenarios[1].params.driftPpm = 200.0;
+
+	scenarios[2].name = "jitter 1ms, 3% 30ms outliers";
+	scenarios[2].params.jitter = 10000;
+	scenarios[2].params.outlierRate = 0.03;
+	scenarios[2].params.outlierDelay = 300000;
+
+	scenarios[3].name = "jitter 1ms, clock step";
+	scenarios[3].params.jitter = 10000;
+	scenarios[3].params.stepAt = samples / 2;
+	scenarios[3].params.stepSize = 100000000;
+
+	for (Scenario &scenario : scenarios)
+		scenario.params.samples = samples;
+	return scenarios;
+}
+
+static void PrintCsv(const ClockTraceParams &params)
+{
+	const std::vector<ClockTraceSample> trace = GenerateClockTrace(params);
+	ClockModel model;
+
+	printf("device,host,capture,mapped\n");
+	for (const ClockTraceSample &sample : trace) {
+		model.Update(sample.deviceTime, sample.hostTime);
+		printf("%lld,%lld,%lld,%lld\n", sample.deviceTime,
+		       sample.hostTime, sample.captureTime,
+		       model.Map(sample.deviceTime));
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const bool quick = IsQuickRun(argc, argv);
+	const int samples = quick ? 20000 : 1000000;
+	std::vector<Scenario> scenarios = GetScenarios(samples);
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--csv") == 0) {
+			scenarios[1].params.samples = 3000;
+			PrintCsv(scenarios[1].params);
+			return 0;
+		}
+	}
+
+	printf("%-30s %10s %12s %12s %10s\n", "trace", "ns/sample",
+	       "mean err us", "p99 err us", "rejected");
+
+	for (const Scenario &scenario : scenarios) {
+		const ClockTraceParams &p = scenario.params;
+		const std::vector<ClockTraceSample> trace =
+			GenerateClockTrace(p);
+		std::vector<long long> mapped(trace.size());
+		ClockModel model;
+
+		Stopwatch watch;
+		for (size_t i = 0; i < trace.size(); i++) {
+			model.Update(trace[i].deviceTime, trace[i].hostTime);
+			mapped[i] = model.Map(trace[i].deviceTime);
+		}
+		double seconds = watch.Seconds();
+
+		/* errors against the capture time plus the mean delay, after
+		 * the first fit window */
+		const double meanDelay =
+			(double)p.latency + (double)p.jitter / 2.0;
+		std::vector<double> errors;
+		double sum = 0.0;
+
+		for (size_t i = 256; i < trace.size(); i++) {
+			double error = std::fabs(
+				(double)(mapped[i] - trace[i].captureTime) -
+				meanDelay);
+			errors.push_back(error);
+			sum += error;
+		}
+
+		std::sort(errors.begin(), errors.end());
+		double p99 = errors[errors.size() * 99 / 100];
+
+		printf("%-30s %10.1f %12.1f %12.1f %10lld\n", scenario.name,
+		       seconds * 1e9 / (double)trace.size(),
+		       sum / (double)errors.size() / 10.0, p99 / 10.0,
+		       model.Rejected());
+
+		CHECK(std::is_sorted(mapped.begin(), mapped.end()));
+		Consume(mapped.back());
+	}
+
+	return TestResult("clock-model-bench");
+}
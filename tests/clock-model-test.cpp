@@ -0,0 +1,170 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "clock-model.hpp"
+#include "clock-trace.hpp"
+#include "test-util.hpp"
+
+#include <cmath>
+
+using namespace DShow;
+
+struct TraceResult {
+	/* mapped time minus capture time minus the mean delay, after the
+	 * warm-up */
+	double maxError = 0.0;
+	/* deviation of mapped intervals from the frame interval */
+	double intervalDeviation = 0.0;
+	double rateErrorPpm = 0.0;
+	long long rejected = 0;
+	int outliers = 0;
+	bool monotonic = true;
+};
+
+static TraceResult RunTrace(const ClockTraceParams &p, int warmup,
+			    int settle = 0)
+{
+	const std::vector<ClockTraceSample> trace = GenerateClockTrace(p);
+	const double meanDelay = (double)p.latency + (double)p.jitter / 2.0;
+	ClockModel model;
+	TraceResult result;
+	double sumSq = 0.0;
+	int intervals = 0;
+	long long lastMapped = 0;
+
+	for (size_t i = 0; i < trace.size(); i++) {
+		const ClockTraceSample &sample = trace[i];
+		model.Update(sample.deviceTime, sample.hostTime);
+		long long mapped = model.Map(sample.deviceTime);
+
+		if (i > 0 && mapped < lastMapped)
+			result.monotonic = false;
+
+		const bool settling = p.stepAt >= 0 && (int)i >= p.stepAt &&
+				      (int)i < p.stepAt + settle;
+
+		if ((int)i >= warmup && !settling) {
+			double error = (double)(mapped - sample.captureTime) -
+				       meanDelay;
+			result.maxError =
+				std::fmax(result.maxError, std::fabs(error));
+
+			double interval = (double)(mapped - lastMapped) -
+					  (double)p.frameInterval;
+			sumSq += interval * interval;
+			intervals++;
+		}
+
+		if (sample.outlier)
+			result.outliers++;
+		lastMapped = mapped;
+	}
+
+	const double rate = 1.0 + p.driftPpm * 1e-6;
+	result.rateErrorPpm = std::fabs(model.Rate() * rate - 1.0) * 1e6;
+	result.intervalDeviation = intervals ? std::sqrt(sumSq / intervals)
+					     : 0.0;
+	result.rejected = model.Rejected();
+	return result;
+}
+
+static void TestUnmapped()
+{
+	ClockModel model;
+	CHECK(!model.Valid());
+	CHECK(model.Map(12345) == 12345);
+
+	model.Update(1000000, 5000000);
+	CHECK(model.Valid());
+	CHECK(model.Map(1000000) == 5000000);
+
+	model.Reset();
+	CHECK(!model.Valid());
+}
+
+static void TestIdeal()
+{
+	ClockTraceParams p;
+	TraceResult r = RunTrace(p, 8);
+
+	CHECK(r.monotonic);
+	CHECK(r.maxError <= 2.0);
+	CHECK(r.intervalDeviation <= 2.0);
+	CHECK(r.rejected == 0);
+}
+
+/* 2 ms of arrival jitter and a clock 200 ppm fast */
+static void TestJitterAndDrift()
+{
+	ClockTraceParams p;
+	p.jitter = 20000;
+	p.driftPpm = 200.0;
+	TraceResult r = RunTrace(p, 300);
+
+	CHECK(r.monotonic);
+	CHECK(r.rateErrorPpm < 20.0);
+	CHECK(r.maxError < 5000.0);
+
+	/* uniform jitter has a deviation of jitter / sqrt(12), mapped
+	 * intervals should be a small fraction of that */
+	CHECK(r.intervalDeviation < 20000.0 / std::sqrt(12.0) / 10.0);
+	CHECK(r.rejected == 0);
+}
+
+/* 3% of the samples arrive 30 ms late */
+static void TestOutliers()
+{
+	ClockTraceParams p;
+	p.jitter = 10000;
+	p.driftPpm = -100.0;
+	p.outlierRate = 0.03;
+	p.outlierDelay = 300000;
+	TraceResult r = RunTrace(p, 300);
+
+	CHECK(r.monotonic);
+	CHECK(r.rateErrorPpm < 20.0);
+	CHECK(r.maxError < 5000.0);
+	CHECK(r.rejected >= r.outliers * 9 / 10);
+}
+
+/* the device clock jumps, the mapping has to stay monotonic and settle on
+ * the new clock shortly after */
+static void TestStep(long long stepSize)
+{
+	ClockTraceParams p;
+	p.jitter = 10000;
+	p.stepAt = 1500;
+	p.stepSize = stepSize;
+	TraceResult r = RunTrace(p, 300, 100);
+
+	CHECK(r.monotonic);
+	CHECK(r.maxError < 20000.0);
+}
+
+int main()
+{
+	TestUnmapped();
+	TestIdeal();
+	TestJitterAndDrift();
+	TestOutliers();
+	TestStep(100000000);
+	TestStep(-100000000);
+
+	return TestResult("clock-model-test");
+}
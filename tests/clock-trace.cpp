@@ -0,0 +1,62 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#include "clock-trace.hpp"
+
+#include <random>
+
+/* host time of the first capture, far from 0 like a real uptime */
+#define HOST_START 360000000000LL
+
+std::vector<ClockTraceSample> GenerateClockTrace(const ClockTraceParams &p)
+{
+	std::mt19937 rng(p.seed);
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	std::vector<ClockTraceSample> trace;
+	trace.reserve((size_t)p.samples);
+
+	const double rate = 1.0 + p.driftPpm * 1e-6;
+	long long step = 0;
+
+	for (int i = 0; i < p.samples; i++) {
+		ClockTraceSample sample;
+		sample.captureTime = HOST_START + (long long)i * p.frameInterval;
+
+		if (i == p.stepAt)
+			step = p.stepSize;
+
+		sample.deviceTime = p.deviceEpoch + step +
+				    (long long)((double)sample.captureTime *
+						rate);
+
+		long long delay = p.latency;
+		if (p.jitter > 0)
+			delay += (long long)(uniform(rng) * (double)p.jitter);
+
+		sample.outlier = p.outlierRate > 0.0 &&
+				 uniform(rng) < p.outlierRate;
+		if (sample.outlier)
+			delay += p.outlierDelay;
+
+		sample.hostTime = sample.captureTime + delay;
+		trace.push_back(sample);
+	}
+
+	return trace;
+}
@@ -0,0 +1,64 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include <vector>
+
+/*
+ * Synthetic timestamp traces for the clock model: a device clock with its
+ * own epoch and drift, sampled at a fixed rate, and host arrival times with
+ * latency, jitter, late outliers (scheduling stalls) and optionally a step
+ * of the device clock.  All times are in 100-nanosecond units.
+ */
+
+struct ClockTraceParams {
+	long long frameInterval = 333333;
+	int samples = 3000;
+
+	/* device clock at host time 0, and its rate error */
+	long long deviceEpoch = 12345678900000LL;
+	double driftPpm = 0.0;
+
+	/* arrival = capture + latency + jitter, jitter is uniform in
+	 * [0, jitter) */
+	long long latency = 20000;
+	long long jitter = 0;
+
+	/* fraction of samples arriving outlierDelay later than that */
+	double outlierRate = 0.0;
+	long long outlierDelay = 0;
+
+	/* device clock jumps by stepSize at sample stepAt, if >= 0 */
+	int stepAt = -1;
+	long long stepSize = 0;
+
+	unsigned seed = 1;
+};
+
+struct ClockTraceSample {
+	long long deviceTime;
+	long long hostTime;
+
+	/* host time the sample was actually captured at */
+	long long captureTime;
+	bool outlier;
+};
+
+std::vector<ClockTraceSample> GenerateClockTrace(const ClockTraceParams &p);
@@ -0,0 +1,249 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * Stress test of SnapshotSlot, using a model of the way HDevice publishes
+ * and reads its configuration rather than HDevice itself (which needs
+ * DirectShow).  It shows that the protocol holds up, not that
+ * HDevice::Receive follows it: StressDevice mirrors PublishConfig and
+ * GetConfig by hand, and has to be kept in line with them.
+ *
+ * Video and audio "streaming threads" deliver samples through whatever
+ * snapshot is current, while control threads and the video streaming thread
+ * itself (standing in for mid-stream format changes) keep publishing new
+ * configurations, serialized by a mutex the way HDevice does with
+ * configMutex.  Every sample has to be delivered, every callback has to see
+ * the config it was published with, and every replaced snapshot has to be
+ * freed.
+ */
+
+#include "../dshowcapture.hpp"
+#include "snapshot-slot.hpp"
+#include "test-util.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace DShow;
+
+#define CONTROL_THREADS 2
+
+/* a format change from the streaming thread every this many samples */
+#define FORMAT_CHANGE_INTERVAL 1000
+
+static std::atomic<long> liveSnapshots{0};
+
+struct ConfigSnapshot {
+	VideoConfig video;
+	AudioConfig audio;
+
+	ConfigSnapshot() { liveSnapshots++; }
+	ConfigSnapshot(const ConfigSnapshot &) = delete;
+	~ConfigSnapshot() { liveSnapshots--; }
+};
+
+struct StreamCounters {
+	std::atomic<long long> produced{0};
+	std::atomic<long long> delivered{0};
+	std::atomic<long long> torn{0};
+	std::atomic<long long> stale{0};
+};
+
+class StressDevice {
+	std::mutex configMutex;
+	VideoConfig videoConfig;
+	AudioConfig audioConfig;
+	SnapshotSlot<ConfigSnapshot> snapshot;
+
+	long long generation = 0;
+
+	void PublishConfig()
+	{
+		std::shared_ptr<ConfigSnapshot> config =
+			std::make_shared<ConfigSnapshot>();
+		config->video = videoConfig;
+		config->audio = audioConfig;
+		snapshot.Publish(config);
+	}
+
+public:
+	StreamCounters video;
+	StreamCounters audio;
+	std::atomic<long long> reconfigurations{0};
+
+	StressDevice() { Reconfigure(); }
+
+	inline std::shared_ptr<const ConfigSnapshot> GetConfig() const
+	{
+		return snapshot.Load();
+	}
+
+	/* every field a callback checks is derived from the generation, so
+	 * a config mixing two generations is detected */
+	void Reconfigure()
+	{
+		std::lock_guard<std::mutex> lock(configMutex);
+		const long long gen = ++generation;
+
+		videoConfig.cx = (int)gen;
+		videoConfig.cy_abs = (int)gen * 2;
+		videoConfig.frameInterval = gen * 3;
+		videoConfig.callback = [this, gen](const VideoConfig &config,
+						   unsigned char *, size_t,
+						   long long, long long,
+						   long) {
+			if (config.cx != (int)gen ||
+			    config.cy_abs != (int)gen * 2 ||
+			    config.frameInterval != gen * 3)
+				video.torn++;
+			video.delivered++;
+		};
+
+		audioConfig.sampleRate = (int)gen;
+		audioConfig.channels = (int)(gen % 8) + 1;
+		audioConfig.callback = [this, gen](const AudioConfig &config,
+						   unsigned char *, size_t,
+						   long long, long long) {
+			if (config.sampleRate != (int)gen ||
+			    config.channels != (int)(gen % 8) + 1)
+				audio.torn++;
+			audio.delivered++;
+		};
+
+		PublishConfig();
+		reconfigurations++;
+	}
+
+	/* same pattern as HDevice::Receive */
+	void Receive(bool isVideo, unsigned char *data, size_t size,
+		     long long time, long long &lastGen)
+	{
+		std::shared_ptr<const ConfigSnapshot> config = GetConfig();
+		StreamCounters &counters = isVideo ? video : audio;
+		counters.produced++;
+
+		long long gen = isVideo ? config->video.cx
+					: config->audio.sampleRate;
+		if (gen < lastGen)
+			counters.stale++;
+		lastGen = gen;
+
+		if (isVideo)
+			config->video.callback(config->video, data, size, time,
+					       time + 1, 0);
+		else
+			config->audio.callback(config->audio, data, size, time,
+					       time + 1);
+	}
+};
+
+int main(int argc, char **argv)
+{
+	const bool quick = IsQuickRun(argc, argv);
+	const long long samples = quick ? 200000 : 5000000;
+	const long long minReconfigurations = quick ? 5000 : 100000;
+
+	double readSeconds = 0.0;
+	double totalSeconds;
+
+	{
+		StressDevice device;
+		std::atomic<bool> streaming{true};
+		std::atomic<long long> nanoseconds{0};
+		std::vector<std::thread> threads;
+		Stopwatch total;
+
+		/* streaming threads run until they have delivered enough
+		 * samples and seen enough reconfigurations */
+		for (bool isVideo : {true, false}) {
+			threads.emplace_back([&, isVideo] {
+				unsigned char data[64] = {};
+				long long lastGen = 0;
+				Stopwatch watch;
+
+				for (long long i = 0;
+				     i < samples ||
+				     device.reconfigurations <
+					     minReconfigurations;
+				     i++) {
+					device.Receive(isVideo, data,
+						       sizeof(data), i,
+						       lastGen);
+
+					if (isVideo &&
+					    i % FORMAT_CHANGE_INTERVAL == 0)
+						device.Reconfigure();
+				}
+
+				nanoseconds += (long long)(watch.Seconds() *
+							   1e9);
+			});
+		}
+
+		std::vector<std::thread> control;
+		for (int i = 0; i < CONTROL_THREADS; i++) {
+			control.emplace_back([&] {
+				while (streaming)
+					device.Reconfigure();
+			});
+		}
+
+		for (std::thread &thread : threads)
+			thread.join();
+
+		streaming = false;
+		for (std::thread &thread : control)
+			thread.join();
+
+		totalSeconds = total.Seconds();
+		readSeconds = (double)nanoseconds / 1e9;
+
+		for (StreamCounters *counters : {&device.video, &device.audio}) {
+			CHECK(counters->produced >= samples);
+			CHECK(counters->delivered == counters->produced);
+			CHECK(counters->torn == 0);
+			CHECK(counters->stale == 0);
+		}
+
+		CHECK(device.reconfigurations >= minReconfigurations);
+
+		/* only the current snapshot is left once nobody reads */
+		CHECK(liveSnapshots == 1);
+
+		long long delivered = device.video.delivered +
+				      device.audio.delivered;
+		long long produced = device.video.produced +
+				     device.audio.produced;
+
+		printf("samples:            %lld produced, %lld delivered, "
+		       "%lld lost\n",
+		       produced, delivered, produced - delivered);
+		printf("reconfigurations:   %lld (%.0f/s)\n",
+		       (long long)device.reconfigurations,
+		       (double)device.reconfigurations / totalSeconds);
+		printf("per sample:         %.1f ns (snapshot load and "
+		       "callback)\n",
+		       readSeconds * 1e9 / (double)produced);
+	}
+
+	CHECK(liveSnapshots == 0);
+	return TestResult("config-snapshot-stress");
+}
@@ -0,0 +1,228 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * Checks the P010 to NV12 (dithered), I010 and P016 kernels: known values
+ * through the scalar kernels, and every SIMD level the CPU supports against
+ * the scalar kernels over odd sizes, widths around the vector lengths, and
+ * frames converted in slices.
+ */
+
+#include "convert-test-util.hpp"
+
+using namespace DShow;
+
+static const VideoFormat outputs[] = {VideoFormat::NV12, VideoFormat::I010,
+				      VideoFormat::P016};
+
+static const int widths[] = {1,  2,  3,  7,  8,  9,   15,  16,  17,
+			     31, 32, 33, 63, 64, 65, 127, 129, 1921};
+static const int heights[] = {1, 2, 3, 4, 5, 17};
+
+static const char *FormatName(VideoFormat format)
+{
+	switch (format) {
+	case VideoFormat::NV12:
+		return "NV12";
+	case VideoFormat::I010:
+		return "I010";
+	default:
+		return "P016";
+	}
+}
+
+/* every sample of the source set to one 10-bit luma and chroma value */
+static TestImage MakeFlat(int cx, int cy, unsigned short luma,
+			  unsigned short chroma)
+{
+	TestImage src(VideoFormat::P010, cx, cy);
+
+	for (int plane = 0; plane < 2; plane++) {
+		const unsigned short value =
+			(unsigned short)((plane ? chroma : luma) << 6);
+		const int words = (int)src.RowBytes(plane) / 2;
+
+		for (int y = 0; y < src.Rows(plane); y++)
+			for (int x = 0; x < words; x++)
+				WriteWord(src.Row(plane, y), x, value);
+	}
+
+	return src;
+}
+
+static TestImage Convert(ConvertProc proc, const TestImage &src,
+			 VideoFormat to, int cx, int cy, int sliceRows = 0)
+{
+	TestImage dst(to, cx, cy);
+	ConvertFrame frame = {};
+	src.AttachSource(frame);
+	dst.AttachDest(frame);
+	frame.cx = cx;
+	frame.cy = cy;
+
+	RunConvert(proc, frame, sliceRows);
+	return dst;
+}
+
+/* whether every sample of a plane is the given value */
+static bool PlaneIs(const TestImage &image, int plane, bool words,
+		    unsigned value)
+{
+	const int count = (int)image.RowBytes(plane) / (words ? 2 : 1);
+
+	for (int y = 0; y < image.Rows(plane); y++) {
+		const unsigned char *row = image.Row(plane, y);
+		for (int x = 0; x < count; x++) {
+			unsigned got = words ? ReadWord(row, x) : row[x];
+			if (got != value)
+				return false;
+		}
+	}
+	return true;
+}
+
+static void TestKnownValues(CpuLevel level)
+{
+	/* enough rows and columns for every dither threshold */
+	const int cx = 37, cy = 9;
+
+	ConvertProc nv12 = GetP010Kernel(VideoFormat::P010, VideoFormat::NV12,
+					 level);
+	ConvertProc i010 = GetP010Kernel(VideoFormat::P010, VideoFormat::I010,
+					 level);
+	ConvertProc p016 = GetP010Kernel(VideoFormat::P010, VideoFormat::P016,
+					 level);
+
+	/* video white and black, neutral chroma; the dither never carries a
+	 * value aligned to 8 bits over to the next one */
+	TestImage white = MakeFlat(cx, cy, 940, 512);
+	TestImage black = MakeFlat(cx, cy, 64, 512);
+	TestImage full = MakeFlat(cx, cy, 1023, 1023);
+
+	TestImage out = Convert(nv12, white, VideoFormat::NV12, cx, cy);
+	CHECK(PlaneIs(out, 0, false, 235));
+	CHECK(PlaneIs(out, 1, false, 128));
+	CHECK(out.GuardsIntact());
+
+	out = Convert(nv12, black, VideoFormat::NV12, cx, cy);
+	CHECK(PlaneIs(out, 0, false, 16));
+
+	/* saturates instead of wrapping around */
+	out = Convert(nv12, full, VideoFormat::NV12, cx, cy);
+	CHECK(PlaneIs(out, 0, false, 255));
+	CHECK(PlaneIs(out, 1, false, 255));
+
+	out = Convert(i010, white, VideoFormat::I010, cx, cy);
+	CHECK(PlaneIs(out, 0, true, 940));
+	CHECK(PlaneIs(out, 1, true, 512));
+	CHECK(PlaneIs(out, 2, true, 512));
+	CHECK(out.GuardsIntact());
+
+	out = Convert(p016, full, VideoFormat::P016, cx, cy);
+	CHECK(PlaneIs(out, 0, true, 0xffff));
+	CHECK(PlaneIs(out, 1, true, 0xffff));
+
+	/* 940 << 6 | 940 >> 4 */
+	out = Convert(p016, white, VideoFormat::P016, cx, cy);
+	CHECK(PlaneIs(out, 0, true, (940 << 6) | (940 >> 4)));
+	CHECK(out.GuardsIntact());
+}
+
+/* a ramp that crosses every 8-bit step shows the dither pattern: over a
+ * 4x4 block, the average has to stay within half a step of the input */
+static void TestDither()
+{
+	const int cx = 64, cy = 4;
+	ConvertProc nv12 = GetP010Kernel(VideoFormat::P010, VideoFormat::NV12,
+					 CpuLevel::Scalar);
+
+	bool ok = true;
+	for (unsigned short value = 0; value < 1020; value++) {
+		TestImage src = MakeFlat(cx, cy, value, 512);
+		TestImage out = Convert(nv12, src, VideoFormat::NV12, cx, cy);
+
+		int sum = 0;
+		for (int y = 0; y < 4; y++)
+			for (int x = 0; x < 4; x++)
+				sum += out.Row(0, y)[x];
+
+		const double average = sum / 16.0;
+		const double expected = value / 4.0;
+		if (average < expected - 0.5 || average > expected + 0.5)
+			ok = false;
+	}
+	CHECK(ok);
+}
+
+static void TestLevel(CpuLevel level)
+{
+	for (VideoFormat to : outputs) {
+		ConvertProc scalar = GetP010Kernel(VideoFormat::P010, to,
+						   CpuLevel::Scalar);
+		ConvertProc simd = GetP010Kernel(VideoFormat::P010, to, level);
+		CHECK(scalar && simd);
+		if (!scalar || !simd)
+			continue;
+
+		for (int cx : widths) {
+			for (int cy : heights) {
+				TestImage src(VideoFormat::P010, cx, cy);
+				src.Fill((unsigned)(cx * 31 + cy));
+
+				TestImage expected =
+					Convert(scalar, src, to, cx, cy);
+				TestImage whole =
+					Convert(simd, src, to, cx, cy);
+				TestImage sliced =
+					Convert(simd, src, to, cx, cy, 2);
+
+				bool ok = expected.GuardsIntact() &&
+					  whole.SameAs(expected) &&
+					  sliced.SameAs(expected);
+				if (!ok)
+					fprintf(stderr,
+						"%s: P010 to %s, %dx%d "
+						"differs\n",
+						CpuLevelName(level),
+						FormatName(to), cx, cy);
+				CHECK(ok);
+			}
+		}
+	}
+}
+
+int main()
+{
+	const std::vector<CpuLevel> levels = GetTestLevels();
+
+	TestKnownValues(CpuLevel::Scalar);
+	TestDither();
+
+	for (CpuLevel level : levels) {
+		TestKnownValues(level);
+		TestLevel(level);
+	}
+
+	CHECK(!GetP010Kernel(VideoFormat::NV12, VideoFormat::NV12,
+			     CpuLevel::Scalar));
+	CHECK(!GetP010Kernel(VideoFormat::P010, VideoFormat::I420,
+			     CpuLevel::Scalar));
+
+	return TestResult("convert-p010-test");
+}
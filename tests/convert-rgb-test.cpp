@@ -0,0 +1,487 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * Checks the RGB kernels: RGB24 to XRGB, and XRGB to NV12/I420 for every
+ * matrix and range against a floating point reference, with the odd width
+ * and height edges, bottom-up sources, and every SIMD level the CPU supports
+ * against the scalar kernels.
+ */
+
+#include "convert-test-util.hpp"
+
+#include <math.h>
+
+using namespace DShow;
+
+static const ColorMatrix matrices[] = {ColorMatrix::BT601, ColorMatrix::BT709,
+				       ColorMatrix::BT2020};
+static const ColorRange ranges[] = {ColorRange::Limited, ColorRange::Full};
+static const VideoFormat outputs[] = {VideoFormat::NV12, VideoFormat::I420};
+
+static const int widths[] = {1,  2,  3,  7,  8,  9,  15, 16,  17,
+			     18, 31, 32, 33, 47, 48, 49, 127, 1921};
+static const int heights[] = {1, 2, 3, 4, 5, 17};
+
+struct Rgb {
+	unsigned char r, g, b;
+};
+
+struct Yuv {
+	int y, u, v;
+};
+
+static const char *MatrixName(ColorMatrix matrix)
+{
+	switch (matrix) {
+	case ColorMatrix::BT601:
+		return "BT601";
+	case ColorMatrix::BT709:
+		return "BT709";
+	default:
+		return "BT2020";
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void SetPixel(TestImage &image, int x, int y, Rgb color)
+{
+	unsigned char *p = image.Row(0, y) + x * 4;
+	p[0] = color.b;
+	p[1] = color.g;
+	p[2] = color.r;
+	p[3] = 0xff;
+}
+
+static TestImage MakeSolid(int cx, int cy, Rgb color)
+{
+	TestImage image(VideoFormat::XRGB, cx, cy);
+	for (int y = 0; y < cy; y++)
+		for (int x = 0; x < cx; x++)
+			SetPixel(image, x, y, color);
+	return image;
+}
+
+static TestImage Convert(ConvertProc proc, const TestImage &src,
+			 VideoFormat to, int cx, int cy, bool flip = false,
+			 int sliceRows = 0)
+{
+	TestImage dst(to, cx, cy);
+	ConvertFrame frame = {};
+	src.AttachSource(frame, flip);
+	dst.AttachDest(frame);
+	frame.cx = cx;
+	frame.cy = cy;
+
+	RunConvert(proc, frame, sliceRows);
+	return dst;
+}
+
+static ConvertProc GetKernel(VideoFormat to, ColorMatrix matrix,
+			     ColorRange range, CpuLevel level)
+{
+	return GetRgbKernel(VideoFormat::XRGB, to, matrix, range, level);
+}
+
+static int Luma(const TestImage &image, int x, int y)
+{
+	return image.Row(0, y)[x];
+}
+
+static int ChromaU(const TestImage &image, VideoFormat format, int x, int y)
+{
+	return format == VideoFormat::NV12 ? image.Row(1, y)[x * 2]
+					   : image.Row(1, y)[x];
+}
+
+static int ChromaV(const TestImage &image, VideoFormat format, int x, int y)
+{
+	return format == VideoFormat::NV12 ? image.Row(1, y)[x * 2 + 1]
+					   : image.Row(2, y)[x];
+}
+
+/* ------------------------------------------------------------------------- */
+/* Floating point reference                                                  */
+
+struct Reference {
+	double kr, kb, kg;
+	double ys, cs, yOffset;
+
+	Reference(ColorMatrix matrix, ColorRange range)
+	{
+		kr = matrix == ColorMatrix::BT601   ? 0.299
+		     : matrix == ColorMatrix::BT709 ? 0.2126
+						    : 0.2627;
+		kb = matrix == ColorMatrix::BT601   ? 0.114
+		     : matrix == ColorMatrix::BT709 ? 0.0722
+						    : 0.0593;
+		kg = 1.0 - kr - kb;
+
+		const bool full = range == ColorRange::Full;
+		ys = full ? 1.0 : 219.0 / 255.0;
+		cs = full ? 1.0 : 224.0 / 255.0;
+		yOffset = full ? 0.0 : 16.0;
+	}
+
+	double Luma(const unsigned char *p) const
+	{
+		return yOffset + ys * (kb * p[0] + kg * p[1] + kr * p[2]);
+	}
+
+	/* from the average of the pixels in a 2x2 block */
+	void Chroma(const unsigned char *p[4], double &u, double &v) const
+	{
+		double b = 0.0, g = 0.0, r = 0.0;
+		for (int i = 0; i < 4; i++) {
+			b += p[i][0] / 4.0;
+			g += p[i][1] / 4.0;
+			r += p[i][2] / 4.0;
+		}
+
+		const double l = kb * b + kg * g + kr * r;
+		u = 128.0 + cs / (2.0 * (1.0 - kb)) * (b - l);
+		v = 128.0 + cs / (2.0 * (1.0 - kr)) * (r - l);
+	}
+};
+
+static bool Near(int got, double expected)
+{
+	const double clamped = std::min(std::max(expected, 0.0), 255.0);
+	return fabs(got - clamped) <= 1.0;
+}
+
+/* the last column and row of odd sizes are paired with themselves */
+static bool MatchesReference(const TestImage &src, const TestImage &out,
+			     VideoFormat format, int cx, int cy,
+			     const Reference &ref)
+{
+	for (int y = 0; y < cy; y++)
+		for (int x = 0; x < cx; x++)
+			if (!Near(Luma(out, x, y),
+				  ref.Luma(src.Row(0, y) + x * 4)))
+				return false;
+
+	for (int y = 0; y < cy; y += 2) {
+		const int y1 = std::min(y + 1, cy - 1);
+
+		for (int x = 0; x < cx; x += 2) {
+			const int x1 = std::min(x + 1, cx - 1);
+			const unsigned char *p[4] = {
+				src.Row(0, y) + x * 4, src.Row(0, y) + x1 * 4,
+				src.Row(0, y1) + x * 4,
+				src.Row(0, y1) + x1 * 4};
+
+			double u, v;
+			ref.Chroma(p, u, v);
+			if (!Near(ChromaU(out, format, x / 2, y / 2), u) ||
+			    !Near(ChromaV(out, format, x / 2, y / 2), v))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* BT.709 limited range values of black, white and the primaries */
+static void TestPrimaries(CpuLevel level)
+{
+	static const struct {
+		Rgb rgb;
+		Yuv yuv;
+	} colors[] = {
+		{{0, 0, 0}, {16, 128, 128}},     {{255, 255, 255}, {235, 128, 128}},
+		{{255, 0, 0}, {63, 102, 240}},   {{0, 255, 0}, {173, 42, 26}},
+		{{0, 0, 255}, {32, 240, 118}},
+	};
+
+	/* wide enough for a full vector and a tail */
+	const int cx = 34, cy = 4;
+
+	for (VideoFormat to : outputs) {
+		ConvertProc proc = GetKernel(to, ColorMatrix::BT709,
+					     ColorRange::Limited, level);
+
+		for (const auto &color : colors) {
+			TestImage src = MakeSolid(cx, cy, color.rgb);
+			TestImage out = Convert(proc, src, to, cx, cy);
+
+			bool ok = out.GuardsIntact();
+			for (int y = 0; y < cy; y++)
+				for (int x = 0; x < cx; x++)
+					ok = ok && Luma(out, x, y) ==
+							   color.yuv.y;
+			for (int y = 0; y < cy / 2; y++) {
+				for (int x = 0; x < cx / 2; x++) {
+					ok = ok && ChromaU(out, to, x, y) ==
+							   color.yuv.u;
+					ok = ok && ChromaV(out, to, x, y) ==
+							   color.yuv.v;
+				}
+			}
+			CHECK(ok);
+		}
+	}
+}
+
+/* random frames of odd sizes, every matrix and range */
+static void TestReference()
+{
+	for (ColorMatrix matrix : matrices) {
+		for (ColorRange range : ranges) {
+			const Reference ref(matrix, range);
+
+			for (VideoFormat to : outputs) {
+				ConvertProc proc = GetKernel(to, matrix, range,
+							     CpuLevel::Scalar);
+
+				for (int cx : {1, 2, 3, 17}) {
+					for (int cy : {1, 2, 3, 5}) {
+						TestImage src(VideoFormat::XRGB,
+							      cx, cy);
+						src.Fill((unsigned)(cx * 7 +
+								    cy));
+						TestImage out = Convert(
+							proc, src, to, cx, cy);
+
+						bool ok = MatchesReference(
+							src, out, to, cx, cy,
+							ref);
+						if (!ok)
+							fprintf(stderr,
+								"%s %s: %dx%d "
+								"differs from "
+								"the reference\n",
+								MatrixName(
+									matrix),
+								range == ColorRange::Full
+									? "full"
+									: "limited",
+								cx, cy);
+						CHECK(ok);
+					}
+				}
+			}
+		}
+	}
+}
+
+/*
+ * A red last column and row next to blue: with an odd width the last chroma
+ * sample covers only the red column, with an odd height the last chroma row
+ * covers only the red row.
+ */
+static void TestOddEdges()
+{
+	const Rgb red = {255, 0, 0};
+	const Rgb blue = {0, 0, 255};
+	const int cx = 19, cy = 7;
+
+	for (VideoFormat to : outputs) {
+		ConvertProc proc = GetKernel(to, ColorMatrix::BT709,
+					     ColorRange::Limited,
+					     CpuLevel::Scalar);
+
+		TestImage src = MakeSolid(cx, cy, blue);
+		for (int y = 0; y < cy; y++)
+			SetPixel(src, cx - 1, y, red);
+		for (int x = 0; x < cx; x++)
+			SetPixel(src, x, cy - 1, red);
+
+		TestImage out = Convert(proc, src, to, cx, cy);
+		CHECK(out.GuardsIntact());
+
+		for (int y = 0; y < cy / 2; y++) {
+			CHECK(ChromaU(out, to, cx / 2, y) == 102);
+			CHECK(ChromaV(out, to, cx / 2, y) == 240);
+			CHECK(ChromaU(out, to, 0, y) == 240);
+			CHECK(ChromaV(out, to, 0, y) == 118);
+		}
+		for (int x = 0; x <= cx / 2; x++) {
+			CHECK(ChromaU(out, to, x, cy / 2) == 102);
+			CHECK(ChromaV(out, to, x, cy / 2) == 240);
+		}
+
+		CHECK(Luma(out, cx - 1, 0) == 63);
+		CHECK(Luma(out, 0, cy - 1) == 63);
+		CHECK(Luma(out, 0, 0) == 32);
+	}
+}
+
+/* a negative pitch converts the same as the frame flipped beforehand */
+static void TestFlip()
+{
+	const int cx = 37, cy = 9;
+
+	TestImage src(VideoFormat::XRGB, cx, cy);
+	src.Fill(99);
+
+	TestImage flipped(VideoFormat::XRGB, cx, cy);
+	for (int y = 0; y < cy; y++)
+		memcpy(flipped.Row(0, y), src.Row(0, cy - 1 - y), cx * 4);
+
+	for (VideoFormat to : outputs) {
+		ConvertProc proc = GetKernel(to, ColorMatrix::BT709,
+					     ColorRange::Limited,
+					     CpuLevel::Scalar);
+
+		TestImage expected = Convert(proc, flipped, to, cx, cy);
+		TestImage out = Convert(proc, src, to, cx, cy, true);
+		CHECK(out.SameAs(expected));
+	}
+
+	ConvertProc rgb24 = GetRgbKernel(VideoFormat::RGB24, VideoFormat::XRGB,
+					 ColorMatrix::BT709,
+					 ColorRange::Limited, CpuLevel::Scalar);
+	TestImage src24(VideoFormat::RGB24, cx, cy);
+	src24.Fill(5);
+
+	TestImage out = Convert(rgb24, src24, VideoFormat::XRGB, cx, cy, true);
+	bool ok = true;
+	for (int y = 0; y < cy; y++)
+		for (int x = 0; x < cx; x++)
+			ok = ok && memcmp(out.Row(0, y) + x * 4,
+					  src24.Row(0, cy - 1 - y) + x * 3,
+					  3) == 0;
+	CHECK(ok);
+}
+
+static void TestRgb24()
+{
+	const int cx = 13, cy = 3;
+	ConvertProc proc = GetRgbKernel(VideoFormat::RGB24, VideoFormat::XRGB,
+					ColorMatrix::BT709, ColorRange::Limited,
+					CpuLevel::Scalar);
+
+	TestImage src(VideoFormat::RGB24, cx, cy);
+	src.Fill(3);
+	TestImage out = Convert(proc, src, VideoFormat::XRGB, cx, cy);
+
+	bool ok = out.GuardsIntact();
+	for (int y = 0; y < cy; y++) {
+		for (int x = 0; x < cx; x++) {
+			const unsigned char *s = src.Row(0, y) + x * 3;
+			const unsigned char *d = out.Row(0, y) + x * 4;
+			ok = ok && d[0] == s[0] && d[1] == s[1] &&
+			     d[2] == s[2] && d[3] == 0xff;
+		}
+	}
+	CHECK(ok);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool SameAsScalar(ConvertProc scalar, ConvertProc simd, VideoFormat from,
+			 VideoFormat to, int cx, int cy)
+{
+	TestImage src(from, cx, cy);
+	src.Fill((unsigned)(cx * 31 + cy));
+
+	for (bool flip : {false, true}) {
+		TestImage expected = Convert(scalar, src, to, cx, cy, flip);
+		TestImage whole = Convert(simd, src, to, cx, cy, flip);
+		TestImage sliced = Convert(simd, src, to, cx, cy, flip, 2);
+
+		if (!expected.GuardsIntact() || !whole.SameAs(expected) ||
+		    !sliced.SameAs(expected))
+			return false;
+	}
+	return true;
+}
+
+static void TestLevel(CpuLevel level)
+{
+	for (ColorMatrix matrix : matrices) {
+		for (ColorRange range : ranges) {
+			for (VideoFormat to : outputs) {
+				ConvertProc scalar = GetKernel(
+					to, matrix, range, CpuLevel::Scalar);
+				ConvertProc simd =
+					GetKernel(to, matrix, range, level);
+
+				for (int cx : widths) {
+					for (int cy : heights) {
+						bool ok = SameAsScalar(
+							scalar, simd,
+							VideoFormat::XRGB, to,
+							cx, cy);
+						if (!ok)
+							fprintf(stderr,
+								"%s: %s to %s, "
+								"%dx%d "
+								"differs\n",
+								CpuLevelName(
+									level),
+								MatrixName(
+									matrix),
+								to == VideoFormat::NV12
+									? "NV12"
+									: "I420",
+								cx, cy);
+						CHECK(ok);
+					}
+				}
+			}
+		}
+	}
+
+	ConvertProc scalar = GetRgbKernel(VideoFormat::RGB24, VideoFormat::XRGB,
+					  ColorMatrix::BT709,
+					  ColorRange::Limited, CpuLevel::Scalar);
+	ConvertProc simd = GetRgbKernel(VideoFormat::RGB24, VideoFormat::XRGB,
+					ColorMatrix::BT709, ColorRange::Limited,
+					level);
+
+	for (int cx : widths) {
+		for (int cy : heights) {
+			bool ok = SameAsScalar(scalar, simd, VideoFormat::RGB24,
+					       VideoFormat::XRGB, cx, cy);
+			if (!ok)
+				fprintf(stderr,
+					"%s: RGB24 to XRGB, %dx%d differs\n",
+					CpuLevelName(level), cx, cy);
+			CHECK(ok);
+		}
+	}
+}
+
+int main()
+{
+	TestPrimaries(CpuLevel::Scalar);
+	TestReference();
+	TestOddEdges();
+	TestFlip();
+	TestRgb24();
+
+	for (CpuLevel level : GetTestLevels()) {
+		TestPrimaries(level);
+		TestLevel(level);
+	}
+
+	CHECK(!GetRgbKernel(VideoFormat::RGB24, VideoFormat::NV12,
+			    ColorMatrix::BT709, ColorRange::Limited,
+			    CpuLevel::Scalar));
+	CHECK(!GetRgbKernel(VideoFormat::XRGB, VideoFormat::P010,
+			    ColorMatrix::BT709, ColorRange::Limited,
+			    CpuLevel::Scalar));
+
+	return TestResult("convert-rgb-test");
+}
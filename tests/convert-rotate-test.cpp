@@ -0,0 +1,242 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * Checks the rotation kernels: where every element of each plane ends up
+ * for 90, 180 and 270 degrees, and every SIMD level the CPU supports against
+ * the scalar kernels, over non-square sizes around the tile and cache block
+ * sizes.
+ */
+
+#include "convert-test-util.hpp"
+
+using namespace DShow;
+
+static const VideoFormat formats[] = {VideoFormat::NV12, VideoFormat::I420,
+				      VideoFormat::Y800, VideoFormat::XRGB};
+static const int rotations[] = {90, 180, 270};
+
+/* rotated sizes, 4:2:0 formats skip the odd ones */
+static const struct {
+	int cx, cy;
+} sizes[] = {
+	{2, 4},    {4, 2},    {6, 10},   {16, 8},  {8, 24},   {18, 34},
+	{40, 24},  {34, 66},  {66, 130}, {96, 64}, {130, 258}, {1, 1},
+	{7, 13},   {13, 7},   {33, 9},   {65, 31},
+};
+
+static const char *FormatName(VideoFormat format)
+{
+	switch (format) {
+	case VideoFormat::NV12:
+		return "NV12";
+	case VideoFormat::I420:
+		return "I420";
+	case VideoFormat::Y800:
+		return "Y800";
+	default:
+		return "XRGB";
+	}
+}
+
+static bool Is420(VideoFormat format)
+{
+	return format == VideoFormat::NV12 || format == VideoFormat::I420;
+}
+
+/* bytes per element of a plane, which is what the kernels move around */
+static int ElementBytes(VideoFormat format, int plane)
+{
+	if (format == VideoFormat::XRGB)
+		return 4;
+	if (format == VideoFormat::NV12 && plane == 1)
+		return 2;
+	return 1;
+}
+
+static int Planes(VideoFormat format)
+{
+	switch (format) {
+	case VideoFormat::NV12:
+		return 2;
+	case VideoFormat::I420:
+		return 3;
+	default:
+		return 1;
+	}
+}
+
+/* source size of a rotated size */
+static void SourceSize(int rotation, int cx, int cy, int &srcCx, int &srcCy)
+{
+	srcCx = rotation == 180 ? cx : cy;
+	srcCy = rotation == 180 ? cy : cx;
+}
+
+static TestImage Rotate(ConvertProc proc, const TestImage &src,
+			VideoFormat format, int cx, int cy, int sliceRows = 0)
+{
+	TestImage dst(format, cx, cy);
+	ConvertFrame frame = {};
+	src.AttachSource(frame);
+	dst.AttachDest(frame);
+	frame.cx = cx;
+	frame.cy = cy;
+
+	RunConvert(proc, frame, sliceRows);
+	return dst;
+}
+
+/*
+ * Clockwise: 90 takes destination (x, y) from source column y of row
+ * h - 1 - x, 270 from column w - 1 - y of row x, 180 from the mirrored
+ * position, with w and h the size of the source plane.
+ */
+static bool PositionsMatch(const TestImage &src, const TestImage &dst,
+			   VideoFormat format, int rotation, int cx, int cy)
+{
+	for (int plane = 0; plane < Planes(format); plane++) {
+		const int b = ElementBytes(format, plane);
+		const int w = plane ? cx / 2 : cx;
+		const int h = plane ? cy / 2 : cy;
+		int srcW, srcH;
+		SourceSize(rotation, w, h, srcW, srcH);
+
+		for (int y = 0; y < h; y++) {
+			for (int x = 0; x < w; x++) {
+				int sx, sy;
+				if (rotation == 90) {
+					sx = y;
+					sy = srcH - 1 - x;
+				} else if (rotation == 270) {
+					sx = srcW - 1 - y;
+					sy = x;
+				} else {
+					sx = srcW - 1 - x;
+					sy = srcH - 1 - y;
+				}
+
+				if (memcmp(dst.Row(plane, y) + x * b,
+					   src.Row(plane, sy) + sx * b, b) != 0)
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+static void TestPositions(CpuLevel level)
+{
+	for (VideoFormat format : formats) {
+		for (int rotation : rotations) {
+			ConvertProc proc =
+				GetRotateKernel(format, rotation, level);
+			CHECK(proc != nullptr);
+			if (!proc)
+				continue;
+
+			for (const auto &size : sizes) {
+				if (Is420(format) &&
+				    ((size.cx | size.cy) & 1) != 0)
+					continue;
+
+				int srcCx, srcCy;
+				SourceSize(rotation, size.cx, size.cy, srcCx,
+					   srcCy);
+
+				TestImage src(format, srcCx, srcCy);
+				src.Fill((unsigned)(size.cx * 131 + size.cy));
+
+				TestImage out = Rotate(proc, src, format,
+						       size.cx, size.cy);
+				bool ok = out.GuardsIntact() &&
+					  PositionsMatch(src, out, format,
+							 rotation, size.cx,
+							 size.cy);
+				if (!ok)
+					fprintf(stderr,
+						"%s: %s by %d, %dx%d is "
+						"wrong\n",
+						CpuLevelName(level),
+						FormatName(format), rotation,
+						size.cx, size.cy);
+				CHECK(ok);
+			}
+		}
+	}
+}
+
+static void TestLevel(CpuLevel level)
+{
+	for (VideoFormat format : formats) {
+		for (int rotation : rotations) {
+			ConvertProc scalar = GetRotateKernel(format, rotation,
+							     CpuLevel::Scalar);
+			ConvertProc simd =
+				GetRotateKernel(format, rotation, level);
+
+			for (const auto &size : sizes) {
+				if (Is420(format) &&
+				    ((size.cx | size.cy) & 1) != 0)
+					continue;
+
+				int srcCx, srcCy;
+				SourceSize(rotation, size.cx, size.cy, srcCx,
+					   srcCy);
+
+				TestImage src(format, srcCx, srcCy);
+				src.Fill((unsigned)(size.cx + size.cy * 17));
+
+				TestImage expected = Rotate(scalar, src, format,
+							    size.cx, size.cy);
+				TestImage whole = Rotate(simd, src, format,
+							 size.cx, size.cy);
+				TestImage sliced = Rotate(simd, src, format,
+							  size.cx, size.cy, 6);
+
+				bool ok = whole.SameAs(expected) &&
+					  sliced.SameAs(expected);
+				if (!ok)
+					fprintf(stderr,
+						"%s: %s by %d, %dx%d "
+						"differs\n",
+						CpuLevelName(level),
+						FormatName(format), rotation,
+						size.cx, size.cy);
+				CHECK(ok);
+			}
+		}
+	}
+}
+
+int main()
+{
+	TestPositions(CpuLevel::Scalar);
+
+	for (CpuLevel level : GetTestLevels()) {
+		TestPositions(level);
+		TestLevel(level);
+	}
+
+	CHECK(!GetRotateKernel(VideoFormat::NV12, 0, CpuLevel::Scalar));
+	CHECK(!GetRotateKernel(VideoFormat::NV12, 45, CpuLevel::Scalar));
+	CHECK(!GetRotateKernel(VideoFormat::YUY2, 90, CpuLevel::Scalar));
+
+	return TestResult("convert-rotate-test");
+}
@@ -0,0 +1,184 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include "convert-kernels.hpp"
+#include "test-util.hpp"
+
+#include <vector>
+
+/*
+ * Shared by the conversion kernel tests: frames laid out the way
+ * GetPlaneLayout lays them out, except that every row is followed by guard
+ * bytes which the kernels must not touch.
+ */
+
+#define TEST_GUARD 0xA5
+#define TEST_PADDING 64
+
+class TestImage {
+	std::vector<unsigned char> planes[3];
+	ptrdiff_t pitch[3] = {};
+	size_t rowBytes[3] = {};
+	int rows[3] = {};
+
+public:
+	inline TestImage(DShow::VideoFormat format, int cx, int cy)
+	{
+		DShow::PlaneLayout layout;
+		DShow::GetPlaneLayout(format, cx, cy, layout);
+
+		for (int i = 0; i < 3; i++) {
+			if (!layout.pitch[i])
+				continue;
+
+			rowBytes[i] = (size_t)layout.pitch[i];
+			rows[i] = i ? (cy + 1) / 2 : cy;
+			pitch[i] = layout.pitch[i] + TEST_PADDING;
+			planes[i].assign((size_t)(pitch[i] * rows[i]),
+					 TEST_GUARD);
+		}
+	}
+
+	inline void Fill(unsigned seed)
+	{
+		for (int i = 0; i < 3; i++) {
+			for (int y = 0; y < rows[i]; y++) {
+				unsigned char *row = Row(i, y);
+				for (size_t x = 0; x < rowBytes[i]; x++) {
+					seed = seed * 1103515245 + 12345;
+					row[x] = (unsigned char)(seed >> 16);
+				}
+			}
+		}
+	}
+
+	inline unsigned char *Row(int plane, int y)
+	{
+		return planes[plane].data() + y * pitch[plane];
+	}
+
+	inline const unsigned char *Row(int plane, int y) const
+	{
+		return planes[plane].data() + y * pitch[plane];
+	}
+
+	inline int Rows(int plane) const { return rows[plane]; }
+	inline size_t RowBytes(int plane) const { return rowBytes[plane]; }
+
+	/* flipped sources are read bottom-up through a negative pitch */
+	inline void AttachSource(DShow::ConvertFrame &frame,
+				 bool flip = false) const
+	{
+		for (int i = 0; i < 3; i++) {
+			if (planes[i].empty()) {
+				frame.src[i] = nullptr;
+				frame.srcPitch[i] = 0;
+			} else if (flip) {
+				frame.src[i] = Row(i, rows[i] - 1);
+				frame.srcPitch[i] = -pitch[i];
+			} else {
+				frame.src[i] = Row(i, 0);
+				frame.srcPitch[i] = pitch[i];
+			}
+		}
+	}
+
+	inline void AttachDest(DShow::ConvertFrame &frame)
+	{
+		for (int i = 0; i < 3; i++) {
+			frame.dst[i] = planes[i].empty() ? nullptr : Row(i, 0);
+			frame.dstPitch[i] = planes[i].empty() ? 0 : pitch[i];
+		}
+	}
+
+	inline bool SameAs(const TestImage &other) const
+	{
+		for (int i = 0; i < 3; i++)
+			if (planes[i] != other.planes[i])
+				return false;
+		return true;
+	}
+
+	inline bool GuardsIntact() const
+	{
+		for (int i = 0; i < 3; i++) {
+			for (int y = 0; y < rows[i]; y++) {
+				const unsigned char *row = Row(i, y);
+				for (ptrdiff_t x = (ptrdiff_t)rowBytes[i];
+				     x < pitch[i]; x++)
+					if (row[x] != TEST_GUARD)
+						return false;
+			}
+		}
+		return true;
+	}
+};
+
+/* converts rows [0, cy) in slices of sliceRows, or all at once if 0 */
+inline void RunConvert(DShow::ConvertProc proc,
+		       const DShow::ConvertFrame &frame, int sliceRows = 0)
+{
+	if (sliceRows <= 0) {
+		proc(frame, 0, frame.cy);
+		return;
+	}
+
+	for (int y = 0; y < frame.cy; y += sliceRows)
+		proc(frame, y, std::min(y + sliceRows, frame.cy));
+}
+
+/* SIMD levels supported by both the build and the CPU */
+inline std::vector<DShow::CpuLevel> GetTestLevels()
+{
+	std::vector<DShow::CpuLevel> levels;
+#ifdef CONVERT_SSE2
+	levels.push_back(DShow::CpuLevel::SSE2);
+#endif
+#ifdef CONVERT_AVX2
+	if (DShow::GetCpuLevel() >= DShow::CpuLevel::AVX2)
+		levels.push_back(DShow::CpuLevel::AVX2);
+#endif
+	return levels;
+}
+
+inline const char *CpuLevelName(DShow::CpuLevel level)
+{
+	switch (level) {
+	case DShow::CpuLevel::SSE2:
+		return "SSE2";
+	case DShow::CpuLevel::AVX2:
+		return "AVX2";
+	default:
+		return "scalar";
+	}
+}
+
+inline unsigned short ReadWord(const unsigned char *row, int index)
+{
+	unsigned short word;
+	memcpy(&word, row + index * 2, 2);
+	return word;
+}
+
+inline void WriteWord(unsigned char *row, int index, unsigned short word)
+{
+	memcpy(row + index * 2, &word, 2);
+}
@@ -0,0 +1,139 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * Time per frame of the packed 4:2:2 kernels at each instruction set level,
+ * on one thread and sliced on the worker pool the way the device converter
+ * runs them.
+ */
+
+#include "convert-kernels.hpp"
+#include "test-util.hpp"
+
+#include <vector>
+
+using namespace DShow;
+
+static const char *LevelName(CpuLevel level)
+{
+	switch (level) {
+	case CpuLevel::SSE2:
+		return "SSE2";
+	case CpuLevel::AVX2:
+		return "AVX2";
+	default:
+		return "scalar";
+	}
+}
+
+struct Pair {
+	const char *name;
+	VideoFormat from;
+	VideoFormat to;
+};
+
+static const Pair pairs[] = {
+	{"YUY2 to NV12", VideoFormat::YUY2, VideoFormat::NV12},
+	{"YUY2 to I420", VideoFormat::YUY2, VideoFormat::I420},
+	{"UYVY to NV12", VideoFormat::UYVY, VideoFormat::NV12},
+	{"UYVY to I420", VideoFormat::UYVY, VideoFormat::I420},
+	{"YVYU to NV12", VideoFormat::YVYU, VideoFormat::NV12},
+	{"HDYC to NV12", VideoFormat::HDYC, VideoFormat::NV12},
+};
+
+/* milliseconds per frame */
+static double TimeKernel(ConvertProc proc, ConvertFrame &frame, int frames,
+			 bool sliced)
+{
+	/* warm up the caches and the pool */
+	proc(frame, 0, frame.cy);
+
+	Stopwatch timer;
+	for (int i = 0; i < frames; i++) {
+		if (sliced)
+			RunSliced(proc, frame, 0);
+		else
+			proc(frame, 0, frame.cy);
+	}
+	double elapsed = timer.Seconds();
+
+	Consume(frame.dst[0][frame.cx / 2]);
+	return elapsed * 1000.0 / frames;
+}
+
+int main(int argc, char **argv)
+{
+	const bool quick = IsQuickRun(argc, argv);
+	const int cx = quick ? 640 : 3840;
+	const int cy = quick ? 360 : 2160;
+	const int frames = quick ? 5 : 200;
+
+	std::vector<CpuLevel> levels;
+	levels.push_back(CpuLevel::Scalar);
+#ifdef CONVERT_SSE2
+	levels.push_back(CpuLevel::SSE2);
+#endif
+#ifdef CONVERT_AVX2
+	if (GetCpuLevel() >= CpuLevel::AVX2)
+		levels.push_back(CpuLevel::AVX2);
+#endif
+
+	std::vector<unsigned char> src((size_t)cx * cy * 2);
+	for (size_t i = 0; i < src.size(); i++)
+		src[i] = (unsigned char)(i * 7 + (i >> 11));
+
+	/* large enough for either output */
+	std::vector<unsigned char> dst((size_t)cx * cy * 3 / 2);
+
+	printf("%dx%d, %d frames, %d threads\n", cx, cy, frames,
+	       WorkerPool::Get().Concurrency());
+	printf("%-14s %-8s %12s %12s\n", "", "", "ms/frame", "sliced");
+
+	for (const Pair &pair : pairs) {
+		PlaneLayout layout;
+		GetPlaneLayout(pair.to, cx, cy, layout);
+
+		ConvertFrame frame = {};
+		frame.src[0] = src.data();
+		frame.srcPitch[0] = cx * 2;
+		for (int i = 0; i < 3; i++) {
+			frame.dst[i] = layout.pitch[i] ? dst.data() +
+								 layout.offset[i]
+						       : nullptr;
+			frame.dstPitch[i] = layout.pitch[i];
+		}
+		frame.cx = cx;
+		frame.cy = cy;
+
+		for (CpuLevel level : levels) {
+			ConvertProc proc =
+				GetPacked422Kernel(pair.from, pair.to, level);
+			CHECK(proc != nullptr);
+			if (!proc)
+				continue;
+
+			double single = TimeKernel(proc, frame, frames, false);
+			double sliced = TimeKernel(proc, frame, frames, true);
+			printf("%-14s %-8s %12.3f %12.3f\n", pair.name,
+			       LevelName(level), single, sliced);
+		}
+	}
+
+	return TestResult("convert-yuv422-bench");
+}
@@ -0,0 +1,314 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * Checks the packed 4:2:2 to NV12/I420/YV12 kernels.  The scalar kernels are
+ * compared against a straightforward per-pixel reference, and every SIMD
+ * level the CPU supports against the scalar kernels, over odd sizes, widths
+ * around the vector lengths, and frames converted in slices.  Destination
+ * rows are padded with guard bytes that must not be touched.
+ */
+
+#include "convert-kernels.hpp"
+#include "test-util.hpp"
+
+#include <vector>
+
+using namespace DShow;
+
+#define GUARD 0xA5
+#define PADDING 64
+
+static const VideoFormat inputs[] = {VideoFormat::YUY2, VideoFormat::YVYU,
+				     VideoFormat::UYVY, VideoFormat::HDYC};
+static const VideoFormat outputs[] = {VideoFormat::NV12, VideoFormat::I420,
+				      VideoFormat::YV12};
+
+static const int widths[] = {1,  2,  3,  14, 15,  16,  17,  30,   31,   32,
+			     33, 47, 63, 64, 65, 127, 129, 1280, 1918, 1921};
+static const int heights[] = {1, 2, 3, 4, 5, 9, 16, 17};
+
+static const char *FormatName(VideoFormat format)
+{
+	switch (format) {
+	case VideoFormat::YUY2:
+		return "YUY2";
+	case VideoFormat::YVYU:
+		return "YVYU";
+	case VideoFormat::UYVY:
+		return "UYVY";
+	case VideoFormat::HDYC:
+		return "HDYC";
+	case VideoFormat::NV12:
+		return "NV12";
+	case VideoFormat::I420:
+		return "I420";
+	case VideoFormat::YV12:
+		return "YV12";
+	default:
+		return "?";
+	}
+}
+
+/* source pixel components, for the reference */
+static void GetPixel(VideoFormat format, const unsigned char *row, int x,
+		     int &y, int &u, int &v)
+{
+	const unsigned char *pair = row + (x & ~1) * 2;
+
+	switch (format) {
+	case VideoFormat::YUY2:
+		y = pair[(x & 1) * 2];
+		u = pair[1];
+		v = pair[3];
+		break;
+	case VideoFormat::YVYU:
+		y = pair[(x & 1) * 2];
+		v = pair[1];
+		u = pair[3];
+		break;
+	default:
+		y = pair[(x & 1) * 2 + 1];
+		u = pair[0];
+		v = pair[2];
+		break;
+	}
+}
+
+struct TestFrame {
+	int cx, cy;
+	int chromaCX, chromaCY;
+	bool planar;
+
+	std::vector<unsigned char> src;
+	std::vector<unsigned char> planes[3];
+	ptrdiff_t srcPitch;
+	ptrdiff_t pitch[3];
+
+	TestFrame(VideoFormat to, int cx_, int cy_)
+		: cx(cx_),
+		  cy(cy_),
+		  chromaCX((cx_ + 1) / 2),
+		  chromaCY((cy_ + 1) / 2),
+		  planar(to != VideoFormat::NV12)
+	{
+		srcPitch = chromaCX * 4;
+		src.resize((size_t)(srcPitch * cy));
+
+		pitch[0] = cx + PADDING;
+		pitch[1] = (planar ? chromaCX : chromaCX * 2) + PADDING;
+		pitch[2] = planar ? pitch[1] : 0;
+
+		planes[0].assign((size_t)(pitch[0] * cy), GUARD);
+		planes[1].assign((size_t)(pitch[1] * chromaCY), GUARD);
+		planes[2].assign((size_t)(pitch[2] * chromaCY), GUARD);
+	}
+
+	void Fill(unsigned seed)
+	{
+		for (unsigned char &byte : src) {
+			seed = seed * 1103515245 + 12345;
+			byte = (unsigned char)(seed >> 16);
+		}
+	}
+
+	/* I420 and YV12 are the same to the kernels, plane 1 is always U */
+	ConvertFrame GetConvertFrame()
+	{
+		ConvertFrame frame = {};
+		frame.src[0] = src.data();
+		frame.srcPitch[0] = srcPitch;
+		for (int i = 0; i < 3; i++) {
+			frame.dst[i] = planes[i].empty() ? nullptr
+							 : planes[i].data();
+			frame.dstPitch[i] = pitch[i];
+		}
+		frame.cx = cx;
+		frame.cy = cy;
+		return frame;
+	}
+
+	bool SamePlanes(const TestFrame &other) const
+	{
+		for (int i = 0; i < 3; i++)
+			if (planes[i] != other.planes[i])
+				return false;
+		return true;
+	}
+
+	bool GuardsIntact() const
+	{
+		const int widthsOut[3] = {cx, planar ? chromaCX : chromaCX * 2,
+					  chromaCX};
+		const int rows[3] = {cy, chromaCY, planar ? chromaCY : 0};
+
+		for (int i = 0; i < 3; i++)
+			for (int y = 0; y < rows[i]; y++)
+				for (ptrdiff_t x = widthsOut[i]; x < pitch[i];
+				     x++)
+					if (planes[i][(size_t)(y * pitch[i] +
+							       x)] != GUARD)
+						return false;
+		return true;
+	}
+};
+
+static bool MatchesReference(VideoFormat from, const TestFrame &frame)
+{
+	for (int y = 0; y < frame.cy; y++) {
+		const unsigned char *row = frame.src.data() + y * frame.srcPitch;
+
+		for (int x = 0; x < frame.cx; x++) {
+			int luma, u, v;
+			GetPixel(from, row, x, luma, u, v);
+			if (frame.planes[0][(size_t)(y * frame.pitch[0] + x)] !=
+			    luma)
+				return false;
+		}
+	}
+
+	for (int cy = 0; cy < frame.chromaCY; cy++) {
+		const int y0 = cy * 2;
+		const int y1 = y0 + 1 < frame.cy ? y0 + 1 : y0;
+		const unsigned char *row0 =
+			frame.src.data() + y0 * frame.srcPitch;
+		const unsigned char *row1 =
+			frame.src.data() + y1 * frame.srcPitch;
+
+		for (int cx = 0; cx < frame.chromaCX; cx++) {
+			int luma, u0, v0, u1, v1;
+			GetPixel(from, row0, cx * 2, luma, u0, v0);
+			GetPixel(from, row1, cx * 2, luma, u1, v1);
+			const int u = (u0 + u1 + 1) >> 1;
+			const int v = (v0 + v1 + 1) >> 1;
+
+			int gotU, gotV;
+			if (frame.planar) {
+				gotU = frame.planes[1][(size_t)(
+					cy * frame.pitch[1] + cx)];
+				gotV = frame.planes[2][(size_t)(
+					cy * frame.pitch[2] + cx)];
+			} else {
+				size_t pos = (size_t)(cy * frame.pitch[1] +
+						      cx * 2);
+				gotU = frame.planes[1][pos];
+				gotV = frame.planes[1][pos + 1];
+			}
+
+			if (gotU != u || gotV != v)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static TestFrame Convert(ConvertProc proc, VideoFormat to, int cx, int cy,
+			 unsigned seed, int sliceRows = 0)
+{
+	TestFrame frame(to, cx, cy);
+	frame.Fill(seed);
+	ConvertFrame convert = frame.GetConvertFrame();
+
+	if (sliceRows <= 0) {
+		proc(convert, 0, cy);
+	} else {
+		for (int y = 0; y < cy; y += sliceRows)
+			proc(convert, y, std::min(y + sliceRows, cy));
+	}
+
+	return frame;
+}
+
+static std::vector<CpuLevel> GetLevels()
+{
+	std::vector<CpuLevel> levels;
+#ifdef CONVERT_SSE2
+	levels.push_back(CpuLevel::SSE2);
+#endif
+#ifdef CONVERT_AVX2
+	if (GetCpuLevel() >= CpuLevel::AVX2)
+		levels.push_back(CpuLevel::AVX2);
+#endif
+	return levels;
+}
+
+static void TestPair(VideoFormat from, VideoFormat to,
+		     const std::vector<CpuLevel> &levels)
+{
+	ConvertProc scalar = GetPacked422Kernel(from, to, CpuLevel::Scalar);
+	CHECK(scalar != nullptr);
+	if (!scalar)
+		return;
+
+	for (int cx : widths) {
+		for (int cy : heights) {
+			const unsigned seed = (unsigned)(cx * 31 + cy);
+			TestFrame expected =
+				Convert(scalar, to, cx, cy, seed);
+
+			bool ok = MatchesReference(from, expected) &&
+				  expected.GuardsIntact();
+
+			/* slices are always an even number of rows */
+			for (int rows = 2; rows < cy; rows += 4) {
+				TestFrame sliced = Convert(scalar, to, cx, cy,
+							   seed, rows);
+				ok = ok && sliced.SamePlanes(expected);
+			}
+
+			for (CpuLevel level : levels) {
+				ConvertProc simd =
+					GetPacked422Kernel(from, to, level);
+				TestFrame whole =
+					Convert(simd, to, cx, cy, seed);
+				TestFrame sliced =
+					Convert(simd, to, cx, cy, seed, 2);
+
+				ok = ok && whole.SamePlanes(expected) &&
+				     sliced.SamePlanes(expected);
+			}
+
+			if (!ok)
+				fprintf(stderr, "%s to %s, %dx%d differs\n",
+					FormatName(from), FormatName(to), cx,
+					cy);
+			CHECK(ok);
+		}
+	}
+}
+
+int main()
+{
+	const std::vector<CpuLevel> levels = GetLevels();
+	printf("SIMD levels tested: %s%s\n",
+	       levels.empty() ? "none" : "SSE2",
+	       levels.size() > 1 ? ", AVX2" : "");
+
+	for (VideoFormat from : inputs)
+		for (VideoFormat to : outputs)
+			TestPair(from, to, levels);
+
+	CHECK(!GetPacked422Kernel(VideoFormat::YUY2, VideoFormat::XRGB,
+				  CpuLevel::Scalar));
+	CHECK(!GetPacked422Kernel(VideoFormat::NV12, VideoFormat::I420,
+				  CpuLevel::Scalar));
+
+	return TestResult("convert-yuv422-test");
+}
@@ -0,0 +1,126 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * Checks that stopping a delivery queue delivers what was queued before it
+ * (or counts it as droppedStop in pull mode), so that the queue's stats add
+ * up once it's stopped.  Windows only.
+ */
+
+#include "delivery-queue.hpp"
+#include "frame.hpp"
+#include "test-util.hpp"
+
+using namespace DShow;
+
+static void PushFrames(DeliveryQueue &queue, int count)
+{
+	unsigned char data[16] = {};
+
+	for (int i = 0; i < count; i++) {
+		QueuedFrame frame;
+		frame.frame = FrameRef(CopyFrame(data, sizeof(data), i, i + 1));
+		queue.Push(frame);
+	}
+}
+
+static bool StatsAddUp(const DeliveryQueue &queue)
+{
+	QueueStats stats;
+	queue.GetStats(stats);
+	return stats.queued ==
+	       stats.delivered + stats.droppedOldest + stats.droppedStop;
+}
+
+/* a slow callback leaves frames queued when Stop is called */
+static void TestDrainOnStop()
+{
+	DeliveryQueue queue;
+	QueueConfig config;
+	config.depth = 64;
+
+	std::atomic<int> delivered{0};
+	CHECK(queue.Start(config, [&](QueuedFrame &) {
+		Sleep(1);
+		delivered++;
+	}));
+
+	PushFrames(queue, 32);
+	queue.Stop();
+
+	QueueStats stats;
+	queue.GetStats(stats);
+	CHECK(delivered.load() == 32);
+	CHECK(stats.delivered == 32);
+	CHECK(stats.droppedStop == 0);
+	CHECK(StatsAddUp(queue));
+}
+
+static void TestOverflowThenStop()
+{
+	DeliveryQueue queue;
+	QueueConfig config;
+	config.depth = 4;
+
+	CHECK(queue.Start(config, [](QueuedFrame &) { Sleep(1); }));
+
+	PushFrames(queue, 100);
+	queue.Stop();
+
+	QueueStats stats;
+	queue.GetStats(stats);
+	CHECK(stats.delivered + stats.droppedOldest == 100);
+	CHECK(stats.droppedStop == 0);
+	CHECK(StatsAddUp(queue));
+}
+
+static void TestPullModeStop()
+{
+	DeliveryQueue queue;
+	QueueConfig config;
+	config.depth = 8;
+	config.pull = true;
+
+	CHECK(queue.Start(config, nullptr));
+
+	PushFrames(queue, 5);
+
+	QueuedFrame frame;
+	CHECK(queue.Pop(frame, 0));
+	CHECK(queue.Pop(frame, 0));
+	frame.frame.Release();
+
+	queue.Stop();
+
+	QueueStats stats;
+	queue.GetStats(stats);
+	CHECK(stats.delivered == 2);
+	CHECK(stats.droppedStop == 3);
+	CHECK(queue.Dropped() == 3);
+	CHECK(StatsAddUp(queue));
+}
+
+int main()
+{
+	TestDrainOnStop();
+	TestOverflowThenStop();
+	TestPullModeStop();
+
+	return TestResult("delivery-queue-test");
+}
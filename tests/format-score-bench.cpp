@@ -0,0 +1,132 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * Time to negotiate a mode, over the requests of the cap list fixtures given
+ * on the command line and over a synthetic device that lists every size,
+ * format and frame rate as a separate cap, as some capture cards do.
+ */
+
+#include "cap-fixture.hpp"
+#include "test-util.hpp"
+
+using namespace DShow;
+
+static std::vector<VideoInfo> GetLargeCapList()
+{
+	static const VideoFormat formats[] = {
+		VideoFormat::NV12, VideoFormat::YUY2,  VideoFormat::UYVY,
+		VideoFormat::XRGB, VideoFormat::MJPEG, VideoFormat::H264};
+	static const long long intervals[] = {166667, 166834, 333333, 333667,
+					      400000};
+
+	std::vector<VideoInfo> caps;
+
+	for (VideoFormat format : formats) {
+		for (int cx = 320; cx <= 3840; cx += 160) {
+			for (long long interval : intervals) {
+				VideoInfo cap = {};
+				cap.minCX = cap.maxCX = cx;
+				cap.minCY = cap.maxCY = cx * 9 / 16;
+				cap.minInterval = cap.maxInterval = interval;
+				cap.format = format;
+				cap.bandwidth = EstimateCapBandwidth(cap);
+				caps.push_back(cap);
+			}
+		}
+	}
+
+	return caps;
+}
+
+/* microseconds per negotiation */
+static double TimeNegotiation(const std::vector<VideoInfo> &caps,
+			      const std::vector<CapExpectation> &requests,
+			      int iterations)
+{
+	const VideoScoreWeights weights;
+	long long checksum = 0;
+
+	Stopwatch timer;
+	for (int i = 0; i < iterations; i++) {
+		for (const CapExpectation &request : requests) {
+			VideoSelection selection = NegotiateVideoCap(
+				caps, request.request, weights,
+				request.config);
+			checksum += selection.candidate.cx;
+		}
+	}
+	double elapsed = timer.Seconds();
+
+	Consume(checksum);
+	return elapsed * 1000000.0 / ((double)iterations * requests.size());
+}
+
+int main(int argc, char **argv)
+{
+	const bool quick = IsQuickRun(argc, argv);
+	const int iterations = quick ? 10 : 20000;
+
+	printf("%-24s %6s %9s %12s\n", "", "caps", "requests", "us/request");
+
+	std::vector<CapExpectation> allRequests;
+
+	for (int i = 1; i < argc; i++) {
+		if (argv[i][0] == '-')
+			continue;
+
+		CapFixture fixture;
+		bool loaded = LoadCapFixture(argv[i], fixture);
+		CHECK(loaded);
+		if (!loaded || fixture.expectations.empty())
+			continue;
+
+		const char *name = strrchr(argv[i], '/');
+		name = name ? name + 1 : argv[i];
+
+		double time = TimeNegotiation(fixture.caps,
+					      fixture.expectations, iterations);
+		printf("%-24s %6d %9d %12.3f\n", name, (int)fixture.caps.size(),
+		       (int)fixture.expectations.size(), time);
+
+		allRequests.insert(allRequests.end(),
+				   fixture.expectations.begin(),
+				   fixture.expectations.end());
+	}
+
+	/* the fixtures' requests against a much longer list */
+	if (allRequests.empty()) {
+		CapExpectation request;
+		request.request.cx = 1920;
+		request.request.cy = 1080;
+		request.request.frameInterval = 333333;
+		allRequests.push_back(request);
+	}
+
+	for (CapExpectation &request : allRequests)
+		request.config.internalFormat = VideoFormat::Any;
+
+	const std::vector<VideoInfo> large = GetLargeCapList();
+	double time = TimeNegotiation(large, allRequests,
+				      quick ? 1 : iterations / 50);
+	printf("%-24s %6d %9d %12.3f\n", "every mode listed",
+	       (int)large.size(), (int)allRequests.size(), time);
+
+	return TestResult("format-score-bench");
+}
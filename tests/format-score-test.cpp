@@ -0,0 +1,146 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * Negotiates every request in the cap list fixtures given on the command
+ * line and checks that it ends up with the expected mode.
+ */
+
+#include "cap-fixture.hpp"
+#include "test-util.hpp"
+
+#include <stdlib.h>
+
+using namespace DShow;
+
+static void TestFixture(const char *path)
+{
+	CapFixture fixture;
+	bool loaded = LoadCapFixture(path, fixture);
+	CHECK(loaded);
+	if (!loaded)
+		return;
+
+	CHECK(!fixture.caps.empty());
+	CHECK(!fixture.expectations.empty());
+
+	const VideoScoreWeights weights;
+
+	for (const CapExpectation &expected : fixture.expectations) {
+		const VideoSelection selection = NegotiateVideoCap(
+			fixture.caps, expected.request, weights,
+			expected.config);
+		const VideoCandidate &chosen = selection.candidate;
+
+		/* same tolerance as when the interval is set on a cap */
+		bool matches = selection.found &&
+			       chosen.format == expected.format &&
+			       chosen.cx == expected.cx &&
+			       chosen.cy == expected.cy &&
+			       llabs(chosen.frameInterval -
+				     expected.frameInterval) <= 1;
+
+		if (!matches)
+			fprintf(stderr,
+				"%s:%d: expected %s %dx%d %lld, got %s %dx%d "
+				"%lld (score %.3f)\n",
+				path, expected.line,
+				VideoFormatName(expected.format), expected.cx,
+				expected.cy, expected.frameInterval,
+				VideoFormatName(chosen.format), chosen.cx,
+				chosen.cy, chosen.frameInterval,
+				selection.score.total);
+		CHECK(matches);
+	}
+}
+
+static void TestSelection()
+{
+	VideoInfo cap = {};
+	cap.minCX = cap.maxCX = 1280;
+	cap.minCY = cap.maxCY = 720;
+	cap.minInterval = cap.maxInterval = 333333;
+	cap.format = VideoFormat::NV12;
+
+	VideoRequest request;
+	request.cx = 1280;
+	request.cy = 720;
+	request.frameInterval = 333333;
+
+	const VideoScoreWeights weights;
+	const VideoConfig config;
+
+	/* nothing to choose from */
+	std::vector<VideoInfo> caps;
+	CHECK(!NegotiateVideoCap(caps, request, weights, config).found);
+
+	/* an exact NV12 match costs nothing */
+	caps.push_back(cap);
+	VideoSelection selection =
+		NegotiateVideoCap(caps, request, weights, config);
+	CHECK(selection.found);
+	CHECK(selection.score.total == 0.0);
+
+	/* the first of equally good caps is kept */
+	VideoCandidate first = FitVideoCap(cap, request, false);
+	VideoCandidate second = first;
+	second.fitsCX = false;
+	VideoScore score = ScoreVideoCandidate(request, first, weights);
+
+	selection = VideoSelection();
+	CHECK(selection.Consider(first, score));
+	CHECK(!selection.Consider(second, score));
+	CHECK(selection.candidate.fitsCX);
+}
+
+/* scaling is decided per cap, by what its format can be converted to */
+static void TestCanScale()
+{
+	VideoConfig config;
+	CHECK(!CanScale(config, VideoFormat::YUY2));
+
+	config.scaling = ScaleMode::Bilinear;
+	CHECK(CanScale(config, VideoFormat::YUY2));
+	CHECK(CanScale(config, VideoFormat::NV12));
+	CHECK(!CanScale(config, VideoFormat::MJPEG));
+	CHECK(!CanScale(config, VideoFormat::H264));
+	CHECK(!CanScale(config, VideoFormat::RGB24));
+
+	config.format = VideoFormat::NV12;
+	CHECK(CanScale(config, VideoFormat::YUY2));
+	CHECK(CanScale(config, VideoFormat::P010));
+	CHECK(!CanScale(config, VideoFormat::RGB24));
+
+	config.format = VideoFormat::XRGB;
+	CHECK(CanScale(config, VideoFormat::RGB24));
+	CHECK(!CanScale(config, VideoFormat::YUY2));
+}
+
+int main(int argc, char **argv)
+{
+	CHECK(argc > 1);
+
+	for (int i = 1; i < argc; i++)
+		TestFixture(argv[i]);
+
+	TestSelection();
+	TestCanScale();
+
+	return TestResult("format-score-test");
+}
@@ -0,0 +1,167 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * Checks FrameFingerprint and the FrameSignature used to detect repeated
+ * frames: which changes it notices, and that it never needs the previous
+ * frame's buffer.
+ */
+
+#include "frame-hash.hpp"
+#include "test-util.hpp"
+
+#include <vector>
+
+using namespace DShow;
+
+struct TestFrame {
+	int cx, cy;
+	std::vector<unsigned char> data;
+
+	/* NV12 */
+	TestFrame(int cx_, int cy_, unsigned seed)
+		: cx(cx_), cy(cy_), data((size_t)cx_ * cy_ * 3 / 2)
+	{
+		for (unsigned char &byte : data) {
+			seed = seed * 1103515245 + 12345;
+			byte = (unsigned char)(seed >> 16);
+		}
+	}
+
+	inline unsigned char &Luma(int x, int y)
+	{
+		return data[(size_t)y * cx + x];
+	}
+
+	bool Update(FrameSignature &signature) const
+	{
+		return signature.Update(data.data(), data.size(),
+					VideoFormat::NV12, cx, cy);
+	}
+
+	unsigned long long Fingerprint() const
+	{
+		return FrameFingerprint(data.data(), data.size(),
+					VideoFormat::NV12, cx, cy);
+	}
+};
+
+static void TestFingerprint()
+{
+	TestFrame a(1920, 1080, 1);
+	TestFrame b(1920, 1080, 1);
+	TestFrame c(1920, 1080, 2);
+
+	CHECK(a.Fingerprint() != 0);
+	CHECK(a.Fingerprint() == b.Fingerprint());
+	CHECK(a.Fingerprint() != c.Fingerprint());
+	CHECK(FrameFingerprint(nullptr, 0, VideoFormat::NV12, 0, 0) == 0);
+}
+
+static void TestRepeats()
+{
+	FrameSignature signature;
+	TestFrame frame(1920, 1080, 1);
+
+	CHECK(!frame.Update(signature));
+	CHECK(frame.Update(signature));
+
+	/* first, last and a sampled row in between (1080 / 64 = every 16) */
+	const int sampledRows[] = {0, 1079, 16 * 20};
+	for (int y : sampledRows) {
+		TestFrame changed = frame;
+		changed.Luma(100, y) ^= 1;
+		CHECK(!changed.Update(signature));
+		CHECK(!frame.Update(signature));
+	}
+
+	/* rows in between aren't compared */
+	TestFrame between = frame;
+	between.Luma(100, 17) ^= 1;
+	CHECK(between.Update(signature));
+
+	/* a different size is never a repeat */
+	TestFrame smaller(1280, 720, 1);
+	CHECK(!smaller.Update(signature));
+
+	signature.Reset();
+	CHECK(!smaller.Update(signature));
+	CHECK(smaller.Update(signature));
+}
+
+/* the signature keeps its own copy, the frame can go away */
+static void TestNoReference()
+{
+	FrameSignature signature;
+
+	{
+		TestFrame frame(640, 480, 3);
+		CHECK(!frame.Update(signature));
+		frame.data.assign(frame.data.size(), 0);
+	}
+
+	TestFrame copy(640, 480, 3);
+	CHECK(copy.Update(signature));
+}
+
+/* fewer rows than are sampled, every one of them is compared */
+static void TestSmallFrame()
+{
+	FrameSignature signature;
+	TestFrame frame(33, 17, 4);
+	CHECK(!frame.Update(signature));
+
+	bool ok = true;
+	for (int y = 0; y < frame.cy; y++) {
+		TestFrame changed = frame;
+		changed.Luma(32, y) ^= 0x80;
+		ok = ok && !changed.Update(signature);
+		ok = ok && !frame.Update(signature);
+	}
+	CHECK(ok);
+}
+
+/* formats without a known row layout are sampled as a whole buffer */
+static void TestUnknownLayout()
+{
+	FrameSignature signature;
+	std::vector<unsigned char> data(100000, 7);
+
+	CHECK(!signature.Update(data.data(), data.size(), VideoFormat::MJPEG,
+				1920, 1080));
+	CHECK(signature.Update(data.data(), data.size(), VideoFormat::MJPEG,
+			       1920, 1080));
+
+	data[0] = 8;
+	CHECK(!signature.Update(data.data(), data.size(), VideoFormat::MJPEG,
+				1920, 1080));
+
+	CHECK(!signature.Update(nullptr, 0, VideoFormat::MJPEG, 0, 0));
+}
+
+int main()
+{
+	TestFingerprint();
+	TestRepeats();
+	TestNoReference();
+	TestSmallFrame();
+	TestUnknownLayout();
+
+	return TestResult("frame-hash-test");
+}
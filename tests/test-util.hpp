@@ -0,0 +1,86 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+#pragma once
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Minimal checks shared by the tests.  Failures are counted instead of
+ * aborting, so that a single run reports all of them.
+ */
+
+inline int &TestFailures()
+{
+	static int failures = 0;
+	return failures;
+}
+
+#define CHECK(cond)                                                    \
+	do {                                                           \
+		if (!(cond)) {                                         \
+			fprintf(stderr, "%s:%d: check failed: %s\n",   \
+				__FILE__, __LINE__, #cond);            \
+			TestFailures()++;                              \
+		}                                                      \
+	} while (false)
+
+inline int TestResult(const char *name)
+{
+	if (TestFailures()) {
+		fprintf(stderr, "%s: %d check(s) failed\n", name,
+			TestFailures());
+		return 1;
+	}
+
+	printf("%s: passed\n", name);
+	return 0;
+}
+
+/* benchmarks are run briefly with --quick, which is how ctest runs them */
+inline bool IsQuickRun(int argc, char **argv)
+{
+	for (int i = 1; i < argc; i++)
+		if (strcmp(argv[i], "--quick") == 0)
+			return true;
+	return false;
+}
+
+class Stopwatch {
+	std::chrono::steady_clock::time_point start;
+
+public:
+	inline Stopwatch() : start(std::chrono::steady_clock::now()) {}
+
+	inline double Seconds() const
+	{
+		std::chrono::duration<double> elapsed =
+			std::chrono::steady_clock::now() - start;
+		return elapsed.count();
+	}
+};
+
+/* keeps the compiler from optimizing away a benchmark's work */
+template<typename T> inline void Consume(const T &value)
+{
+	static volatile unsigned long long sink;
+	sink = sink + (unsigned long long)value;
+}
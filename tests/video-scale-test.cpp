@@ -0,0 +1,321 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * Checks the scaler: that every filter's weights sum to WEIGHT_ONE and stay
+ * inside the source, the clamped edges of area and bilinear filters, and the
+ * vertical pass of every SIMD level the CPU supports against the scalar one.
+ */
+
+#include "video-scale.hpp"
+#include "convert-test-util.hpp"
+
+#include <math.h>
+
+using namespace DShow;
+
+static const ScaleMode modes[] = {ScaleMode::Bilinear, ScaleMode::Area};
+
+static const int sizes[] = {1,  2,   3,   4,   5,   7,   9,    10,   16,
+			    17, 240, 480, 720, 1080, 1280, 1920, 3840};
+
+/* ------------------------------------------------------------------------- */
+
+static bool WeightsValid(const ScaleFilter &filter, int srcSize, int dstSize)
+{
+	if (filter.taps < 1 || (int)filter.start.size() != dstSize ||
+	    filter.weights.size() != (size_t)dstSize * filter.taps)
+		return false;
+
+	for (int i = 0; i < dstSize; i++) {
+		const short *w = &filter.weights[(size_t)i * filter.taps];
+		int sum = 0;
+
+		for (int k = 0; k < filter.taps; k++) {
+			if (w[k] < 0)
+				return false;
+			sum += w[k];
+		}
+
+		if (sum != WEIGHT_ONE || filter.start[i] < 0 ||
+		    filter.start[i] + filter.taps > srcSize)
+			return false;
+	}
+	return true;
+}
+
+static void TestWeightSums()
+{
+	for (ScaleMode mode : modes) {
+		for (int srcSize : sizes) {
+			for (int dstSize : sizes) {
+				ScaleFilter filter;
+				filter.Reset(srcSize, dstSize, mode);
+
+				bool ok = WeightsValid(filter, srcSize, dstSize);
+				if (!ok)
+					fprintf(stderr,
+						"%s: %d to %d has bad "
+						"weights\n",
+						mode == ScaleMode::Area
+							? "area"
+							: "bilinear",
+						srcSize, dstSize);
+				CHECK(ok);
+			}
+		}
+	}
+}
+
+/* every source sample is weighted by how much of it the output covers, also
+ * for the last outputs whose first tap is pulled back by the clamp */
+static bool AreaWeightsCover(const ScaleFilter &filter, int srcSize,
+			     int dstSize)
+{
+	const double ratio = (double)srcSize / dstSize;
+
+	for (int i = 0; i < dstSize; i++) {
+		const double a = i * ratio;
+		const double b = a + ratio;
+		double covered = 0.0;
+
+		for (int k = 0; k < filter.taps; k++) {
+			const int j = filter.start[i] + k;
+			const double overlap =
+				std::max(0.0, std::min(b, j + 1.0) -
+						      std::max(a, (double)j));
+			const double expected = overlap / ratio * WEIGHT_ONE;
+			const short w =
+				filter.weights[(size_t)i * filter.taps + k];
+
+			if (fabs(w - expected) > filter.taps)
+				return false;
+			covered += overlap;
+		}
+
+		/* nothing of the output's span is left outside the taps */
+		if (fabs(covered - ratio) > 1e-9)
+			return false;
+	}
+	return true;
+}
+
+static void TestAreaEdges()
+{
+	/* 10 to 3: 5 taps, the last output starts at 6.67 and is clamped to
+	 * start at 5 so it doesn't read past sample 9 */
+	ScaleFilter filter;
+	filter.Reset(10, 3, ScaleMode::Area);
+	CHECK(filter.taps == 5);
+	CHECK(filter.start[0] == 0);
+	CHECK(filter.start[2] == 5);
+	CHECK(filter.weights[2 * 5] == 0);
+	CHECK(AreaWeightsCover(filter, 10, 3));
+
+	/* taps are limited to the source size */
+	filter.Reset(3, 1, ScaleMode::Area);
+	CHECK(filter.taps == 3);
+	CHECK(filter.start[0] == 0);
+
+	for (int srcSize : sizes) {
+		for (int dstSize : sizes) {
+			if (srcSize <= dstSize)
+				continue;
+
+			filter.Reset(srcSize, dstSize, ScaleMode::Area);
+			bool ok = AreaWeightsCover(filter, srcSize, dstSize);
+			if (!ok)
+				fprintf(stderr,
+					"area: %d to %d doesn't cover the "
+					"source\n",
+					srcSize, dstSize);
+			CHECK(ok);
+		}
+	}
+
+	/* upscaling with area falls back to bilinear */
+	ScaleFilter bilinear;
+	filter.Reset(4, 9, ScaleMode::Area);
+	bilinear.Reset(4, 9, ScaleMode::Bilinear);
+	CHECK(filter.taps == 2);
+	CHECK(filter.start == bilinear.start);
+	CHECK(filter.weights == bilinear.weights);
+}
+
+static void TestBilinearEdges()
+{
+	/* 4 to 8: the first center (-0.25) is clamped to sample 0, the last
+	 * (3.25) to sample 3 through the second tap of the last pair */
+	ScaleFilter filter;
+	filter.Reset(4, 8, ScaleMode::Bilinear);
+	CHECK(filter.taps == 2);
+	CHECK(filter.start[0] == 0);
+	CHECK(filter.weights[0] == WEIGHT_ONE && filter.weights[1] == 0);
+	CHECK(filter.start[7] == 2);
+	CHECK(filter.weights[14] == 0 && filter.weights[15] == WEIGHT_ONE);
+
+	/* halfway between samples 0 and 1 */
+	filter.Reset(4, 2, ScaleMode::Bilinear);
+	CHECK(filter.start[0] == 0);
+	CHECK(filter.weights[0] == WEIGHT_ONE / 2);
+
+	/* the same size is a copy */
+	filter.Reset(17, 17, ScaleMode::Bilinear);
+	bool ok = true;
+	for (int i = 0; i < 16; i++)
+		ok = ok && filter.start[i] == i &&
+		     filter.weights[i * 2] == WEIGHT_ONE;
+	CHECK(ok);
+	CHECK(filter.start[16] == 15 && filter.weights[33] == WEIGHT_ONE);
+
+	/* a single source sample has a single tap */
+	for (ScaleMode mode : modes) {
+		for (int dstSize : {1, 2, 7}) {
+			filter.Reset(1, dstSize, mode);
+			ok = filter.taps == 1;
+			for (int i = 0; ok && i < dstSize; i++)
+				ok = filter.start[i] == 0 &&
+				     filter.weights[i] == WEIGHT_ONE;
+			CHECK(ok);
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void TestVertical(CpuLevel level)
+{
+	VerticalProc scalar = GetVerticalProc(CpuLevel::Scalar);
+	VerticalProc simd = GetVerticalProc(level);
+
+	unsigned seed = 1;
+	auto random = [&]() {
+		seed = seed * 1103515245 + 12345;
+		return seed >> 16;
+	};
+
+	for (int taps = 1; taps <= 6; taps++) {
+		for (int n : {1, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65, 129,
+			      1921}) {
+			std::vector<unsigned char> src((size_t)taps * n);
+			std::vector<const unsigned char *> rows(taps);
+			for (auto &v : src)
+				v = (unsigned char)random();
+			for (int k = 0; k < taps; k++)
+				rows[k] = &src[(size_t)k * n];
+
+			/* weights summing to WEIGHT_ONE, with the extremes
+			 * every so often */
+			std::vector<short> w(taps);
+			int left = WEIGHT_ONE;
+			for (int k = 0; k < taps - 1; k++) {
+				w[k] = (short)(n & 1 ? random() % (left + 1)
+						     : (k == 0 ? left : 0));
+				left -= w[k];
+			}
+			w[taps - 1] = (short)left;
+
+			std::vector<unsigned char> expected(n + TEST_PADDING,
+							    TEST_GUARD);
+			std::vector<unsigned char> out(n + TEST_PADDING,
+						       TEST_GUARD);
+			scalar(rows.data(), w.data(), taps, expected.data(), 0,
+			       n);
+			simd(rows.data(), w.data(), taps, out.data(), 0, n);
+
+			bool ok = out == expected;
+			if (!ok)
+				fprintf(stderr,
+					"%s: %d taps over %d differs\n",
+					CpuLevelName(level), taps, n);
+			CHECK(ok);
+
+			/* starting past the first columns leaves them be */
+			if (n > 5) {
+				std::vector<unsigned char> tail(
+					n + TEST_PADDING, TEST_GUARD);
+				simd(rows.data(), w.data(), taps, tail.data(),
+				     5, n);
+				CHECK(memcmp(tail.data() + 5,
+					     expected.data() + 5, n - 5) == 0);
+				CHECK(tail[4] == TEST_GUARD);
+			}
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void TestScaler()
+{
+	VideoScaler scaler;
+	CHECK(!scaler.Reset(VideoFormat::MJPEG, 64, 64, 32, 32,
+			    ScaleMode::Bilinear));
+	CHECK(!scaler.Reset(VideoFormat::Y800, 64, 64, 32, 32,
+			    ScaleMode::None));
+
+	/* the same size through bilinear is a copy */
+	const int cx = 37, cy = 11;
+	CHECK(scaler.Reset(VideoFormat::Y800, cx, cy, cx, cy,
+			   ScaleMode::Bilinear));
+
+	std::vector<unsigned char> src((size_t)cx * cy);
+	std::vector<unsigned char> dst(src.size());
+	for (size_t i = 0; i < src.size(); i++)
+		src[i] = (unsigned char)(i * 7);
+	scaler.Scale(src.data(), dst.data(), 0);
+	CHECK(dst == src);
+
+	/* a solid frame stays solid in every direction */
+	for (ScaleMode mode : modes) {
+		for (int dstCX : {19, 100}) {
+			CHECK(scaler.Reset(VideoFormat::I420, 50, 30, dstCX, 13,
+					   mode));
+			const PlaneLayout &in = scaler.InputLayout();
+			const PlaneLayout &out = scaler.OutputLayout();
+
+			src.assign(in.size, 0);
+			memset(src.data(), 77, in.offset[1]);
+			memset(src.data() + in.offset[1], 200,
+			       in.size - in.offset[1]);
+
+			dst.assign(out.size, 0);
+			scaler.Scale(src.data(), dst.data(), 0);
+
+			bool ok = true;
+			for (size_t i = 0; i < out.size; i++)
+				ok = ok &&
+				     dst[i] == (i < out.offset[1] ? 77 : 200);
+			CHECK(ok);
+		}
+	}
+}
+
+int main()
+{
+	TestWeightSums();
+	TestAreaEdges();
+	TestBilinearEdges();
+	TestScaler();
+
+	for (CpuLevel level : GetTestLevels())
+		TestVertical(level);
+
+	return TestResult("video-scale-test");
+}
@@ -0,0 +1,121 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * Scheduling overhead of WorkerPool::Run with empty slices, from one and
+ * from several submitting threads (devices), and the speedup it gets on
+ * memory bound work the size of a 4K NV12 frame.
+ */
+
+#include "worker-pool.hpp"
+#include "test-util.hpp"
+
+#include <algorithm>
+
+using namespace DShow;
+
+static unsigned GetWorkerCount()
+{
+	unsigned cores = std::thread::hardware_concurrency();
+	return std::max(std::min(cores, 16u), 2u) - 1;
+}
+
+/* microseconds per Run */
+static double TimeEmptyRuns(WorkerPool &pool, int count, int submitters,
+			    int runs)
+{
+	std::atomic<long long> slices{0};
+	std::vector<std::thread> threads;
+
+	Stopwatch timer;
+	for (int i = 0; i < submitters; i++) {
+		threads.emplace_back([&, i] {
+			std::atomic<long long> local{0};
+			for (int run = 0; run < runs; run++)
+				pool.Run(count, (unsigned)i, [&](int slice) {
+					local.fetch_add(
+						slice,
+						std::memory_order_relaxed);
+				});
+			slices += local.load();
+		});
+	}
+	for (std::thread &thread : threads)
+		thread.join();
+	double elapsed = timer.Seconds();
+
+	const long long expected = (long long)submitters * runs * count *
+				   (count - 1) / 2;
+	CHECK(slices.load() == expected);
+	return elapsed * 1000000.0 / runs;
+}
+
+/* milliseconds per pass over the buffer */
+static double TimeMemoryBound(WorkerPool &pool, std::vector<unsigned> &buffer,
+			      int slices, int passes)
+{
+	const size_t rows = buffer.size() / 1024;
+	unsigned *data = buffer.data();
+
+	Stopwatch timer;
+	for (int pass = 0; pass < passes; pass++) {
+		pool.Run(slices, 0, [&](int slice) {
+			size_t y0 = rows * slice / slices;
+			size_t y1 = rows * (slice + 1) / slices;
+			for (size_t i = y0 * 1024; i < y1 * 1024; i++)
+				data[i] = data[i] * 3 + 1;
+		});
+	}
+	double elapsed = timer.Seconds();
+
+	Consume(data[buffer.size() / 2]);
+	return elapsed * 1000.0 / passes;
+}
+
+int main(int argc, char **argv)
+{
+	const bool quick = IsQuickRun(argc, argv);
+	const int runs = quick ? 200 : 50000;
+	const int passes = quick ? 2 : 100;
+
+	WorkerPool pool(GetWorkerCount());
+	printf("%d threads\n\n", pool.Concurrency());
+
+	printf("empty slices, us per Run\n");
+	printf("%8s %12s %12s\n", "slices", "1 submitter", "4 submitters");
+	for (int count : {2, 4, 8, 16}) {
+		double single = TimeEmptyRuns(pool, count, 1, runs);
+		double shared = TimeEmptyRuns(pool, count, 4, runs);
+		printf("%8d %12.2f %12.2f\n", count, single, shared);
+	}
+
+	/* 3840x2160 NV12 */
+	std::vector<unsigned> buffer(3840 * 2160 * 3 / 2 / 4);
+
+	printf("\nmemory bound, %d KB per pass\n",
+	       (int)(buffer.size() * 4 / 1024));
+	printf("%8s %12s %12s\n", "slices", "ms/pass", "speedup");
+	double base = TimeMemoryBound(pool, buffer, 1, passes);
+	for (int count = 1; count <= pool.Concurrency(); count *= 2) {
+		double time = TimeMemoryBound(pool, buffer, count, passes);
+		printf("%8d %12.3f %12.2f\n", count, time, base / time);
+	}
+
+	return TestResult("worker-pool-bench");
+}
@@ -0,0 +1,167 @@
+/*
+ *  Copyright (C) 2023 Lain Bailey <lain@obsproject.com>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ */
+
+/*
+ * Checks that WorkerPool::Run calls every slice exactly once before
+ * returning, with several threads submitting at once, that slices actually
+ * run in parallel whatever the affinity, and that a pool can be torn down.
+ */
+
+#include "worker-pool.hpp"
+#include "test-util.hpp"
+
+#include <memory>
+
+using namespace DShow;
+
+#define MAX_SLICES 64
+
+static bool RunsEverySliceOnce(WorkerPool &pool, int count, unsigned affinity)
+{
+	std::atomic<int> calls[MAX_SLICES];
+	for (std::atomic<int> &c : calls)
+		c = 0;
+
+	pool.Run(count, affinity, [&](int slice) {
+		if (slice >= 0 && slice < MAX_SLICES)
+			calls[slice]++;
+	});
+
+	for (int i = 0; i < MAX_SLICES; i++)
+		if (calls[i].load() != (i < count ? 1 : 0))
+			return false;
+	return true;
+}
+
+static void TestSingleSubmitter(unsigned workers)
+{
+	WorkerPool pool(workers);
+	CHECK(pool.Concurrency() == (int)workers + 1);
+
+	bool ok = true;
+	for (int iteration = 0; iteration < 200; iteration++)
+		for (int count = 0; count <= MAX_SLICES; count += 3)
+			ok = ok && RunsEverySliceOnce(pool, count,
+						      (unsigned)iteration);
+	CHECK(ok);
+}
+
+static void TestConcurrentSubmitters(unsigned workers)
+{
+	WorkerPool pool(workers);
+	std::atomic<int> failures{0};
+	std::vector<std::thread> submitters;
+
+	for (unsigned i = 0; i < 4; i++) {
+		submitters.emplace_back([&, i] {
+			for (int iteration = 0; iteration < 2000; iteration++) {
+				int count = 2 + (iteration + (int)i) % 17;
+				if (!RunsEverySliceOnce(pool, count, i))
+					failures++;
+			}
+		});
+	}
+
+	for (std::thread &thread : submitters)
+		thread.join();
+	CHECK(failures.load() == 0);
+}
+
+/* every slice waits for all of the others, which can only finish if each of
+ * them is on a different thread */
+static bool RunsInParallel(WorkerPool &pool, unsigned affinity)
+{
+	const int count = pool.Concurrency();
+	std::atomic<int> arrived{0};
+	std::atomic<bool> timedOut{false};
+
+	pool.Run(count, affinity, [&](int) {
+		arrived++;
+
+		Stopwatch timer;
+		while (arrived.load() < count) {
+			if (timer.Seconds() > 5.0) {
+				timedOut = true;
+				break;
+			}
+			std::this_thread::yield();
+		}
+	});
+
+	return !timedOut.load();
+}
+
+static void TestParallelism(unsigned workers)
+{
+	WorkerPool pool(workers);
+
+	bool ok = true;
+	for (unsigned affinity = 0; affinity < 2 * workers + 1; affinity++)
+		ok = ok && RunsInParallel(pool, affinity);
+	CHECK(ok);
+}
+
+/* a slice dealt to a worker stuck on another job is stolen instead */
+static void TestStealing()
+{
+	WorkerPool pool(3);
+	std::atomic<bool> release{false};
+	std::atomic<int> blocked{0};
+
+	/* slice 1 is left for a worker to pick up, which then stays busy */
+	std::thread blocker([&] {
+		pool.Run(2, 0, [&](int slice) {
+			if (slice == 1) {
+				blocked = 1;
+				while (!release.load())
+					std::this_thread::yield();
+			} else {
+				while (!blocked.load())
+					std::this_thread::yield();
+			}
+		});
+	});
+
+	while (!blocked.load())
+		std::this_thread::yield();
+
+	/* one of the slices is always dealt to the busy worker */
+	bool ok = true;
+	for (int i = 0; i < 100; i++)
+		ok = ok && RunsEverySliceOnce(pool, 8, 0);
+	CHECK(ok);
+
+	release = true;
+	blocker.join();
+}
+
+int main()
+{
+	for (unsigned workers : {0u, 1u, 3u, 7u}) {
+		TestSingleSubmitter(workers);
+		TestConcurrentSubmitters(workers);
+	}
+
+	for (unsigned workers : {1u, 3u, 7u})
+		TestParallelism(workers);
+
+	TestStealing();
+
+	return TestResult("worker-pool-test");
+}